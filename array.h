@@ -0,0 +1,40 @@
+/*
+ * Growing arrays indexed by an id.
+ *
+ * Copyright 2026 agent
+ * Author: agent <agent@local>
+ * License: GPLv2
+ */
+#ifndef _ARRAY_H
+#define _ARRAY_H
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Makes (*array)[index] valid in an array of size byte elements, zeroing
+ * the new ones. The array at least doubles, *alloc is its length. On
+ * failure the array is left as it was.
+ */
+static inline int grow_array(void *array, unsigned *alloc, unsigned index, size_t size)
+{
+	unsigned new_alloc;
+	void *n;
+
+	if (index < *alloc)
+		return 0;
+
+	new_alloc = *alloc ? 2 * *alloc : 64;
+	if (new_alloc <= index)
+		new_alloc = index + 1;
+	n = realloc(*(void **) array, new_alloc * size);
+	if (!n)
+		return -ENOMEM;
+	memset((char *) n + *alloc * size, 0, (new_alloc - *alloc) * size);
+	*(void **) array = n;
+	*alloc = new_alloc;
+	return 0;
+}
+
+#endif
@@ -9,6 +9,7 @@
 
 #include "back_trace.h"
 #include "sym_translator.h"
+#include "lat_translator.h"
 
 int bt_compare(const struct back_trace *b1, const struct back_trace *b2)
 {
@@ -55,6 +56,29 @@ void bt_save_symbolic(const struct back_trace *b, char *buf, size_t buflen)
 	*buf = '\0';
 }
 
+const char *bt_translate(const struct back_trace *b)
+{
+	int i, index, id, prio;
+	int best_id = -1, best_prio = INT_MIN;
+
+	for (i = 0; i < MAX_BT_LEN; i++) {
+		if (b->trace[i] == 0 || b->trace[i] == ULONG_MAX)
+			break;
+
+		index = sym_translator_lookup_index(b->trace[i]);
+		if (index < 0)
+			break;
+
+		id = sym_translator_translation(index, &prio);
+		if (id >= 0 && prio > best_prio) {
+			best_prio = prio;
+			best_id = id;
+		}
+	}
+
+	return best_id >= 0 ? lat_translator_translation(best_id) : NULL;
+}
+
 void bt_init(struct back_trace *b, const long tr[], int len)
 {
 	int i;
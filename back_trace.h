@@ -6,7 +6,9 @@
 #ifndef _BACK_TRACE_H
 #define _BACK_TRACE_H
 
-#define MAX_BT_LEN 12
+/* The most frames lattop handles, --stack-depth defaults to DEFAULT_BT_LEN */
+#define MAX_BT_LEN 64
+#define DEFAULT_BT_LEN 12
 
 struct back_trace {
 	unsigned long trace[MAX_BT_LEN];
@@ -15,5 +17,7 @@ struct back_trace {
 void bt_init(struct back_trace *b, const long tr[], int len);
 int  bt_compare(const struct back_trace *b1, const struct back_trace *b2);
 void bt_save_symbolic(const struct back_trace *b, char *buf, size_t buflen);
+/* Returns the highest priority latencytop translation of the trace, or NULL */
+const char *bt_translate(const struct back_trace *b);
 
 #endif
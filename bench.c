@@ -0,0 +1,304 @@
+/*
+ * lattop-bench: microbenchmarks of lattop's pipeline on generated events,
+ * unprivileged and offline. Run by "make bench".
+ *
+ * lattop.o is linked in with its main() renamed, so the benchmarks run
+ * the real code with lattop's globals.
+ *
+ * Copyright 2026 agent
+ * Author: agent <agent@local>
+ * License: GPLv2
+ */
+#include <sys/mman.h>
+#include <errno.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "event_gen.h"
+#include "lattop.h"
+#include "polled_reader.h"
+#include "process_accountant.h"
+#include "self_stats.h"
+#include "stap_reader.h"
+#include "sym_translator.h"
+
+static unsigned long long arg_events = 1000000;
+static unsigned arg_reports = 20;
+
+static uint64_t now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void print_result(const char *name, const char *unit, uint64_t ops, uint64_t ns)
+{
+	printf("%-28s %14.0f %-10s %10.1f ns/op\n", name,
+	       ns ? ops * 1e9 / ns : 0.0, unit, ops ? (double) ns / ops : 0.0);
+}
+
+static int bench_kallsyms(void)
+{
+	char path[] = "/tmp/lattop-bench-XXXXXX";
+	const char *file = arg_kallsyms;
+	uint64_t start, ns;
+	FILE *f;
+	int fd, r;
+
+	if (!file) {
+		fd = mkstemp(path);
+		f = fd >= 0 ? fdopen(fd, "w") : NULL;
+		if (!f || event_gen_write_kallsyms(f) < 0 || fclose(f)) {
+			fprintf(stderr, "Cannot write %s: %s\n", path, strerror(errno));
+			return -errno;
+		}
+		file = path;
+	}
+
+	start = now();
+	r = sym_translator_init_from(file);
+	if (r == 0)
+		r = sym_translator_build();
+	ns = now() - start;
+	if (!arg_kallsyms)
+		unlink(path);
+	if (r < 0) {
+		fprintf(stderr, "Cannot load the symbols from %s: %s\n", file, strerror(-r));
+		return r;
+	}
+
+	print_result("kallsyms load", "symbols/s", sym_translator_count(), ns);
+	return 0;
+}
+
+static int bench_parse(void)
+{
+	struct outbuf ob = {};
+	struct gen_event e;
+	struct polled_reader *pr;
+	uint64_t start, ns, seq;
+	int fd, r;
+
+	fd = memfd_create("lattop-bench", MFD_CLOEXEC);
+	if (fd < 0) {
+		perror("memfd_create");
+		return -errno;
+	}
+	for (seq = 1; seq <= arg_events; seq++) {
+		event_gen_next(&e);
+		event_gen_format(&ob, &e, seq);
+		if (ob.len >= 1 << 20 && ob_flush(&ob, fd) < 0)
+			break;
+	}
+	r = ob_flush(&ob, fd);
+	ob_free(&ob);
+	if (r < 0 || lseek(fd, 0, SEEK_SET) < 0) {
+		fprintf(stderr, "Cannot generate the events: %s\n", strerror(r < 0 ? -r : errno));
+		close(fd);
+		return -EIO;
+	}
+
+	pr = stap_reader_new_stream(fd);
+	if (!pr) {
+		close(fd);
+		return -ENOMEM;
+	}
+
+	self_stats_reset();
+	start = now();
+	/* -1 at the end of the stream */
+	while ((r = pr->ops->handle_ready_fd(pr)) == 0)
+		;
+	ns = now() - start;
+
+	print_result("stap_reader parse+account", "events/s", self_stats.events, ns);
+	print_result("  parse only", "events/s", self_stats.events,
+	             self_stats.stage_ns[STAGE_PARSE]);
+	if (self_stats.events != arg_events || self_stats.malformed)
+		fprintf(stderr, "Parsed %llu of %llu events, %llu malformed lines.\n",
+		        (unsigned long long) self_stats.events, arg_events,
+		        (unsigned long long) self_stats.malformed);
+
+	pr->ops->fini(pr);
+	free(pr);
+	close(fd);
+	pa_dump_and_clear();
+	return 0;
+}
+
+static int bench_account(void)
+{
+	struct gen_event *events;
+	uint64_t start, ns, i;
+
+	events = malloc(arg_events * sizeof(struct gen_event));
+	if (!events)
+		return -ENOMEM;
+	for (i = 0; i < arg_events; i++)
+		event_gen_next(&events[i]);
+
+	start = now();
+	for (i = 0; i < arg_events; i++)
+		pa_account_latency(events[i].pid, events[i].comm, &events[i].ev,
+		                   1, (struct back_trace*) events[i].bt);
+	ns = now() - start;
+	print_result("pa_account_latency", "events/s", arg_events, ns);
+
+	free(events);
+	pa_dump_and_clear();
+	return 0;
+}
+
+static int bench_lookup(void)
+{
+	unsigned long *addrs, found = 0;
+	unsigned n = sym_translator_count();
+	uint64_t start, ns, i;
+
+	addrs = malloc(arg_events * sizeof(unsigned long));
+	if (!addrs)
+		return -ENOMEM;
+	/* spread over the symbols, whichever kallsyms it is */
+	for (i = 0; i < arg_events; i++)
+		addrs[i] = sym_translator_addr(i * 7919 % n) + i % 64;
+
+	start = now();
+	for (i = 0; i < arg_events; i++)
+		found += sym_translator_lookup(addrs[i]) != NULL;
+	ns = now() - start;
+	print_result("sym_translator_lookup", "lookups/s", arg_events, ns);
+
+	if (found != arg_events)
+		fprintf(stderr, "Only %lu of %llu addresses found.\n", found, arg_events);
+	free(addrs);
+	return 0;
+}
+
+static int bench_dump(void)
+{
+	struct gen_event e;
+	uint64_t ns = 0, start, per_report, i;
+	unsigned n;
+
+	per_report = arg_events / arg_reports ?: 1;
+	for (n = 0; n < arg_reports; n++) {
+		for (i = 0; i < per_report; i++) {
+			event_gen_next(&e);
+			pa_account_latency(e.pid, e.comm, &e.ev, 1, (struct back_trace*) e.bt);
+		}
+
+		start = now();
+		pa_dump_and_clear();
+		ns += now() - start;
+	}
+	print_result("pa_dump_and_clear", "reports/s", arg_reports, ns);
+	print_result("  per event", "events/s", per_report * arg_reports, ns);
+	return 0;
+}
+
+static void usage_and_exit(int code)
+{
+	fprintf(stderr,
+"Usage: lattop-bench [-n EVENTS] [-R REPORTS] [-t THREADS] [-s STACKS] [-z SKEW]\n"
+"                    [-d DEPTH] [-y SYMBOLS] [-S SEED] [-f FORMAT] [-k KALLSYMS] [-F]\n"
+"  -n EVENTS    events per benchmark (default: 1000000)\n"
+"  -R REPORTS   reports to split the events into for pa_dump_and_clear (default: 20)\n"
+"  -f FORMAT    text, json, csv, folded, tree or callers reports, to /dev/null\n"
+"               (default: text)\n"
+"  -k KALLSYMS  look up in this kallsyms file instead of a generated one,\n"
+"               e.g. a copy of /proc/kallsyms\n"
+"  -F           key the stacks by function, like lattop --by-function\n"
+"The generator's options are those of lattop-gen.\n");
+	exit(code);
+}
+
+int main(int argc, char *argv[])
+{
+	struct event_gen_params params = EVENT_GEN_DEFAULTS;
+	int c, r;
+
+	while ((c = getopt(argc, argv, "n:R:t:s:z:d:y:S:f:k:Fh")) != -1) {
+		switch (c) {
+		case 'n':
+			arg_events = strtoull(optarg, NULL, 10);
+			break;
+		case 'R':
+			arg_reports = strtoul(optarg, NULL, 10);
+			break;
+		case 't':
+			params.threads = strtoul(optarg, NULL, 10);
+			break;
+		case 's':
+			params.stacks = strtoul(optarg, NULL, 10);
+			break;
+		case 'z':
+			params.skew = atof(optarg);
+			break;
+		case 'd':
+			params.depth = strtoul(optarg, NULL, 10);
+			break;
+		case 'y':
+			params.symbols = strtoul(optarg, NULL, 10);
+			break;
+		case 'S':
+			params.seed = strtoull(optarg, NULL, 10);
+			break;
+		case 'f':
+			r = lattop_parse_format(optarg);
+			/* those replace the output file, not /dev/null */
+			if (r < 0 || r == FORMAT_PPROF || r == FORMAT_SNAPSHOT) {
+				fprintf(stderr, "Unknown format '%s'\n", optarg);
+				exit(1);
+			}
+			arg_format = r;
+			break;
+		case 'k':
+			arg_kallsyms = optarg;
+			break;
+		case 'F':
+			arg_by_function = true;
+			break;
+		case 'h':
+			usage_and_exit(0);
+		default:
+			usage_and_exit(1);
+		}
+	}
+	if (optind < argc || !arg_events || !arg_reports)
+		usage_and_exit(1);
+
+	r = event_gen_init(&params);
+	if (r < 0) {
+		fprintf(stderr, "Invalid parameters: %s\n", strerror(-r));
+		return 1;
+	}
+
+	arg_output = "/dev/null";
+	r = pa_init();
+	if (r < 0)
+		return 1;
+
+	printf("%llu events, %u threads, %u stacks of %u frames, skew %.2f\n",
+	       arg_events, params.threads, params.stacks, params.depth, params.skew);
+
+	r = bench_kallsyms();
+	if (!r)
+		r = bench_parse();
+	if (!r)
+		r = bench_account();
+	if (!r)
+		r = bench_lookup();
+	if (!r)
+		r = bench_dump();
+
+	pa_fini();
+	sym_translator_fini();
+	event_gen_fini();
+	return r < 0;
+}
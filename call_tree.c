@@ -0,0 +1,426 @@
+/*
+ * Call tree report writers. The stacks of all the shown threads are added
+ * up in a prefix tree of functions:
+ *
+ *  tree    - top-down, from the outermost frames to the innermost
+ *  callers - bottom-up, from the innermost frames to their callers
+ *
+ * Every node has the inclusive account of the stacks passing through it
+ * and the exclusive (self) one of the stacks whose innermost frame it is,
+ * so it answers how much latency goes through a function on a path and
+ * how much waits in it directly. Bottom-up, the innermost frames are the
+ * first level, so only they have a self account.
+ *
+ * With -f tree or callers the accountant adds every event to the tree
+ * instead of the threads' accounts (unless the recording, the metrics or
+ * the shm snapshot need those), so the tree is the aggregation and there
+ * is nothing to rebuild when the report is written. Only the daemon
+ * renders its clients' trees from the threads' accounts, with the same
+ * code.
+ *
+ * The tree lives as long as the stack table and its nodes are found from
+ * the interned stack ids: a stack's path is added the first time the
+ * stack is seen, later events only walk from its cached innermost node up
+ * to the root. The nodes come from an arena of fixed size chunks, every
+ * node finds its children by function in its own small open addressing
+ * table. The accounts carry the number of their interval, so a new
+ * interval starts without touching the nodes, and the nodes not seen in
+ * the interval are not printed. Nodes below --tree-min percent of the
+ * total or deeper than --tree-depth levels are not printed either.
+ *
+ * Copyright 2026 agent
+ * Author: agent <agent@local>
+ * License: GPLv2
+ */
+#include <alloca.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "call_tree.h"
+
+#include "array.h"
+#include "back_trace.h"
+#include "fnv1a.h"
+#include "lattop.h"
+#include "report.h"
+#include "stack_table.h"
+#include "sym_translator.h"
+#include "symbol_loader.h"
+#include "timespan.h"
+
+#define CHUNK_SHIFT 12
+#define CHUNK_NODES (1U << CHUNK_SHIFT)
+
+struct tree_account {
+	uint64_t count;
+	uint64_t total;
+	uint64_t max;
+};
+
+struct tree_node {
+	unsigned long key;	/* the function's start, or the address if unknown */
+	uint32_t parent;
+	uint32_t gen;		/* the interval of the accounts */
+	uint32_t *children;	/* node numbers, open addressing, at most half full */
+	uint32_t nr_children, children_size;
+	struct tree_account incl, self;
+};
+
+struct call_tree {
+	bool bottom_up;
+	/* node 0 is the root */
+	struct tree_node **chunks;
+	unsigned nr_chunks, nr_nodes;
+	/* the innermost node + 1 by stack id, 0 if the stack was not added yet */
+	uint32_t *leaf;
+	unsigned leaf_len;
+	uint32_t gen;
+	unsigned nr_live;	/* nodes with accounts in this interval, with the root */
+	int error;		/* of this interval */
+};
+
+static struct call_tree trees[2] = { { .bottom_up = false }, { .bottom_up = true } };
+static struct call_tree *fed;		/* by the accountant */
+static struct call_tree *shown;		/* by the writer */
+
+static struct tree_node *node(const struct call_tree *t, uint32_t n)
+{
+	return &t->chunks[n >> CHUNK_SHIFT][n & (CHUNK_NODES - 1)];
+}
+
+static int new_node(struct call_tree *t)
+{
+	struct tree_node **c;
+
+	if (t->nr_nodes == t->nr_chunks * CHUNK_NODES) {
+		c = realloc(t->chunks, (t->nr_chunks + 1) * sizeof(*c));
+		if (!c)
+			return -ENOMEM;
+		t->chunks = c;
+		t->chunks[t->nr_chunks] = malloc(CHUNK_NODES * sizeof(struct tree_node));
+		if (!t->chunks[t->nr_chunks])
+			return -ENOMEM;
+		t->nr_chunks++;
+	}
+
+	memset(node(t, t->nr_nodes), 0, sizeof(struct tree_node));
+	return t->nr_nodes++;
+}
+
+static uint32_t hash_key(unsigned long key)
+{
+	return fnv1a_bytes(&key, sizeof(key));
+}
+
+static int grow_children(const struct call_tree *t, struct tree_node *p)
+{
+	unsigned size = p->children_size ? 2 * p->children_size : 4, i, j;
+	uint32_t *c;
+
+	c = calloc(size, sizeof(uint32_t));
+	if (!c)
+		return -ENOMEM;
+
+	for (i = 0; i < p->children_size; i++) {
+		if (!p->children[i])
+			continue;
+		j = hash_key(node(t, p->children[i])->key) & (size - 1);
+		while (c[j])
+			j = (j + 1) & (size - 1);
+		c[j] = p->children[i];
+	}
+
+	free(p->children);
+	p->children = c;
+	p->children_size = size;
+	return 0;
+}
+
+/* The child of parent for key, added if it is not there yet. 0 on failure. */
+static uint32_t get_child(struct call_tree *t, uint32_t parent, unsigned long key)
+{
+	struct tree_node *p = node(t, parent);
+	unsigned i;
+	int n;
+
+	if (2 * (p->nr_children + 1) > p->children_size && grow_children(t, p) < 0)
+		return 0;
+
+	for (i = hash_key(key) & (p->children_size - 1); p->children[i];
+	     i = (i + 1) & (p->children_size - 1))
+		if (node(t, p->children[i])->key == key)
+			return p->children[i];
+
+	/* the chunks may move, not the nodes */
+	n = new_node(t);
+	if (n < 0)
+		return 0;
+	node(t, n)->key = key;
+	node(t, n)->parent = parent;
+	p->children[i] = n;
+	p->nr_children++;
+	return n;
+}
+
+/* Adds the path of the stack, the symbols have to be there by now */
+static int add_path(struct call_tree *t, int stack_id)
+{
+	struct back_trace bt;
+	unsigned long key;
+	unsigned len, i;
+	uint32_t n = 0;
+	int index;
+
+	if (grow_array(&t->leaf, &t->leaf_len, stack_id, sizeof(uint32_t)) < 0)
+		return -ENOMEM;
+
+	symbol_loader_wait();
+	len = stack_table_get(stack_id, &bt);
+	for (i = 0; i < len; i++) {
+		/* trace[0] is the innermost frame */
+		key = bt.trace[t->bottom_up ? i : len - 1 - i];
+		index = sym_translator_lookup_index(key);
+		if (index >= 0)
+			key = sym_translator_addr(index);
+
+		n = get_child(t, n, key);
+		if (!n)
+			return -ENOMEM;
+	}
+	t->leaf[stack_id] = n + 1;
+	return 0;
+}
+
+/* The node with its accounts of this interval */
+static struct tree_node *touch(struct call_tree *t, uint32_t n)
+{
+	struct tree_node *p = node(t, n);
+
+	if (p->gen != t->gen) {
+		memset(&p->incl, 0, sizeof(p->incl));
+		memset(&p->self, 0, sizeof(p->self));
+		p->gen = t->gen;
+		t->nr_live++;
+	}
+	return p;
+}
+
+static void add_account(struct tree_account *ta, const struct tree_account *a)
+{
+	ta->count += a->count;
+	ta->total += a->total;
+	if (a->max > ta->max)
+		ta->max = a->max;
+}
+
+static void add_stack(struct call_tree *t, int stack_id, const struct tree_account *a)
+{
+	struct tree_node *p;
+	uint32_t leaf, n;
+
+	if (t->error)
+		return;
+	if ((unsigned) stack_id >= t->leaf_len || !t->leaf[stack_id]) {
+		t->error = add_path(t, stack_id);
+		if (t->error)
+			return;
+	}
+
+	leaf = t->leaf[stack_id] - 1;
+	for (n = leaf; n; n = p->parent) {
+		p = touch(t, n);
+		add_account(&p->incl, a);
+		/* the innermost frame is the first level bottom-up, the last one top-down */
+		if (t->bottom_up ? p->parent == 0 : n == leaf)
+			add_account(&p->self, a);
+	}
+	add_account(&touch(t, 0)->incl, a);
+}
+
+static void new_interval(struct call_tree *t)
+{
+	t->gen++;
+	t->nr_live = 0;
+	t->error = 0;
+	if (!t->nr_nodes && new_node(t) < 0)
+		t->error = -ENOMEM;
+	else
+		touch(t, 0);
+}
+
+void call_tree_feed(bool bottom_up)
+{
+	fed = &trees[bottom_up];
+	new_interval(fed);
+}
+
+bool call_tree_fed(void)
+{
+	return fed;
+}
+
+void call_tree_add(int stack_id, uint64_t count, uint64_t total, uint64_t max)
+{
+	const struct tree_account a = { count, total, max };
+
+	add_stack(fed, stack_id, &a);
+}
+
+void call_tree_clear(void)
+{
+	if (fed)
+		new_interval(fed);
+}
+
+static void tree_begin(struct call_tree *t)
+{
+	shown = t;
+	if (t != fed)
+		new_interval(t);
+}
+
+static void tree_process(struct outbuf *ob, const struct report_info *ri,
+                         struct process *p)
+{
+	struct rb_node *rb;
+
+	if (shown == fed)
+		return;
+
+	for (rb = rb_first(&p->bt2la_map); rb; rb = rb_next(rb)) {
+		struct bt2la *bt2la = rb_entry(rb, struct bt2la, rb_node);
+		const struct tree_account a = { bt2la->la.count, bt2la->la.total, bt2la->la.max };
+
+		add_stack(shown, bt2la->stack_id, &a);
+	}
+}
+
+static int compare_nodes_by_total(const void *p1, const void *p2)
+{
+	const struct tree_node *n1 = *(const struct tree_node**) p1;
+	const struct tree_node *n2 = *(const struct tree_node**) p2;
+
+	return (n1->incl.total < n2->incl.total) - (n1->incl.total > n2->incl.total);
+}
+
+static void put_node(struct outbuf *ob, const struct tree_node *n, unsigned depth);
+
+/* The children of n seen in the interval, the largest first, as far as the cutoffs allow */
+static void put_children(struct outbuf *ob, const struct tree_node *n, unsigned depth)
+{
+	const struct tree_node *root = node(shown, 0), **children, *c;
+	unsigned nr_children = 0, i;
+
+	if (depth >= arg_tree_depth)
+		return;
+
+	children = alloca(n->nr_children * sizeof(*children));
+	for (i = 0; i < n->children_size; i++) {
+		if (!n->children[i])
+			continue;
+		c = node(shown, n->children[i]);
+		if (c->gen == shown->gen)
+			children[nr_children++] = c;
+	}
+	qsort(children, nr_children, sizeof(*children), compare_nodes_by_total);
+
+	for (i = 0; i < nr_children; i++) {
+		/* sorted, the rest is smaller still */
+		if (children[i]->incl.total * 100.0 < arg_tree_min * root->incl.total)
+			break;
+		put_node(ob, children[i], depth);
+	}
+}
+
+static void put_node(struct outbuf *ob, const struct tree_node *n, unsigned depth)
+{
+	const struct tree_node *root = node(shown, 0);
+	char total[32], max[32], self_max[32];
+	const char *name;
+
+	format_timespan(total,    sizeof(total),    n->incl.total/1000, 3);
+	format_timespan(max,      sizeof(max),      n->incl.max/1000,   3);
+	format_timespan(self_max, sizeof(self_max), n->self.max/1000,   3);
+	ob_printf(ob, "%6.1f%% %6.1f%% %10s %10s %8llu %10s %8llu  %*s",
+	          n->incl.total * 100.0 / root->incl.total, n->self.total * 100.0 / root->incl.total,
+	          total, max, (unsigned long long) n->incl.count,
+	          self_max, (unsigned long long) n->self.count, 2 * depth, "");
+	name = sym_translator_lookup(n->key);
+	if (name)
+		ob_printf(ob, "%s\n", name);
+	else
+		ob_printf(ob, "0x%lx\n", n->key);
+
+	put_children(ob, n, depth + 1);
+}
+
+static void tree_end(struct outbuf *ob, const struct report_info *ri)
+{
+	const struct tree_node *root;
+	char total[32];
+
+	if (shown->error) {
+		ob->error = shown->error;
+		return;
+	}
+
+	root = node(shown, 0);
+	format_timespan(total, sizeof(total), root->incl.total/1000, 3);
+	ob_printf(ob, "\nCall tree, %s: %s in %llu events, %u nodes, %.1f%% or more shown\n",
+	          shown->bottom_up ? "bottom-up from the innermost frames" :
+	                             "top-down from the outermost frames",
+	          total, (unsigned long long) root->incl.count, shown->nr_live - 1, arg_tree_min);
+	if (root->incl.total) {
+		ob_printf(ob, "%7s %7s %10s %10s %8s %10s %8s  %s\n",
+		          "INCL", "SELF", "TOTAL", "MAX", "COUNT", "SELF MAX", "SELF CNT", "FUNCTION");
+		put_children(ob, root, 0);
+	}
+
+	if (ri->sample_factor > 1)
+		ob_printf(ob, "Sampled up to 1 in %u events, counts and totals are scaled.\n",
+		          ri->sample_factor);
+	ob_printf(ob, "=== %s", ctime(&ri->time));
+}
+
+static void callers_begin(struct outbuf *ob, const struct report_info *ri)
+{
+	tree_begin(&trees[1]);
+}
+
+static void top_down_begin(struct outbuf *ob, const struct report_info *ri)
+{
+	tree_begin(&trees[0]);
+}
+
+const struct report_writer tree_writer = {
+	.begin = top_down_begin,
+	.process = tree_process,
+	.end = tree_end,
+};
+
+const struct report_writer callers_writer = {
+	.begin = callers_begin,
+	.process = tree_process,
+	.end = tree_end,
+};
+
+void call_tree_fini(void)
+{
+	struct call_tree *t;
+	unsigned i;
+
+	for (t = trees; t < trees + 2; t++) {
+		for (i = 0; i < t->nr_nodes; i++)
+			free(node(t, i)->children);
+		for (i = 0; i < t->nr_chunks; i++)
+			free(t->chunks[i]);
+		free(t->chunks);
+		free(t->leaf);
+		*t = (struct call_tree) { .bottom_up = t->bottom_up };
+	}
+	fed = shown = NULL;
+}
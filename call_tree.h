@@ -0,0 +1,25 @@
+/*
+ * Copyright 2026 agent
+ * Author: agent <agent@local>
+ * License: GPLv2
+ */
+#ifndef _CALL_TREE_H
+#define _CALL_TREE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * The accountant feeds the tree of the -f tree/callers report as the
+ * events come, instead of the writer building it from the threads'
+ * stacks. Bottom-up for callers.
+ */
+void call_tree_feed(bool bottom_up);
+/* Whether the tree is fed, it needs the symbols before the first stack */
+bool call_tree_fed(void);
+/* Adds count events of the interned stack, of total latency and the max */
+void call_tree_add(int stack_id, uint64_t count, uint64_t total, uint64_t max);
+/* Starts the next interval of a fed tree */
+void call_tree_clear(void);
+
+#endif
@@ -0,0 +1,119 @@
+/*
+ * Copyright 2026 agent
+ * Author: agent <agent@local>
+ * License: GPLv2
+ */
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "client.h"
+
+#include "filter.h"
+#include "lattop.h"
+#include "outbuf.h"
+
+static int add_filter_cmd(void *userdata, const char *cmd)
+{
+	ob_printf(userdata, "%s\n", cmd);
+	return 0;
+}
+
+static int write_all(int fd, const char *data, size_t len)
+{
+	ssize_t n;
+
+	while (len) {
+		n = write(fd, data, len);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+		data += n;
+		len -= n;
+	}
+	return 0;
+}
+
+int client_run(const char *path)
+{
+	struct sockaddr_un sa = { .sun_family = AF_UNIX };
+	struct outbuf req = {};
+	char buf[65536];
+	int fd, out_fd = STDOUT_FILENO, r;
+	bool first = true;
+	ssize_t n;
+
+	if (strlen(path) >= sizeof(sa.sun_path)) {
+		fprintf(stderr, "Socket path too long: %s\n", path);
+		return -ENAMETOOLONG;
+	}
+	strcpy(sa.sun_path, path);
+
+	fd = socket(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0);
+	if (fd < 0 || connect(fd, (struct sockaddr*) &sa, sizeof(sa)) < 0) {
+		r = -errno;
+		fprintf(stderr, "Cannot connect to the daemon at %s: %s\n", path, strerror(errno));
+		if (fd >= 0)
+			close(fd);
+		return r;
+	}
+
+	/* the view, see daemon.c */
+	ob_printf(&req, "interval %u.%03u\ncount %d\nsort %s\nformat %s\n%s",
+	          arg_interval_ms / 1000, arg_interval_ms % 1000, arg_count, lattop_sort_name(arg_sort),
+	          lattop_format_name(arg_format), arg_reverse ? "reverse\n" : "");
+	if (filter_active())
+		filter_for_each_command(add_filter_cmd, &req);
+	ob_puts(&req, "start\n");
+	r = req.error ?: write_all(fd, req.data, req.len);
+	ob_free(&req);
+	if (r < 0) {
+		fprintf(stderr, "Cannot talk to the daemon: %s\n", strerror(-r));
+		goto out;
+	}
+
+	if (arg_output) {
+		out_fd = open(arg_output, O_WRONLY|O_CREAT|O_APPEND|O_CLOEXEC, 0644);
+		if (out_fd < 0) {
+			r = -errno;
+			fprintf(stderr, "Cannot open %s: %s\n", arg_output, strerror(errno));
+			goto out;
+		}
+	}
+
+	while ((n = read(fd, buf, sizeof(buf))) != 0) {
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			r = -errno;
+			fprintf(stderr, "Reading from the daemon failed: %s\n", strerror(errno));
+			break;
+		}
+
+		if (first && n >= 7 && !memcmp(buf, "error: ", 7)) {
+			fprintf(stderr, "The daemon refused the request: %.*s", (int) n - 7, buf + 7);
+			r = -EINVAL;
+			break;
+		}
+		first = false;
+
+		r = write_all(out_fd, buf, n);
+		if (r < 0) {
+			fprintf(stderr, "Failed to write the report: %s\n", strerror(-r));
+			break;
+		}
+	}
+
+	if (out_fd != STDOUT_FILENO)
+		close(out_fd);
+out:
+	close(fd);
+	return r;
+}
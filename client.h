@@ -0,0 +1,12 @@
+/*
+ * Copyright 2026 agent
+ * Author: agent <agent@local>
+ * License: GPLv2
+ */
+#ifndef _CLIENT_H
+#define _CLIENT_H
+
+/* Asks the daemon at path for reports as given by arg_*, copies them out */
+int client_run(const char *path);
+
+#endif
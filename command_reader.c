@@ -0,0 +1,162 @@
+/*
+ * command_reader reads commands from stdin, one per line. They change the
+ * probe's filters without restarting it:
+ *
+ *   min-latency USEC        (or: m USEC)
+ *   max-interruptible USEC  (or: M USEC)
+ *   pid-filter PID          (or: p PID)
+ *   pid-tree PID            (or: t PID)
+ *   comm-filter PREFIX      (or: C PREFIX)
+ *   cgroup-filter PATH      (or: g PATH)
+ *   no-filter               removes all the task filters
+ *
+ * In the interactive mode stdin is the keyboard, tui.c runs the same
+ * commands from its ':' prompt.
+ *
+ * Copyright 2026 agent
+ * Author: agent <agent@local>
+ * License: GPLv2
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "command_reader.h"
+
+#include "filter.h"
+#include "lattop.h"
+#include "timespan.h"
+
+struct command_reader {
+	/* must be first */
+	struct polled_reader pr;
+
+	char buf[256];
+	unsigned fill_count;
+};
+
+static const struct {
+	const char *name, *short_name;
+	enum filter_type type;
+} filter_commands[] = {
+	{ "pid-filter",    "p", FILTER_PID },
+	{ "pid-tree",      "t", FILTER_PID_TREE },
+	{ "comm-filter",   "C", FILTER_COMM },
+	{ "cgroup-filter", "g", FILTER_CGROUP },
+};
+
+void command_run(char *line)
+{
+	char cmd[32], arg[256];
+	unsigned long long value;
+	int i, n, r;
+
+	n = sscanf(line, "%31s %255s", cmd, arg);
+	if (n < 1)
+		return;
+
+	if (n == 1 && !strcmp(cmd, "no-filter")) {
+		filter_clear();
+		lattop_filters_changed();
+		return;
+	}
+
+	if (n != 2) {
+		fprintf(stderr, "Commands: min-latency USEC, max-interruptible USEC, "
+		                "pid-filter PID, pid-tree PID, comm-filter PREFIX, "
+		                "cgroup-filter PATH, no-filter\n");
+		return;
+	}
+
+	for (i = 0; i < sizeof(filter_commands)/sizeof(filter_commands[0]); i++) {
+		if (strcmp(cmd, filter_commands[i].name) &&
+		    strcmp(cmd, filter_commands[i].short_name))
+			continue;
+
+		r = filter_add(filter_commands[i].type, arg);
+		if (r < 0) {
+			fprintf(stderr, "Invalid filter '%s': %s\n", arg, strerror(-r));
+			return;
+		}
+		lattop_filters_changed();
+		return;
+	}
+
+	if (sscanf(arg, "%llu", &value) != 1) {
+		fprintf(stderr, "Invalid value '%s'\n", arg);
+		return;
+	}
+
+	if (!strcmp(cmd, "min-latency") || !strcmp(cmd, "m"))
+		arg_min_delay = value * NSEC_PER_USEC;
+	else if (!strcmp(cmd, "max-interruptible") || !strcmp(cmd, "M"))
+		arg_max_interruptible_delay = value * NSEC_PER_USEC;
+	else {
+		fprintf(stderr, "Unknown command '%s'\n", cmd);
+		return;
+	}
+
+	lattop_delays_changed();
+}
+
+static int command_reader_handle_ready_fd(struct polled_reader *pr)
+{
+	struct command_reader *cr = (struct command_reader*) pr;
+	char *line, *eol;
+	ssize_t n;
+
+	n = read(STDIN_FILENO, cr->buf + cr->fill_count,
+	         sizeof(cr->buf) - cr->fill_count - 1);
+	if (n < 0)
+		return errno == EAGAIN || errno == EINTR ? 0 : -errno;
+	if (n == 0) {
+		/* no more commands, but keep running */
+		lattop_reader_stopped(pr);
+		return 0;
+	}
+
+	cr->fill_count += n;
+	cr->buf[cr->fill_count] = '\0';
+
+	line = cr->buf;
+	while ((eol = strchr(line, '\n'))) {
+		*eol = '\0';
+		command_run(line);
+		line = eol + 1;
+	}
+
+	cr->fill_count -= line - cr->buf;
+	if (cr->fill_count == sizeof(cr->buf) - 1) {
+		fprintf(stderr, "Command too long, ignoring.\n");
+		cr->fill_count = 0;
+	}
+	memmove(cr->buf, line, cr->fill_count);
+
+	return 0;
+}
+
+static int command_reader_get_fd(struct polled_reader *pr)
+{
+	return STDIN_FILENO;
+}
+
+static const struct polled_reader_ops command_reader_ops = {
+	.get_fd = command_reader_get_fd,
+	.handle_ready_fd = command_reader_handle_ready_fd,
+};
+
+struct polled_reader *command_reader_new(void)
+{
+	struct command_reader *r;
+
+	r = calloc(1, sizeof(struct command_reader));
+	if (r == NULL)
+		return NULL;
+
+	r->pr.ops = &command_reader_ops;
+
+	return &r->pr;
+}
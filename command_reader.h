@@ -0,0 +1,16 @@
+/*
+ * Copyright 2026 agent
+ * Author: agent <agent@local>
+ * License: GPLv2
+ */
+
+#ifndef _COMMAND_READER_H
+#define _COMMAND_READER_H
+
+#include "polled_reader.h"
+
+struct polled_reader *command_reader_new(void);
+/* Runs one command, the interactive mode reads them at its ':' prompt */
+void command_run(char *line);
+
+#endif
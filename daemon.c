@@ -0,0 +1,632 @@
+/*
+ * The daemon runs a single probe for any number of clients connected to a
+ * UNIX socket. Every tick (-i) the accountant's data is flattened into
+ * records keyed by thread and interned stack id. Each client adds the
+ * records it wants into its own view and gets a report rendered whenever
+ * its interval is over.
+ *
+ * A client configures its view by lines, then reads the reports:
+ *
+ *   interval SECONDS   rounded up to whole ticks
+ *   count N            close after N reports
+ *   sort max|total|pid|count|sleep|block
+ *   reverse
+ *   format text|json|csv|folded
+ *   +pid PID           only these processes (repeatable)
+ *   +comm PREFIX       only tasks with this comm prefix (repeatable)
+ *   start
+ *
+ * Errors are reported as a line starting with "error: ", then the
+ * connection is closed. The output to a client is buffered and written
+ * when the socket is writable. A client that does not keep up loses
+ * reports, it never stalls the daemon.
+ *
+ * Copyright 2026 agent
+ * Author: agent <agent@local>
+ * License: GPLv2
+ */
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "daemon.h"
+
+#include "lattop.h"
+#include "outbuf.h"
+#include "process.h"
+#include "process_accountant.h"
+#include "report.h"
+#include "stack_table.h"
+#include "timespan.h"
+
+/* reports are dropped while more than this is waiting for a client */
+#define CLIENT_MAX_BACKLOG (4*1024*1024)
+#define CLIENT_MAX_PIDS 16
+
+/* a thread's latencies in one stack */
+struct stack_account {
+	int stack_id;		/* -1 in an empty hash slot */
+	pid_t pid, tid;
+	char comm[16];
+	struct latency_account la;
+};
+
+struct client {
+	/* must be first */
+	struct polled_reader pr;
+
+	int fd;
+	bool started, closing, gone;
+	char line[256];
+	unsigned line_len;
+
+	/* the view */
+	unsigned interval_ticks, ticks;
+	int count;
+	enum sort_by sort;
+	bool reverse;
+	enum output_format format;
+	pid_t pids[CLIENT_MAX_PIDS];
+	unsigned nr_pids;
+	char comms[CLIENT_MAX_PIDS][16];
+	unsigned nr_comms;
+
+	/* the current interval, open addressing by (tid, stack id) */
+	struct stack_account *slots;
+	unsigned nr_slots, used;
+	unsigned sample_factor;
+	unsigned long seq;
+
+	struct outbuf out;
+	size_t out_pos;
+	unsigned long dropped;
+};
+
+struct listener {
+	/* must be first */
+	struct polled_reader pr;
+
+	int fd;
+	const char *path;
+	bool bound;
+};
+
+static struct client *clients[MAX_CLIENTS];
+static unsigned nr_clients;
+
+/* the last tick's records */
+static struct stack_account *tick;
+static unsigned tick_len, tick_alloc;
+static unsigned tick_sample_factor;
+
+static void client_drop(struct client *c)
+{
+	c->gone = true;
+	lattop_remove_reader(&c->pr);
+}
+
+static void client_flush(struct client *c)
+{
+	ssize_t n;
+
+	while (c->out_pos < c->out.len) {
+		n = send(c->fd, c->out.data + c->out_pos, c->out.len - c->out_pos,
+		         MSG_NOSIGNAL|MSG_DONTWAIT);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN) {
+				lattop_reader_want_write(&c->pr, true);
+				return;
+			}
+			client_drop(c);
+			return;
+		}
+		c->out_pos += n;
+	}
+
+	c->out.len = c->out_pos = 0;
+	lattop_reader_want_write(&c->pr, false);
+	if (c->closing)
+		client_drop(c);
+}
+
+static void client_error(struct client *c, const char *msg, const char *arg)
+{
+	ob_printf(&c->out, "error: %s%s%s\n", msg, arg ? ": " : "", arg ?: "");
+	c->closing = true;
+	client_flush(c);
+}
+
+static void client_command(struct client *c, char *line)
+{
+	char cmd[32], arg[224];
+	double seconds;
+	unsigned ms;
+	int n, value;
+
+	n = sscanf(line, "%31s %223s", cmd, arg);
+	if (n < 1)
+		return;
+
+	if (!strcmp(cmd, "start")) {
+		c->started = true;
+		return;
+	}
+	if (!strcmp(cmd, "reverse")) {
+		c->reverse = true;
+		return;
+	}
+	if (!strcmp(cmd, "reset") || !strcmp(cmd, "commit"))
+		return;		/* framing of the filter commands */
+
+	if (n != 2) {
+		client_error(c, "missing argument", cmd);
+		return;
+	}
+
+	if (!strcmp(cmd, "interval")) {
+		if (sscanf(arg, "%lf", &seconds) != 1 || !(seconds >= 0 && seconds <= 2592000)) {
+			client_error(c, "invalid number", arg);
+			return;
+		}
+		ms = seconds * MSEC_PER_SEC + 0.5;
+		c->interval_ticks = ms > arg_interval_ms ? (ms + arg_interval_ms - 1) / arg_interval_ms : 1;
+	} else if (!strcmp(cmd, "count") || !strcmp(cmd, "+pid")) {
+		if (sscanf(arg, "%d", &value) != 1 || value < 0) {
+			client_error(c, "invalid number", arg);
+			return;
+		}
+		if (cmd[0] == 'c')
+			c->count = value;
+		else if (c->nr_pids < CLIENT_MAX_PIDS)
+			c->pids[c->nr_pids++] = value;
+		else
+			client_error(c, "too many pid filters", NULL);
+	} else if (!strcmp(cmd, "+comm")) {
+		if (c->nr_comms < CLIENT_MAX_PIDS)
+			snprintf(c->comms[c->nr_comms++], 16, "%.15s", arg);
+		else
+			client_error(c, "too many comm filters", NULL);
+	} else if (!strcmp(cmd, "sort")) {
+		value = lattop_parse_sort(arg);
+		if (value < 0)
+			client_error(c, "unknown sort", arg);
+		else
+			c->sort = value;
+	} else if (!strcmp(cmd, "format")) {
+		value = lattop_parse_format(arg);
+		if (value < 0 || value == FORMAT_PPROF || value == FORMAT_SNAPSHOT)
+			client_error(c, "unsupported format", arg);
+		else
+			c->format = value;
+	} else if (!strcmp(cmd, "+tree") || !strcmp(cmd, "+cgroup"))
+		client_error(c, "pid tree and cgroup filters must be given to the daemon", NULL);
+	else
+		client_error(c, "unknown command", cmd);
+}
+
+static int client_handle_ready_fd(struct polled_reader *pr)
+{
+	struct client *c = (struct client*) pr;
+	char *line, *eol;
+	ssize_t n;
+
+	n = recv(c->fd, c->line + c->line_len, sizeof(c->line) - c->line_len - 1, MSG_DONTWAIT);
+	if (n < 0 && (errno == EAGAIN || errno == EINTR))
+		return 0;
+	if (n <= 0) {
+		client_drop(c);
+		return 0;
+	}
+
+	/* nothing is expected after the view is configured */
+	if (c->started)
+		return 0;
+
+	c->line_len += n;
+	c->line[c->line_len] = '\0';
+
+	line = c->line;
+	while (!c->started && !c->closing && (eol = strchr(line, '\n'))) {
+		*eol = '\0';
+		client_command(c, line);
+		line = eol + 1;
+	}
+
+	c->line_len -= line - c->line;
+	memmove(c->line, line, c->line_len);
+	if (c->line_len == sizeof(c->line) - 1)
+		client_error(c, "line too long", NULL);
+
+	return 0;
+}
+
+static int client_handle_writable(struct polled_reader *pr)
+{
+	client_flush((struct client*) pr);
+	return 0;
+}
+
+static int client_get_fd(struct polled_reader *pr)
+{
+	return ((struct client*) pr)->fd;
+}
+
+static void client_fini(struct polled_reader *pr)
+{
+	struct client *c = (struct client*) pr;
+	unsigned i;
+
+	for (i = 0; i < nr_clients; i++) {
+		if (clients[i] == c) {
+			clients[i] = clients[--nr_clients];
+			break;
+		}
+	}
+
+	close(c->fd);
+	ob_free(&c->out);
+	free(c->slots);
+	fprintf(stderr, "Client disconnected (%u connected).\n", nr_clients);
+}
+
+static const struct polled_reader_ops client_ops = {
+	.fini = client_fini,
+	.get_fd = client_get_fd,
+	.handle_ready_fd = client_handle_ready_fd,
+	.handle_writable = client_handle_writable,
+};
+
+static bool client_wants(const struct client *c, const struct stack_account *sa)
+{
+	unsigned i;
+
+	if (!c->nr_pids && !c->nr_comms)
+		return true;
+	for (i = 0; i < c->nr_pids; i++)
+		if (c->pids[i] == sa->pid)
+			return true;
+	for (i = 0; i < c->nr_comms; i++)
+		if (!strncmp(sa->comm, c->comms[i], strlen(c->comms[i])))
+			return true;
+	return false;
+}
+
+static unsigned slot_hash(pid_t tid, int stack_id)
+{
+	return ((unsigned) tid * 2654435761U) ^ ((unsigned) stack_id * 40503U);
+}
+
+static int client_grow(struct client *c)
+{
+	struct stack_account *old = c->slots;
+	unsigned old_nr = c->nr_slots, i, j;
+
+	c->nr_slots = old_nr ? old_nr * 2 : 256;
+	c->slots = malloc(c->nr_slots * sizeof(struct stack_account));
+	if (!c->slots) {
+		c->slots = old;
+		c->nr_slots = old_nr;
+		return -ENOMEM;
+	}
+	for (i = 0; i < c->nr_slots; i++)
+		c->slots[i].stack_id = -1;
+
+	for (i = 0; i < old_nr; i++) {
+		if (old[i].stack_id < 0)
+			continue;
+		j = slot_hash(old[i].tid, old[i].stack_id) & (c->nr_slots - 1);
+		while (c->slots[j].stack_id >= 0)
+			j = (j + 1) & (c->nr_slots - 1);
+		c->slots[j] = old[i];
+	}
+
+	free(old);
+	return 0;
+}
+
+static void client_accumulate(struct client *c)
+{
+	struct stack_account *s;
+	unsigned i, j;
+
+	for (i = 0; i < tick_len; i++) {
+		const struct stack_account *t = &tick[i];
+
+		if (!client_wants(c, t))
+			continue;
+		if (2 * (c->used + 1) > c->nr_slots && client_grow(c) < 0)
+			return;
+
+		j = slot_hash(t->tid, t->stack_id) & (c->nr_slots - 1);
+		for (;;) {
+			s = &c->slots[j];
+			if (s->stack_id < 0 || (s->tid == t->tid && s->stack_id == t->stack_id))
+				break;
+			j = (j + 1) & (c->nr_slots - 1);
+		}
+
+		if (s->stack_id < 0) {
+			*s = *t;
+			c->used++;
+		} else
+			la_merge(&s->la, &t->la);
+	}
+
+	if (c->sample_factor < tick_sample_factor)
+		c->sample_factor = tick_sample_factor;
+}
+
+static int compare_by_tid(const void *p1, const void *p2)
+{
+	const struct stack_account *s1 = *(const struct stack_account**) p1;
+	const struct stack_account *s2 = *(const struct stack_account**) p2;
+
+	return s1->tid < s2->tid ? -1 : s1->tid > s2->tid;
+}
+
+static void client_clear(struct client *c)
+{
+	unsigned i;
+
+	for (i = 0; i < c->nr_slots; i++)
+		c->slots[i].stack_id = -1;
+	c->used = 0;
+	c->sample_factor = 1;
+	c->ticks = 0;
+}
+
+static void client_report(struct client *c)
+{
+	struct stack_account **sorted = NULL;
+	struct process **procs = NULL;
+	struct report_info ri;
+	unsigned i, n = 0, nprocs = 0;
+
+	time(&ri.time);
+	ri.seq = c->seq++;
+	ri.sample_factor = c->sample_factor;
+	ri.sort = c->sort;
+	ri.reverse = c->reverse;
+
+	if (c->out.len - c->out_pos > CLIENT_MAX_BACKLOG) {
+		if (!c->dropped++)
+			fprintf(stderr, "A client does not keep up, dropping its reports.\n");
+		goto out;
+	}
+
+	/* group the view by thread into processes for the report writers */
+	sorted = malloc(c->used * sizeof(*sorted));
+	procs = malloc(c->used * sizeof(*procs));
+	if (c->used && (!sorted || !procs))
+		goto out;
+
+	for (i = 0; i < c->nr_slots; i++)
+		if (c->slots[i].stack_id >= 0)
+			sorted[n++] = &c->slots[i];
+	qsort(sorted, n, sizeof(*sorted), compare_by_tid);
+
+	for (i = 0; i < n; i++) {
+		const struct stack_account *s = sorted[i];
+
+		if (!nprocs || procs[nprocs-1]->tid != s->tid) {
+			procs[nprocs] = process_new(s->pid, s->tid, s->comm);
+			if (!procs[nprocs])
+				goto out;
+			nprocs++;
+		}
+		process_add_account(procs[nprocs-1], s->stack_id, &s->la);
+	}
+
+	pa_render_report(&c->out, &ri, c->format, procs, nprocs);
+	client_flush(c);
+
+	if (c->count && --c->count == 0) {
+		c->closing = true;
+		client_flush(c);
+	}
+out:
+	for (i = 0; i < nprocs; i++) {
+		process_fini(procs[i]);
+		free(procs[i]);
+	}
+	free(procs);
+	free(sorted);
+	client_clear(c);
+}
+
+static struct client *client_new(int fd)
+{
+	struct client *c;
+
+	c = calloc(1, sizeof(struct client));
+	if (!c)
+		return NULL;
+
+	c->pr.ops = &client_ops;
+	c->fd = fd;
+	c->interval_ticks = 1;
+	c->sort = SORT_BY_MAX_LATENCY;
+	c->format = FORMAT_TEXT;
+	c->sample_factor = 1;
+	return c;
+}
+
+void daemon_tick(void)
+{
+	struct pa_snapshot snap;
+	struct rb_node *node, *n2;
+	unsigned i;
+
+	pa_take_snapshot(&snap);
+	tick_len = 0;
+	tick_sample_factor = snap.info.sample_factor;
+
+	for (node = rb_first(&snap.processes); node; node = rb_next(node)) {
+		struct process *p = rb_entry(node, struct process, rb_node);
+
+		for (n2 = rb_first(&p->bt2la_map); n2; n2 = rb_next(n2)) {
+			struct bt2la *b = rb_entry(n2, struct bt2la, rb_node);
+
+			if (tick_len == tick_alloc) {
+				unsigned new_alloc = tick_alloc ? tick_alloc * 2 : 1024;
+				struct stack_account *t = realloc(tick, new_alloc * sizeof(*tick));
+				if (!t)
+					goto out;
+				tick = t;
+				tick_alloc = new_alloc;
+			}
+
+			tick[tick_len] = (struct stack_account) {
+				.stack_id = b->stack_id,
+				.pid = p->pid,
+				.tid = p->tid,
+				.la = b->la,
+			};
+			memcpy(tick[tick_len].comm, p->comm, sizeof(p->comm));
+			tick_len++;
+		}
+	}
+out:
+	pa_snapshot_free(&snap);
+
+	for (i = 0; i < nr_clients; i++) {
+		struct client *c = clients[i];
+
+		if (!c->started || c->closing || c->gone)
+			continue;
+		client_accumulate(c);
+		if (++c->ticks >= c->interval_ticks)
+			client_report(c);
+	}
+}
+
+static int listener_handle_ready_fd(struct polled_reader *pr)
+{
+	struct listener *l = (struct listener*) pr;
+	struct client *c;
+	int fd;
+
+	fd = accept4(l->fd, NULL, NULL, SOCK_NONBLOCK|SOCK_CLOEXEC);
+	if (fd < 0)
+		return 0;	/* the client may have gone already */
+
+	c = nr_clients < MAX_CLIENTS ? client_new(fd) : NULL;
+	if (!c || lattop_add_reader(&c->pr) < 0) {
+		static const char msg[] = "error: too many clients\n";
+		send(fd, msg, sizeof(msg) - 1, MSG_NOSIGNAL|MSG_DONTWAIT);
+		close(fd);
+		free(c);
+		return 0;
+	}
+
+	clients[nr_clients++] = c;
+	fprintf(stderr, "Client connected (%u connected).\n", nr_clients);
+	return 0;
+}
+
+int listen_unix_socket(const char *path)
+{
+	struct sockaddr_un sa = { .sun_family = AF_UNIX };
+	int fd, r, probe;
+
+	if (strlen(path) >= sizeof(sa.sun_path))
+		return -ENAMETOOLONG;
+	strcpy(sa.sun_path, path);
+
+	fd = socket(AF_UNIX, SOCK_STREAM|SOCK_NONBLOCK|SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return -errno;
+
+	r = bind(fd, (struct sockaddr*) &sa, sizeof(sa));
+	if (r < 0 && errno == EADDRINUSE) {
+		/* a stale socket, unless someone answers */
+		probe = socket(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0);
+		if (probe >= 0 && connect(probe, (struct sockaddr*) &sa, sizeof(sa)) == 0) {
+			close(probe);
+			fprintf(stderr, "Another lattop is listening on %s\n", path);
+			close(fd);
+			return -EADDRINUSE;
+		}
+		if (probe >= 0)
+			close(probe);
+		unlink(path);
+		r = bind(fd, (struct sockaddr*) &sa, sizeof(sa));
+	}
+	if (r < 0) {
+		r = -errno;
+		fprintf(stderr, "Cannot bind %s: %s\n", path, strerror(errno));
+		close(fd);
+		return r;
+	}
+
+	/* the reports show every process on the system */
+	if (chmod(path, 0600) < 0 || listen(fd, 16) < 0) {
+		r = -errno;
+		close(fd);
+		unlink(path);
+		return r;
+	}
+
+	return fd;
+}
+
+static int listener_start(struct polled_reader *pr)
+{
+	struct listener *l = (struct listener*) pr;
+
+	l->fd = listen_unix_socket(l->path);
+	if (l->fd < 0)
+		return l->fd;
+	l->bound = true;
+
+	fprintf(stderr, "Listening on %s\n", l->path);
+	return 0;
+}
+
+static void listener_fini(struct polled_reader *pr)
+{
+	struct listener *l = (struct listener*) pr;
+	if (!l->bound)
+		return;
+	close(l->fd);
+	unlink(l->path);
+	free(tick);
+	tick = NULL;
+	tick_len = tick_alloc = 0;
+}
+
+static int listener_get_fd(struct polled_reader *pr)
+{
+	return ((struct listener*) pr)->fd;
+}
+
+static const struct polled_reader_ops listener_ops = {
+	.fini = listener_fini,
+	.start = listener_start,
+	.get_fd = listener_get_fd,
+	.handle_ready_fd = listener_handle_ready_fd,
+};
+
+struct polled_reader *listener_new(const char *path)
+{
+	struct listener *l;
+
+	l = calloc(1, sizeof(struct listener));
+	if (l == NULL)
+		return NULL;
+
+	l->pr.ops = &listener_ops;
+	l->path = path;
+
+	return &l->pr;
+}
@@ -0,0 +1,23 @@
+/*
+ * Copyright 2026 agent
+ * Author: agent <agent@local>
+ * License: GPLv2
+ */
+#ifndef _DAEMON_H
+#define _DAEMON_H
+
+#include "polled_reader.h"
+
+#define DEFAULT_SOCKET "/run/lattop.sock"
+#define MAX_CLIENTS 64
+
+/* A non-blocking listening socket at path, replacing a stale one */
+int listen_unix_socket(const char *path);
+
+/* Accepts the clients on a UNIX socket at path */
+struct polled_reader *listener_new(const char *path);
+
+/* Ends a tick of the daemon (-i), the clients' views are updated from it */
+void daemon_tick(void);
+
+#endif
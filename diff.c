@@ -0,0 +1,391 @@
+/*
+ * Differential reports: every interval's stacks against a baseline
+ * snapshot, ranked by how much worse they got.
+ *
+ * The baseline is a hash table by symbolic stack, summed over the comms
+ * and divided by its number of intervals for the totals and counts. The
+ * join goes over the interned stack table, each stack id is looked up
+ * in the baseline only once, so an interval costs O(stacks).
+ *
+ * Copyright 2026 agent
+ * Author: agent <agent@local>
+ * License: GPLv2
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "diff.h"
+
+#include "array.h"
+#include "fnv1a.h"
+#include "lattop.h"
+#include "outbuf.h"
+#include "process.h"
+#include "report.h"
+#include "snapshot.h"
+#include "stack_table.h"
+
+struct base_stack {
+	char *stack;		/* ";outermost;...;innermost" */
+	struct latency_account la;
+	bool seen;		/* in the current interval */
+};
+
+static const char *base_path;
+static unsigned long base_intervals, cur_intervals = 1;
+static struct base_stack *base;
+static unsigned nr_base, base_alloc;
+/* base index + 1, open addressing, at most half full */
+static unsigned *base_hash;
+static unsigned base_hash_size;
+
+/* stack id -> base index + 2, 1 if not in the baseline, 0 not looked up yet */
+static unsigned *stack_base;
+static unsigned stack_base_len;
+
+/* stack id -> the current interval's account, ids in it listed in touched */
+static struct latency_account *cur;
+static unsigned cur_len;
+static int *touched;
+static unsigned nr_touched, touched_alloc;
+
+static struct outbuf key;
+
+static int grow_base_hash(void)
+{
+	unsigned new_size = base_hash_size ? 2 * base_hash_size : 1024;
+	unsigned *new_hash, i, slot;
+
+	new_hash = calloc(new_size, sizeof(unsigned));
+	if (!new_hash)
+		return -ENOMEM;
+	for (i = 0; i < nr_base; i++) {
+		slot = fnv1a_string(base[i].stack) & (new_size - 1);
+		while (new_hash[slot])
+			slot = (slot + 1) & (new_size - 1);
+		new_hash[slot] = i + 1;
+	}
+	free(base_hash);
+	base_hash = new_hash;
+	base_hash_size = new_size;
+	return 0;
+}
+
+/* Returns the slot of the stack, or of the free one to insert it at */
+static unsigned find_slot(const char *stack)
+{
+	unsigned slot = fnv1a_string(stack) & (base_hash_size - 1);
+
+	while (base_hash[slot] && strcmp(base[base_hash[slot] - 1].stack, stack))
+		slot = (slot + 1) & (base_hash_size - 1);
+	return slot;
+}
+
+static void add_base_line(const char *k, const struct latency_account *la, void *userdata)
+{
+	const char *stack = strchr(k, ';') ?: "";
+	struct base_stack *b;
+	unsigned slot;
+	int *error = userdata;
+
+	if (*error)
+		return;
+	if (2 * (nr_base + 1) > base_hash_size && grow_base_hash() < 0)
+		goto oom;
+
+	slot = find_slot(stack);
+	if (base_hash[slot]) {
+		la_merge(&base[base_hash[slot] - 1].la, la);
+		return;
+	}
+
+	if (nr_base == base_alloc) {
+		unsigned new_alloc = base_alloc ? 2 * base_alloc : 256;
+		b = realloc(base, new_alloc * sizeof(struct base_stack));
+		if (!b)
+			goto oom;
+		base = b;
+		base_alloc = new_alloc;
+	}
+	b = &base[nr_base];
+	b->stack = strdup(stack);
+	if (!b->stack)
+		goto oom;
+	b->la = *la;
+	b->seen = false;
+	base_hash[slot] = ++nr_base;
+	return;
+oom:
+	*error = -ENOMEM;
+}
+
+int diff_init(const char *path)
+{
+	int r, error = 0;
+
+	base_path = path;
+	r = snapshot_load(path, &base_intervals, add_base_line, &error);
+	if (r == 0)
+		r = error;
+	if (r < 0) {
+		fprintf(stderr, "Cannot load the baseline %s: %s\n", path, strerror(-r));
+		diff_fini();
+		return r;
+	}
+	if (!base_intervals)
+		base_intervals = 1;
+	return 0;
+}
+
+void diff_set_intervals(unsigned long intervals)
+{
+	cur_intervals = intervals ?: 1;
+}
+
+void diff_fini(void)
+{
+	unsigned i;
+
+	for (i = 0; i < nr_base; i++)
+		free(base[i].stack);
+	free(base);
+	free(base_hash);
+	free(stack_base);
+	free(cur);
+	free(touched);
+	base = NULL;
+	base_hash = stack_base = NULL;
+	cur = NULL;
+	touched = NULL;
+	nr_base = base_alloc = base_hash_size = stack_base_len = 0;
+	cur_len = nr_touched = touched_alloc = 0;
+	ob_free(&key);
+}
+
+/* The join: the baseline index of the stack or -1 */
+static int base_of(int id)
+{
+	struct back_trace bt;
+	unsigned slot;
+
+	if (!stack_base[id]) {
+		stack_table_get(id, &bt);
+		key.len = 0;
+		snapshot_put_stack(&key, &bt);
+		ob_putc(&key, '\0');
+		if (key.error || !nr_base)
+			return -1;
+		slot = find_slot(key.data);
+		stack_base[id] = base_hash[slot] ? base_hash[slot] + 1 : 1;
+	}
+	return stack_base[id] - 2;
+}
+
+static void diff_begin(struct outbuf *ob, const struct report_info *ri)
+{
+	unsigned i;
+
+	for (i = 0; i < nr_touched; i++)
+		memset(&cur[touched[i]], 0, sizeof(struct latency_account));
+	nr_touched = 0;
+}
+
+static void diff_process(struct outbuf *ob, const struct report_info *ri,
+                         struct process *p)
+{
+	struct rb_node *node;
+	int id, *t;
+
+	for (node = rb_first(&p->bt2la_map); node; node = rb_next(node)) {
+		struct bt2la *bt2la = rb_entry(node, struct bt2la, rb_node);
+
+		id = bt2la->stack_id;
+		if (grow_array(&stack_base, &stack_base_len, id, sizeof(unsigned)) < 0 ||
+		    grow_array(&cur, &cur_len, id, sizeof(struct latency_account)) < 0)
+			continue;
+
+		if (!cur[id].count) {
+			if (nr_touched == touched_alloc) {
+				unsigned new_alloc = touched_alloc ? 2 * touched_alloc : 256;
+				t = realloc(touched, new_alloc * sizeof(int));
+				if (!t)
+					continue;
+				touched = t;
+				touched_alloc = new_alloc;
+			}
+			touched[nr_touched++] = id;
+		}
+		la_merge(&cur[id], &bt2la->la);
+	}
+}
+
+struct diff_row {
+	const struct latency_account *cur, *base;
+	int id;			/* -1 for a stack only in the baseline */
+	const char *stack;	/* of the baseline */
+	double total, max, p50, p99, count;
+	double state_total[_LA_NR_STATES];
+};
+
+static const struct latency_account zero_la;
+
+static double sort_key(const struct diff_row *r, enum sort_by sort)
+{
+	switch (sort) {
+	case SORT_BY_MAX_LATENCY:
+		return r->max;
+	case SORT_BY_COUNT:
+		return r->count;
+	case SORT_BY_SLEEP:
+		return r->state_total[LA_SLEEP];
+	case SORT_BY_BLOCK:
+		return r->state_total[LA_BLOCK];
+	default:
+		return r->total;
+	}
+}
+
+static enum sort_by rows_sort;
+
+static int compare_rows(const void *p1, const void *p2)
+{
+	double k1 = sort_key(p1, rows_sort), k2 = sort_key(p2, rows_sort);
+
+	return k1 < k2 ? 1 : k1 > k2 ? -1 : 0;
+}
+
+static void compute_row(struct diff_row *r)
+{
+	const struct latency_account *c = r->cur ?: &zero_la, *b = r->base ?: &zero_la;
+	unsigned i;
+
+	r->total = (double) c->total / cur_intervals - (double) b->total / base_intervals;
+	r->count = (double) c->count / cur_intervals - (double) b->count / base_intervals;
+	r->max = (double) c->max - (double) b->max;
+	r->p50 = (double) la_quantile(c, 500) - (double) la_quantile(b, 500);
+	r->p99 = (double) la_quantile(c, 990) - (double) la_quantile(b, 990);
+	for (i = 0; i < _LA_NR_STATES; i++)
+		r->state_total[i] = (double) c->state_total[i] / cur_intervals -
+		                    (double) b->state_total[i] / base_intervals;
+}
+
+static void put_stack(struct outbuf *ob, const struct diff_row *r)
+{
+	struct back_trace bt;
+	const char *s;
+
+	if (r->id >= 0) {
+		stack_table_get(r->id, &bt);
+		key.len = 0;
+		snapshot_put_stack(&key, &bt);
+		ob_putc(&key, '\0');
+		s = key.error ? "" : key.data;
+	} else
+		s = r->stack;
+	/* without the leading ';' */
+	ob_puts(ob, *s ? s + 1 : s);
+}
+
+static void put_json_row(struct outbuf *ob, const struct report_info *ri, const struct diff_row *r)
+{
+	const struct latency_account *c = r->cur ?: &zero_la, *b = r->base ?: &zero_la;
+	struct outbuf stack = {};
+	unsigned i;
+
+	ob_puts(ob, "{\"interval\":");
+	ob_put_u64(ob, ri->seq);
+	ob_puts(ob, ",\"time\":");
+	ob_put_i64(ob, ri->time);
+	ob_puts(ob, ",\"status\":\"");
+	ob_puts(ob, !r->base ? "new" : !r->cur ? "gone" : "both");
+	ob_puts(ob, "\",\"stack\":");
+	put_stack(&stack, r);
+	ob_putc(&stack, '\0');
+	ob_put_json_string(ob, stack.error ? "" : stack.data);
+	ob_free(&stack);
+	ob_printf(ob, ",\"total_ns\":%.0f,\"baseline_total_ns\":%.0f,\"delta_total_ns\":%.0f",
+	          (double) c->total / cur_intervals, (double) b->total / base_intervals, r->total);
+	ob_printf(ob, ",\"max_ns\":%llu,\"baseline_max_ns\":%llu,\"delta_max_ns\":%.0f",
+	          (unsigned long long) c->max, (unsigned long long) b->max, r->max);
+	ob_printf(ob, ",\"delta_p50_ns\":%.0f,\"delta_p99_ns\":%.0f", r->p50, r->p99);
+	for (i = 0; i < _LA_NR_STATES; i++)
+		ob_printf(ob, ",\"delta_%s_total_ns\":%.0f", la_state_name(i), r->state_total[i]);
+	ob_printf(ob, ",\"count\":%.2f,\"baseline_count\":%.2f,\"delta_count\":%.2f}\n",
+	          (double) c->count / cur_intervals, (double) b->count / base_intervals, r->count);
+}
+
+static void put_text_row(struct outbuf *ob, const struct diff_row *r)
+{
+	ob_printf(ob, "%+10.2f %+10.2f %+10.2f %+9.2f %+9.2f %+9.2f %+8.1f %-4s ",
+	          r->total / 1e6, r->state_total[LA_SLEEP] / 1e6, r->state_total[LA_BLOCK] / 1e6,
+	          r->max / 1e6, r->p50 / 1e6, r->p99 / 1e6, r->count,
+	          !r->base ? "new" : !r->cur ? "gone" : "");
+	put_stack(ob, r);
+	ob_putc(ob, '\n');
+}
+
+static void diff_end(struct outbuf *ob, const struct report_info *ri)
+{
+	struct diff_row *rows;
+	unsigned n = 0, i;
+	int b;
+
+	rows = malloc((nr_touched + nr_base) * sizeof(struct diff_row) + 1);
+	if (!rows) {
+		ob->error = -ENOMEM;
+		return;
+	}
+
+	for (i = 0; i < nr_base; i++)
+		base[i].seen = false;
+	for (i = 0; i < nr_touched; i++) {
+		b = base_of(touched[i]);
+		rows[n] = (struct diff_row) {
+			.cur = &cur[touched[i]],
+			.base = b >= 0 ? &base[b].la : NULL,
+			.id = touched[i],
+		};
+		if (b >= 0)
+			base[b].seen = true;
+		compute_row(&rows[n++]);
+	}
+	for (i = 0; i < nr_base; i++) {
+		if (base[i].seen)
+			continue;
+		rows[n] = (struct diff_row) {
+			.base = &base[i].la,
+			.id = -1,
+			.stack = base[i].stack,
+		};
+		compute_row(&rows[n++]);
+	}
+
+	rows_sort = ri->sort;
+	qsort(rows, n, sizeof(struct diff_row), compare_rows);
+
+	if (arg_format == FORMAT_JSON) {
+		for (i = 0; i < n; i++)
+			put_json_row(ob, ri, &rows[ri->reverse ? n - 1 - i : i]);
+	} else {
+		ob_printf(ob, "\nAgainst %s (%lu intervals), totals and counts per interval:\n",
+		          base_path, base_intervals);
+		ob_printf(ob, "%10s %10s %10s %9s %9s %9s %8s %-4s %s\n",
+		          "total ms", "sleep ms", "block ms", "max ms", "p50 ms", "p99 ms",
+		          "count", "", "stack");
+		for (i = 0; i < n; i++)
+			put_text_row(ob, &rows[ri->reverse ? n - 1 - i : i]);
+		if (ri->sample_factor > 1)
+			ob_printf(ob, "Sampled up to 1 in %u events, counts and totals are scaled.\n",
+			          ri->sample_factor);
+		ob_printf(ob, "=== %s", ctime(&ri->time));
+	}
+	free(rows);
+}
+
+const struct report_writer diff_writer = {
+	.begin = diff_begin,
+	.process = diff_process,
+	.end = diff_end,
+};
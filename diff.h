@@ -0,0 +1,15 @@
+/*
+ * Copyright 2026 agent
+ * Author: agent <agent@local>
+ * License: GPLv2
+ */
+#ifndef _DIFF_H
+#define _DIFF_H
+
+/* Loads the baseline snapshot for diff_writer. Returns 0 or -errno. */
+int  diff_init(const char *path);
+void diff_fini(void);
+/* The reports sum up this many intervals, e.g. of merged snapshots */
+void diff_set_intervals(unsigned long intervals);
+
+#endif
@@ -0,0 +1,135 @@
+/*
+ * Synthetic events like lat.stp's, for benchmarks and for running lattop
+ * without the probe. The stacks' popularity follows a Zipf distribution,
+ * the delays are log-uniform between 1 us and 100 ms.
+ *
+ * Copyright 2026 agent
+ * Author: agent <agent@local>
+ * License: GPLv2
+ */
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "event_gen.h"
+
+#define SYMBOL_BASE 0xffffffff81000000UL
+#define SYMBOL_SIZE 0x400
+/* 2013-01-01 00:00:00 UTC */
+#define EPOCH_NS 1356998400000000000ULL
+
+static struct event_gen_params p;
+static struct back_trace *stacks;
+static double *stack_cdf;
+static uint64_t rng;
+static uint64_t event_seq;
+
+/* xorshift64* */
+static uint64_t random_u64(void)
+{
+	rng ^= rng >> 12;
+	rng ^= rng << 25;
+	rng ^= rng >> 27;
+	return rng * 2685821657736338717ULL;
+}
+
+static double random_double(void)
+{
+	return (random_u64() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+unsigned long event_gen_address(void)
+{
+	return SYMBOL_BASE + random_u64() % ((unsigned long) p.symbols * SYMBOL_SIZE);
+}
+
+int event_gen_init(const struct event_gen_params *params)
+{
+	double sum = 0.0;
+	unsigned i, j;
+
+	p = *params;
+	if (!p.threads || !p.stacks || !p.symbols || p.depth < 1 || p.depth > MAX_BT_LEN)
+		return -EINVAL;
+	rng = p.seed ?: 1;
+	event_seq = 0;
+
+	stacks = calloc(p.stacks, sizeof(struct back_trace));
+	stack_cdf = malloc(p.stacks * sizeof(double));
+	if (!stacks || !stack_cdf) {
+		event_gen_fini();
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < p.stacks; i++) {
+		/* distinct because the innermost frames are */
+		stacks[i].trace[0] = SYMBOL_BASE + (i % p.symbols) * SYMBOL_SIZE +
+		                     1 + i / p.symbols % (SYMBOL_SIZE - 1);
+		for (j = 1; j < p.depth; j++)
+			stacks[i].trace[j] = event_gen_address();
+
+		sum += 1.0 / pow(i + 1, p.skew);
+		stack_cdf[i] = sum;
+	}
+	for (i = 0; i < p.stacks; i++)
+		stack_cdf[i] /= sum;
+
+	return 0;
+}
+
+void event_gen_fini(void)
+{
+	free(stacks);
+	free(stack_cdf);
+	stacks = NULL;
+	stack_cdf = NULL;
+}
+
+void event_gen_next(struct gen_event *e)
+{
+	double u = random_double();
+	unsigned low = 0, high = p.stacks - 1, middle, thread;
+
+	/* the first stack whose cumulative probability reaches u */
+	while (low < high) {
+		middle = (low + high) / 2;
+		if (stack_cdf[middle] < u)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+	e->bt = &stacks[low];
+
+	thread = random_u64() % p.threads;
+	e->pid = 1000 + thread / 4 * 4;
+	snprintf(e->comm, sizeof(e->comm), "task%u", thread / 4);
+	e->ev.tid = 1000 + thread;
+	e->ev.type = random_u64() & 1 ? 'S' : 'B';
+	e->ev.delay = (uint64_t) (1000.0 * pow(100000.0, random_double()));
+	e->ev.cpu = thread % 8;
+	/* the events are 10 us apart from an arbitrary epoch */
+	e->ev.time = EPOCH_NS + ++event_seq * 10000;
+}
+
+void event_gen_format(struct outbuf *ob, const struct gen_event *e, uint64_t seq)
+{
+	int i;
+
+	/* not sampled, the weight is 1 */
+	ob_printf(ob, "%c %llu %llu %d %d %llu %u 1 %s\n", e->ev.type, (unsigned long long) seq,
+	          (unsigned long long) e->ev.delay, e->pid, e->ev.tid,
+	          (unsigned long long) e->ev.time, e->ev.cpu, e->comm);
+	for (i = 0; i < MAX_BT_LEN && e->bt->trace[i]; i++)
+		ob_printf(ob, "%s0x%lx", i ? " " : "", e->bt->trace[i]);
+	ob_putc(ob, '\n');
+}
+
+int event_gen_write_kallsyms(FILE *f)
+{
+	unsigned i;
+
+	for (i = 0; i < p.symbols; i++)
+		fprintf(f, "%016lx T gen_function_%u\n", SYMBOL_BASE + i * SYMBOL_SIZE, i);
+	return ferror(f) ? -EIO : 0;
+}
@@ -0,0 +1,46 @@
+/*
+ * Copyright 2026 agent
+ * Author: agent <agent@local>
+ * License: GPLv2
+ */
+#ifndef _EVENT_GEN_H
+#define _EVENT_GEN_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+#include "back_trace.h"
+#include "outbuf.h"
+#include "process.h"
+
+struct event_gen_params {
+	unsigned threads;	/* 4 threads per process */
+	unsigned stacks;	/* distinct back traces */
+	unsigned depth;		/* frames per trace, at most MAX_BT_LEN */
+	unsigned symbols;	/* in the fake kallsyms */
+	double skew;		/* Zipf exponent of the stack popularity, 0 is uniform */
+	uint64_t seed;
+};
+
+#define EVENT_GEN_DEFAULTS { .threads = 64, .stacks = 1000, .depth = 8, \
+                             .symbols = 20000, .skew = 1.0, .seed = 1 }
+
+struct gen_event {
+	pid_t pid;
+	char comm[16];
+	struct la_event ev;
+	const struct back_trace *bt;
+};
+
+int  event_gen_init(const struct event_gen_params *params);
+void event_gen_fini(void);
+void event_gen_next(struct gen_event *e);
+/* Appends the event as lat.stp prints it */
+void event_gen_format(struct outbuf *ob, const struct gen_event *e, uint64_t seq);
+/* A kallsyms file with the symbols of the generated traces */
+int  event_gen_write_kallsyms(FILE *f);
+/* A random address in the symbols, for lookups */
+unsigned long event_gen_address(void);
+
+#endif
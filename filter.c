@@ -0,0 +1,240 @@
+/*
+ * filter keeps the set-based filters which lat.stp evaluates in the kernel,
+ * before any formatting or stack capture is done.
+ *
+ * Copyright 2026 agent
+ * Author: agent <agent@local>
+ * License: GPLv2
+ */
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "filter.h"
+
+struct filter {
+	enum filter_type type;
+	unsigned long long id;	/* pid or cgroup id */
+	char comm[16];		/* TASK_COMM_LEN */
+};
+
+static struct filter *filters;
+static unsigned n_filters, filters_alloc;
+
+static const char *const probe_names[_NR_FILTER_TYPES] = {
+	[FILTER_PID]      = "pid",
+	[FILTER_PID_TREE] = "tree",
+	[FILTER_COMM]     = "comm",
+	[FILTER_CGROUP]   = "cgroup",
+};
+
+static int parse_id(const char *spec, unsigned long long *id)
+{
+	char *endptr;
+
+	errno = 0;
+	*id = strtoull(spec, &endptr, 10);
+	if (errno || endptr == spec || *endptr != '\0' || *id == 0)
+		return -EINVAL;
+	return 0;
+}
+
+int filter_add(enum filter_type type, const char *spec)
+{
+	struct filter f = { .type = type };
+	struct stat st;
+	int r;
+
+	switch (type) {
+	case FILTER_PID:
+	case FILTER_PID_TREE:
+		r = parse_id(spec, &f.id);
+		if (r < 0)
+			return r;
+		break;
+	case FILTER_COMM:
+		if (*spec == '\0' || strlen(spec) >= sizeof(f.comm) || strchr(spec, ' '))
+			return -EINVAL;
+		strcpy(f.comm, spec);
+		break;
+	case FILTER_CGROUP:
+		/* on cgroup2, the inode number is the cgroup id */
+		if (stat(spec, &st) < 0)
+			return -errno;
+		if (!S_ISDIR(st.st_mode))
+			return -ENOTDIR;
+		f.id = st.st_ino;
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	if (n_filters == filters_alloc) {
+		unsigned new_alloc = filters_alloc ? 2 * filters_alloc : 16;
+		struct filter *new_filters = realloc(filters, new_alloc * sizeof(struct filter));
+		if (!new_filters)
+			return -ENOMEM;
+		filters = new_filters;
+		filters_alloc = new_alloc;
+	}
+
+	filters[n_filters++] = f;
+	return 0;
+}
+
+void filter_clear(void)
+{
+	n_filters = 0;
+}
+
+bool filter_active(void)
+{
+	return n_filters > 0;
+}
+
+bool filter_has_type(enum filter_type type)
+{
+	unsigned i;
+
+	for (i = 0; i < n_filters; i++)
+		if (filters[i].type == type)
+			return true;
+	return false;
+}
+
+bool filter_match(pid_t pid, const char *comm)
+{
+	unsigned i;
+
+	if (!n_filters)
+		return true;
+
+	for (i = 0; i < n_filters; i++) {
+		const struct filter *f = &filters[i];
+
+		if (f->type == FILTER_PID && f->id == pid)
+			return true;
+		if (f->type == FILTER_COMM && !strncmp(comm, f->comm, strlen(f->comm)))
+			return true;
+	}
+	return false;
+}
+
+static pid_t get_ppid(pid_t pid)
+{
+	char path[64], buf[512], *p;
+	FILE *f;
+	int ppid = 0;
+
+	snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+	f = fopen(path, "re");
+	if (!f)
+		return 0;
+
+	/* comm may contain spaces and parentheses, skip to the last ')' */
+	if (fgets(buf, sizeof(buf), f) && (p = strrchr(buf, ')')))
+		sscanf(p + 1, " %*c %d", &ppid);
+
+	fclose(f);
+	return ppid;
+}
+
+static bool in_tree(pid_t pid, pid_t root, const pid_t *ppids, pid_t max_pid)
+{
+	/* depth is bounded in case of a ppid loop caused by pid reuse */
+	int depth;
+
+	for (depth = 0; depth < 64 && pid > 0 && pid <= max_pid; depth++) {
+		if (pid == root)
+			return true;
+		pid = ppids[pid];
+	}
+	return false;
+}
+
+/* The probe follows forks, but descendants existing already must be sent */
+static int for_each_descendant(pid_t root,
+                               int (*write_cmd)(void *userdata, const char *cmd),
+                               void *userdata)
+{
+	DIR *d;
+	struct dirent *de;
+	pid_t *ppids = NULL, pid, max_pid = 0;
+	char cmd[64];
+	int r = 0;
+
+	d = opendir("/proc");
+	if (!d)
+		return -errno;
+
+	/* pass 1: collect the parent of every process */
+	while ((de = readdir(d))) {
+		pid = atoi(de->d_name);
+		if (pid <= 0)
+			continue;
+		if (pid > max_pid) {
+			pid_t *new_ppids = realloc(ppids, (pid + 1) * sizeof(pid_t));
+			if (!new_ppids) {
+				r = -ENOMEM;
+				goto out;
+			}
+			memset(new_ppids + max_pid + 1, 0, (pid - max_pid) * sizeof(pid_t));
+			ppids = new_ppids;
+			max_pid = pid;
+		}
+		ppids[pid] = get_ppid(pid);
+	}
+
+	/* pass 2: send the descendants */
+	for (pid = 1; pid <= max_pid && r == 0; pid++) {
+		if (!ppids[pid] || pid == root || !in_tree(ppids[pid], root, ppids, max_pid))
+			continue;
+		snprintf(cmd, sizeof(cmd), "+tree %d", pid);
+		r = write_cmd(userdata, cmd);
+	}
+
+out:
+	free(ppids);
+	closedir(d);
+	return r;
+}
+
+int filter_for_each_command(int (*write_cmd)(void *userdata, const char *cmd),
+                            void *userdata)
+{
+	char cmd[64];
+	unsigned i;
+	int r, r2;
+
+	/* drops all events until "commit", so no unfiltered flood in between */
+	r = write_cmd(userdata, "reset");
+
+	for (i = 0; i < n_filters && r == 0; i++) {
+		const struct filter *f = &filters[i];
+
+		if (f->type == FILTER_COMM)
+			snprintf(cmd, sizeof(cmd), "+%s %s", probe_names[f->type], f->comm);
+		else
+			snprintf(cmd, sizeof(cmd), "+%s %llu", probe_names[f->type], f->id);
+		r = write_cmd(userdata, cmd);
+
+		if (r == 0 && f->type == FILTER_PID_TREE)
+			r = for_each_descendant(f->id, write_cmd, userdata);
+	}
+
+	/* even after a failure, or the probe keeps dropping everything */
+	r2 = write_cmd(userdata, "commit");
+
+	return r ?: r2;
+}
+
+void filter_fini(void)
+{
+	free(filters);
+	filters = NULL;
+	n_filters = filters_alloc = 0;
+}
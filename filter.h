@@ -0,0 +1,40 @@
+/*
+ * Copyright 2026 agent
+ * Author: agent <agent@local>
+ * License: GPLv2
+ */
+#ifndef _FILTER_H
+#define _FILTER_H
+
+#include <sys/types.h>
+#include <stdbool.h>
+
+enum filter_type {
+	FILTER_PID,      /* all threads of a process */
+	FILTER_PID_TREE, /* a process and its descendants */
+	FILTER_COMM,     /* comm prefix */
+	FILTER_CGROUP,   /* cgroup v2 id */
+	_NR_FILTER_TYPES
+};
+
+/* Parses spec (a PID, a comm prefix or a cgroup path) and adds the filter */
+int  filter_add(enum filter_type type, const char *spec);
+void filter_clear(void);
+bool filter_active(void);
+bool filter_has_type(enum filter_type type);
+/*
+ * Evaluates the pid and comm filters in userspace, for data that did not
+ * come through the probe. The tree and cgroup filters never match.
+ */
+bool filter_match(pid_t pid, const char *comm);
+
+/*
+ * Calls write_cmd for every probe command needed to install the filters.
+ * The commands are understood by lat.stp's procfs("filter") probe.
+ */
+int filter_for_each_command(int (*write_cmd)(void *userdata, const char *cmd),
+                            void *userdata);
+
+void filter_fini(void);
+
+#endif
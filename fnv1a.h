@@ -0,0 +1,45 @@
+/*
+ * FNV-1a, the hash of the open addressing tables. fnv1a_add() continues
+ * a hash, e.g. over the fields of a key.
+ *
+ * Copyright 2026 agent
+ * Author: agent <agent@local>
+ * License: GPLv2
+ */
+#ifndef _FNV1A_H
+#define _FNV1A_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define FNV1A_BASIS 2166136261U
+#define FNV1A_PRIME 16777619U
+
+static inline uint32_t fnv1a_add(uint32_t h, const void *p, size_t len)
+{
+	const unsigned char *b = p;
+
+	while (len--) {
+		h ^= *b++;
+		h *= FNV1A_PRIME;
+	}
+	return h;
+}
+
+static inline uint32_t fnv1a_bytes(const void *p, size_t len)
+{
+	return fnv1a_add(FNV1A_BASIS, p, len);
+}
+
+static inline uint32_t fnv1a_string(const char *s)
+{
+	uint32_t h = FNV1A_BASIS;
+
+	while (*s) {
+		h ^= (unsigned char) *s++;
+		h *= FNV1A_PRIME;
+	}
+	return h;
+}
+
+#endif
@@ -0,0 +1,142 @@
+/*
+ * lattop-gen: writes a synthetic lat.stp stream to stdout, to feed lattop
+ * (--input, with -K for --kallsyms) or the benchmarks without root or a
+ * kernel probe.
+ *
+ * Copyright 2026 agent
+ * Author: agent <agent@local>
+ * License: GPLv2
+ */
+#include <errno.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "event_gen.h"
+
+static void usage_and_exit(int code)
+{
+	fprintf(stderr,
+"Usage: lattop-gen [-n EVENTS] [-r RATE] [-t THREADS] [-s STACKS] [-z SKEW]\n"
+"                  [-d DEPTH] [-y SYMBOLS] [-S SEED] [-K KALLSYMS]\n"
+"  -n EVENTS    stop after EVENTS events (default: 0, endless)\n"
+"  -r RATE      events per second (default: 0, as fast as possible)\n"
+"  -t THREADS   number of threads, 4 per process (default: 64)\n"
+"  -s STACKS    number of distinct stacks (default: 1000)\n"
+"  -z SKEW      Zipf exponent of the stacks' popularity, 0 is uniform (default: 1)\n"
+"  -d DEPTH     frames per stack, at most %d (default: 8)\n"
+"  -y SYMBOLS   number of kernel functions (default: 20000)\n"
+"  -S SEED      random seed (default: 1)\n"
+"  -K KALLSYMS  also write the functions in the /proc/kallsyms format\n",
+	MAX_BT_LEN);
+	exit(code);
+}
+
+static unsigned long parse_number(const char *s)
+{
+	char *end;
+	unsigned long v;
+
+	errno = 0;
+	v = strtoul(s, &end, 10);
+	if (errno || end == s || *end) {
+		fprintf(stderr, "Invalid number '%s'\n", s);
+		exit(1);
+	}
+	return v;
+}
+
+int main(int argc, char *argv[])
+{
+	struct event_gen_params params = EVENT_GEN_DEFAULTS;
+	unsigned long long events = 0, seq = 0;
+	unsigned long rate = 0, batch;
+	const char *kallsyms = NULL;
+	struct outbuf ob = {};
+	struct gen_event e;
+	struct timespec next;
+	FILE *f;
+	int c, r;
+
+	while ((c = getopt(argc, argv, "n:r:t:s:z:d:y:S:K:h")) != -1) {
+		switch (c) {
+		case 'n':
+			events = parse_number(optarg);
+			break;
+		case 'r':
+			rate = parse_number(optarg);
+			break;
+		case 't':
+			params.threads = parse_number(optarg);
+			break;
+		case 's':
+			params.stacks = parse_number(optarg);
+			break;
+		case 'z':
+			params.skew = atof(optarg);
+			break;
+		case 'd':
+			params.depth = parse_number(optarg);
+			break;
+		case 'y':
+			params.symbols = parse_number(optarg);
+			break;
+		case 'S':
+			params.seed = parse_number(optarg);
+			break;
+		case 'K':
+			kallsyms = optarg;
+			break;
+		case 'h':
+			usage_and_exit(0);
+		default:
+			usage_and_exit(1);
+		}
+	}
+	if (optind < argc)
+		usage_and_exit(1);
+
+	r = event_gen_init(&params);
+	if (r < 0) {
+		fprintf(stderr, "Invalid parameters: %s\n", strerror(-r));
+		return 1;
+	}
+
+	if (kallsyms) {
+		f = fopen(kallsyms, "we");
+		if (!f || event_gen_write_kallsyms(f) < 0 || fclose(f)) {
+			fprintf(stderr, "Cannot write %s: %s\n", kallsyms, strerror(errno));
+			return 1;
+		}
+	}
+
+	/* with a rate, batches of 10 ms */
+	batch = rate ? (rate + 99) / 100 : 4096;
+	clock_gettime(CLOCK_MONOTONIC, &next);
+
+	ob_puts(&ob, "lat begin\n");
+	while (!events || seq < events) {
+		unsigned long i;
+
+		for (i = 0; i < batch && (!events || seq < events); i++) {
+			event_gen_next(&e);
+			event_gen_format(&ob, &e, ++seq);
+		}
+		if (ob_flush(&ob, STDOUT_FILENO) < 0)
+			break;
+
+		if (rate) {
+			next.tv_nsec += 1000000000LL * batch / rate;
+			next.tv_sec += next.tv_nsec / 1000000000;
+			next.tv_nsec %= 1000000000;
+			clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+		}
+	}
+
+	ob_free(&ob);
+	event_gen_fini();
+	return 0;
+}
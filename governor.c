@@ -0,0 +1,87 @@
+/*
+ * governor keeps lattop's overhead under the configured budget (--cpu-budget,
+ * --max-rate). Every interval it measures lattop's own CPU use and the event
+ * rate and makes the probe sample 1 in N events when it is over the budget.
+ * Accounted events are weighted by N, so the reported counts and totals stay
+ * comparable.
+ *
+ * Copyright 2026 agent
+ * Author: agent <agent@local>
+ * License: GPLv2
+ */
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "governor.h"
+
+#include "lattop.h"
+#include "process_accountant.h"
+#include "self_stats.h"
+#include "timespan.h"
+
+#define MAX_SAMPLE_FACTOR 65536
+
+static unsigned sample_n = 1;
+static uint64_t last_wall, last_cpu;
+
+static uint64_t now_ns(clockid_t clock)
+{
+	struct timespec ts;
+
+	clock_gettime(clock, &ts);
+	return ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+unsigned governor_sample_factor(void)
+{
+	return sample_n;
+}
+
+void governor_tick(void)
+{
+	uint64_t wall, cpu;
+	double cpu_percent, rate, over = 0.0, f;
+	unsigned new_n = sample_n;
+
+	wall = now_ns(CLOCK_MONOTONIC) - last_wall;
+	cpu = now_ns(CLOCK_PROCESS_CPUTIME_ID) - last_cpu;
+	last_wall += wall;
+	last_cpu += cpu;
+	if (wall)
+		self_stats.cpu_percent = 100.0 * cpu / wall;
+
+	if ((!arg_cpu_budget && !arg_max_rate) || wall == 0)
+		return;
+
+	/* how many times over the budget are we? */
+	cpu_percent = 100.0 * cpu / wall;
+	rate = (double) pa_event_count() * NSEC_PER_SEC / wall;
+	if (arg_cpu_budget && cpu_percent / arg_cpu_budget > over)
+		over = cpu_percent / arg_cpu_budget;
+	if (arg_max_rate && rate / arg_max_rate > over)
+		over = rate / arg_max_rate;
+
+	/* the measured load is already reduced by the current factor */
+	if (over > 1.0) {
+		/* in floating point, a storm can be far over any unsigned */
+		f = sample_n * ceil(over);
+		new_n = f > MAX_SAMPLE_FACTOR ? MAX_SAMPLE_FACTOR : (unsigned) f;
+	} else if (over < 0.5 && sample_n > 1)
+		new_n = sample_n / 2;
+
+	if (new_n == sample_n)
+		return;
+
+	sample_n = new_n;
+	lattop_sampling_changed();
+	fprintf(stderr, "Governor: %.1f%% CPU, %.0f events/s, now sampling 1 in %u events.\n",
+	        cpu_percent, rate, sample_n);
+}
+
+void governor_init(void)
+{
+	last_wall = now_ns(CLOCK_MONOTONIC);
+	last_cpu = now_ns(CLOCK_PROCESS_CPUTIME_ID);
+}
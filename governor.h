@@ -0,0 +1,15 @@
+/*
+ * Copyright 2026 agent
+ * Author: agent <agent@local>
+ * License: GPLv2
+ */
+#ifndef _GOVERNOR_H
+#define _GOVERNOR_H
+
+void governor_init(void);
+/* Measures the last interval and adjusts the probe's sampling */
+void governor_tick(void);
+/* The probe currently passes 1 in governor_sample_factor() events */
+unsigned governor_sample_factor(void);
+
+#endif
@@ -5,60 +5,95 @@
  */
 #include <sys/types.h>
 #include <errno.h>
-#include <limits.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include "rbtree.h"
-#include "sym_translator.h"
+
+#include "lat_translator.h"
+
+#include "fnv1a.h"
 
 struct symbol_translation {
-	struct rb_node rb_node;
 	char *symbol;
 	char *translation;
 	int prio;
 };
 
-static struct rb_root sym2trans = RB_ROOT;
+/* translations, indexed by translation id */
+static struct symbol_translation *translations;
+static unsigned n_translations, translations_alloc;
+
+/*
+ * Open addressing hash table of translation ids, keyed by the symbol name.
+ * Empty slots are -1. Always kept at most half full.
+ */
+static int *sym2trans;
+static unsigned sym2trans_size;
 
-static struct symbol_translation *__insert_symbol(const char *symbol, struct symbol_translation *st)
+/* Returns the slot where the symbol is, or the empty slot where it belongs */
+static int *find_slot(const char *symbol)
 {
-	struct rb_node **p = &sym2trans.rb_node;
-	struct rb_node *parent = NULL;
-	struct symbol_translation *ist;
-	int cmp;
-
-	while (*p) {
-		parent = *p;
-		ist = rb_entry(parent, struct symbol_translation, rb_node);
-
-		cmp = strcmp(symbol, ist->symbol);
-		if (cmp < 0)
-			p = &(*p)->rb_left;
-		else if (cmp > 0)
-			p = &(*p)->rb_right;
-		else
-			return ist;
+	unsigned mask = sym2trans_size - 1;
+	unsigned i = fnv1a_string(symbol) & mask;
+
+	while (sym2trans[i] >= 0 &&
+	       strcmp(translations[sym2trans[i]].symbol, symbol))
+		i = (i + 1) & mask;
+
+	return &sym2trans[i];
+}
+
+static int grow_table(void)
+{
+	int *old = sym2trans;
+	unsigned old_size = sym2trans_size;
+	unsigned i;
+
+	sym2trans_size = old_size ? old_size * 2 : 256;
+	sym2trans = malloc(sym2trans_size * sizeof(int));
+	if (!sym2trans) {
+		sym2trans = old;
+		sym2trans_size = old_size;
+		return -ENOMEM;
 	}
+	memset(sym2trans, -1, sym2trans_size * sizeof(int));
 
-	rb_link_node(&st->rb_node, parent, p);
+	for (i = 0; i < n_translations; i++)
+		*find_slot(translations[i].symbol) = i;
 
-	return NULL;
+	free(old);
+	return 0;
 }
 
-static struct symbol_translation *insert_symbol(const char *symbol, struct symbol_translation *st)
+static int insert_symbol(char *symbol, char *translation, int prio)
 {
-	struct symbol_translation *ret;
-	if ((ret = __insert_symbol(symbol, st))) {
-		/* we already know this address. some alias? */
-		free(st->symbol);
-		free(st->translation);
-		free(st);
-		goto out;
+	struct symbol_translation *st;
+	int *slot;
+
+	if (2 * (n_translations + 1) > sym2trans_size && grow_table() < 0)
+		return -ENOMEM;
+
+	slot = find_slot(symbol);
+	if (*slot >= 0)
+		/* we already know this symbol, the first definition wins */
+		return -EEXIST;
+
+	if (n_translations == translations_alloc) {
+		unsigned new_alloc = translations_alloc ? translations_alloc * 2 : 128;
+		st = realloc(translations, new_alloc * sizeof(struct symbol_translation));
+		if (!st)
+			return -ENOMEM;
+		translations = st;
+		translations_alloc = new_alloc;
 	}
-	rb_insert_color(&st->rb_node, &sym2trans);
-out:
-	return ret;
+
+	st = &translations[n_translations];
+	st->symbol = symbol;
+	st->translation = translation;
+	st->prio = prio;
+	*slot = n_translations++;
+	return 0;
 }
 
 static int parse_latencytop_trans(void)
@@ -67,10 +102,9 @@ static int parse_latencytop_trans(void)
 	char *line = NULL;
 	size_t len = 0;
 	ssize_t read;
-	int prio;
+	int prio, r;
 	char *symbol;
 	char *translation;
-	struct symbol_translation *st;
 
 	f = fopen("/usr/share/latencytop/latencytop.trans", "re");
 	if (!f) {
@@ -87,11 +121,13 @@ static int parse_latencytop_trans(void)
 			continue;
 		}
 
-		st = malloc(sizeof(struct symbol_translation));
-		st->symbol = symbol;
-		st->translation = translation;
-		st->prio = prio;
-		insert_symbol(symbol, st);
+		r = insert_symbol(symbol, translation, prio);
+		if (r < 0) {
+			free(symbol);
+			free(translation);
+			if (r == -ENOMEM)
+				break;
+		}
 	}
 	if (line)
 		free(line);
@@ -99,93 +135,33 @@ static int parse_latencytop_trans(void)
 	return 0;
 }
 
-struct symbol_translation *lookup_symbol(const char *symbol)
+int lat_translator_lookup(const char *symbol)
 {
-	struct rb_node *n = sym2trans.rb_node;
-	struct symbol_translation *st;
-	int cmp;
-
-	while (n) {
-		st = rb_entry(n, struct symbol_translation, rb_node);
-
-		cmp = strcmp(symbol, st->symbol);
-		if (cmp < 0)
-			n = n->rb_left;
-		else if (cmp > 0)
-			n = n->rb_right;
-		else
-			return st;
-	}
+	int id;
 
-	return NULL;
-}
+	if (!sym2trans)
+		return -ENOENT;
 
-static void delete_symbols(struct rb_node *n)
-{
-	struct symbol_translation *s;
-	if (!n)
-		return;
-	delete_symbols(n->rb_left);
-	delete_symbols(n->rb_right);
-	s = rb_entry(n, struct symbol_translation, rb_node);
-	free(s->symbol);
-	free(s->translation);
-	free(s);
+	id = *find_slot(symbol);
+	return id >= 0 ? id : -ENOENT;
 }
 
-int lat_translator_lookup(const char *symbol, const char **translation, int *prio)
+const char *lat_translator_translation(int id)
 {
-	struct symbol_translation *st = lookup_symbol(symbol);
-
-	if (!st)
-		return -ENOENT;
-
-	*translation = st->translation;
-	*prio = st->prio;
-	return 0;
+	return translations[id].translation;
 }
 
-const char *lat_translator_translate_stack(char *symbolic_stack_trace)
+int lat_translator_prio(int id)
 {
-	const char *translation, *best_translation = NULL;
-	char *p;
-	size_t len;
-	int prio, best_prio = INT_MIN;
-	char tmp;
-
-	p = symbolic_stack_trace;
-	while (*p) {
-		/* skip spaces */
-		p += strspn(p, " ");
-		if (*p == '\0')
-			break;
-
-		/* isolate single symbol */
-		len = strcspn(p, " ");
-		tmp = p[len];
-		p[len] = '\0'; /* cut */
-
-		if (lat_translator_lookup(p, &translation, &prio) == 0 &&
-		    prio > best_prio) {
-			best_prio = prio;
-			best_translation = translation;
-		}
-
-		p[len] = tmp; /* uncut */
-		p += len;
-	}
-
-	return best_translation ?: NULL;
+	return translations[id].prio;
 }
 
 /*void lat_translator_dump(void)
 {
-	struct rb_node *node;
-	struct symbol_translation *st;
-	for (node = rb_first(&sym2trans); node; node = rb_next(node)) {
-		st = rb_entry(node, struct symbol_translation, rb_node);
-		printf("%d %s => %s\n", st->prio, st->symbol, st->translation);
-	}
+	unsigned i;
+	for (i = 0; i < n_translations; i++)
+		printf("%d %s => %s\n", translations[i].prio,
+		       translations[i].symbol, translations[i].translation);
 }*/
 
 int lat_translator_init(void)
@@ -195,5 +171,15 @@ int lat_translator_init(void)
 
 void lat_translator_fini(void)
 {
-	delete_symbols(sym2trans.rb_node);
+	unsigned i;
+
+	for (i = 0; i < n_translations; i++) {
+		free(translations[i].symbol);
+		free(translations[i].translation);
+	}
+	free(translations);
+	free(sym2trans);
+	translations = NULL;
+	sym2trans = NULL;
+	n_translations = translations_alloc = sym2trans_size = 0;
 }
@@ -9,7 +9,10 @@
 int  lat_translator_init(void);
 void lat_translator_fini(void);
 /*void lat_translator_dump(void);*/
-int lat_translator_lookup(const char *symbol, const char **translation, int *prio);
-const char *lat_translator_translate_stack(const char *symbolic_stack_trace);
+
+/* Returns the translation id of the symbol, or -ENOENT. */
+int lat_translator_lookup(const char *symbol);
+const char *lat_translator_translation(int id);
+int lat_translator_prio(int id);
 
 #endif
@@ -6,6 +6,7 @@
 #include <assert.h>
 #include <errno.h>
 #include <getopt.h>
+#include <limits.h>
 #include <poll.h>
 #include <sched.h>
 #include <string.h>
@@ -16,31 +17,122 @@
 #include "lattop.h"
 
 #include "process_accountant.h"
-#include "sym_translator.h"
-#include "lat_translator.h"
+#include "symbol_loader.h"
 
 #include "polled_reader.h"
 #include "timer_reader.h"
 #include "signal_reader.h"
 #include "stap_reader.h"
+#include "command_reader.h"
+#include "filter.h"
+#include "governor.h"
+#include "stack_rewrite.h"
+#include "stack_table.h"
 #include "timespan.h"
-
-#define MAX_READERS 3
-
-int arg_interval = 5;
+#include "tui.h"
+#include "daemon.h"
+#include "client.h"
+#include "metrics.h"
+#include "shm_writer.h"
+#include "lattop_shm.h"
+#include "recording.h"
+#include "snapshot.h"
+#include "diff.h"
+
+/* stap, signal, command or listener, metrics, timer, and the connections */
+#define MAX_READERS (5 + MAX_CLIENTS + MAX_HTTP_CONNS)
+
+unsigned arg_interval_ms = 5000;
 int arg_count;
 enum sort_by arg_sort = SORT_BY_MAX_LATENCY;
 bool arg_reverse;
+enum output_format arg_format = FORMAT_TEXT;
+const char *arg_output;
 unsigned long long arg_min_delay;
 unsigned long long arg_max_interruptible_delay = 5*NSEC_PER_MSEC;
-pid_t arg_pid_filter;
+unsigned arg_cpu_budget;
+unsigned arg_max_rate;
+unsigned arg_tid_rate;
+unsigned arg_stack_depth = DEFAULT_BT_LEN;
+bool arg_by_function;
+unsigned arg_tree_depth = DEFAULT_TREE_DEPTH;
+double arg_tree_min = DEFAULT_TREE_MIN;
+bool arg_interactive;
+const char *arg_daemon;
+const char *arg_connect;
+const char *arg_metrics;
+unsigned arg_metrics_limit = DEFAULT_METRICS_LIMIT;
+const char *arg_shm;
+const char *arg_record;
+const char *arg_diff;
+const char *arg_kallsyms;
+static const char *arg_input;
+static const char *arg_report;
+static bool arg_merge;
+static time_t report_from, report_to = (time_t) ((1ULL << (sizeof(time_t) * 8 - 1)) - 1);
+static bool interval_given;
+
+/* the filters given on the command line, for lattop_restore_filters() */
+static unsigned long long initial_min_delay;
+static unsigned long long initial_max_interruptible_delay;
 
 static struct polled_reader *readers[MAX_READERS];
 static struct pollfd poll_fds[MAX_READERS];
+static bool removed[MAX_READERS];
 static unsigned num_readers;
 
 static int should_quit;
 
+static const char *const sort_names[_NR_SORT_BY] = {
+	[SORT_BY_MAX_LATENCY]   = "max",
+	[SORT_BY_TOTAL_LATENCY] = "total",
+	[SORT_BY_PID]           = "pid",
+	[SORT_BY_COUNT]         = "count",
+	[SORT_BY_SLEEP]         = "sleep",
+	[SORT_BY_BLOCK]         = "block",
+};
+
+static const char *const format_names[_NR_FORMATS] = {
+	[FORMAT_TEXT] = "text",
+	[FORMAT_JSON] = "json",
+	[FORMAT_CSV]  = "csv",
+	[FORMAT_FOLDED] = "folded",
+	[FORMAT_PPROF] = "pprof",
+	[FORMAT_SNAPSHOT] = "snapshot",
+	[FORMAT_TREE] = "tree",
+	[FORMAT_CALLERS] = "callers",
+};
+
+int lattop_parse_sort(const char *name)
+{
+	int i;
+
+	for (i = 0; i < _NR_SORT_BY; i++)
+		if (!strcasecmp(name, sort_names[i]))
+			return i;
+	return -EINVAL;
+}
+
+const char *lattop_sort_name(enum sort_by sort)
+{
+	return sort_names[sort];
+}
+
+int lattop_parse_format(const char *name)
+{
+	int i;
+
+	for (i = 0; i < _NR_FORMATS; i++)
+		if (!strcasecmp(name, format_names[i]))
+			return i;
+	return -EINVAL;
+}
+
+const char *lattop_format_name(enum output_format format)
+{
+	return format_names[format];
+}
+
 static int start_reader(unsigned index)
 {
 	int r;
@@ -61,20 +153,149 @@ static int start_reader(unsigned index)
 
 	poll_fds[index].fd = readers[index]->ops->get_fd(readers[index]);
 	poll_fds[index].events = POLLIN;
+	poll_fds[index].revents = 0;
+	removed[index] = false;
 	return 0;
 }
 
+int lattop_add_reader(struct polled_reader *r)
+{
+	int ret;
+
+	if (num_readers == MAX_READERS)
+		return -EMFILE;
+
+	readers[num_readers] = r;
+	ret = start_reader(num_readers);
+	if (ret)
+		return ret;
+
+	num_readers++;
+	return 0;
+}
+
+static int reader_index(struct polled_reader *r)
+{
+	int i;
+
+	for (i = 0; i < num_readers; i++)
+		if (readers[i] == r)
+			return i;
+	return -1;
+}
+
+void lattop_remove_reader(struct polled_reader *r)
+{
+	int i = reader_index(r);
+
+	/* freed by reap_readers(), the main loop may still be iterating */
+	if (i >= 0) {
+		removed[i] = true;
+		poll_fds[i].fd = -1;
+	}
+}
+
+void lattop_reader_want_write(struct polled_reader *r, bool want)
+{
+	int i = reader_index(r);
+
+	if (i >= 0)
+		poll_fds[i].events = want ? POLLIN|POLLOUT : POLLIN;
+}
+
+static void reap_readers(void)
+{
+	unsigned i, j = 0;
+
+	for (i = 0; i < num_readers; i++) {
+		if (removed[i]) {
+			if (readers[i]->ops->fini)
+				readers[i]->ops->fini(readers[i]);
+			free(readers[i]);
+			continue;
+		}
+		readers[j] = readers[i];
+		poll_fds[j] = poll_fds[i];
+		removed[j] = false;
+		j++;
+	}
+	num_readers = j;
+}
+
 void lattop_reader_started(struct polled_reader *r)
 {
 	/* stap reader */
 	assert(readers[0] == r);
-	assert(num_readers < MAX_READERS);
 
-	readers[num_readers] = timer_reader_new();
-	start_reader(num_readers);
-	num_readers++;
+	/* the governor measures from here, not including the compilation */
+	governor_init();
+
+	lattop_add_reader(timer_reader_new());
+
+	if (!arg_input)
+		fprintf(stderr, "Systemtap probe activated. Reading data...\n");
+}
+
+void lattop_reader_stopped(struct polled_reader *r)
+{
+	int i;
+
+	/* poll() ignores negative fds */
+	for (i = 0; i < num_readers; i++) {
+		if (readers[i] == r)
+			poll_fds[i].fd = -1;
+	}
+}
+
+void lattop_delays_changed(void)
+{
+	int r;
+
+	/* only the parameters, the task filter sets stay as they are */
+	r = stap_reader_set_delays(readers[0]);
+	if (r == -EAGAIN)
+		fprintf(stderr, "The filters will change when the probe is activated.\n");
+	else if (r)
+		fprintf(stderr, "Failed to change the probe's filters: %s\n", strerror(-r));
+	else
+		fprintf(stderr, "Filters: min-latency %llu us, max-interruptible %llu us\n",
+		        arg_min_delay / NSEC_PER_USEC,
+		        arg_max_interruptible_delay / NSEC_PER_USEC);
+}
 
-	fprintf(stderr, "Systemtap probe activated. Reading data...\n");
+void lattop_filters_changed(void)
+{
+	int r;
+
+	r = stap_reader_set_filters(readers[0]);
+	if (r == -EAGAIN)
+		fprintf(stderr, "The filters will change when the probe is activated.\n");
+	else if (r)
+		fprintf(stderr, "Failed to change the probe's task filters: %s\n", strerror(-r));
+	else
+		fprintf(stderr, "Task filters: %s\n", filter_active() ? "on" : "none");
+}
+
+void lattop_sampling_changed(void)
+{
+	int r;
+
+	r = stap_reader_set_sampling(readers[0], governor_sample_factor());
+	if (r)
+		fprintf(stderr, "Failed to change the probe's sampling: %s\n", strerror(-r));
+}
+
+void lattop_shed_load(void)
+{
+	arg_min_delay = arg_min_delay ? arg_min_delay * 2 : 100 * NSEC_PER_USEC;
+	lattop_delays_changed();
+}
+
+void lattop_restore_filters(void)
+{
+	arg_min_delay = initial_min_delay;
+	arg_max_interruptible_delay = initial_max_interruptible_delay;
+	lattop_delays_changed();
 }
 
 static int main_loop(void)
@@ -90,10 +311,16 @@ static int main_loop(void)
 		}
 
 		for (i = 0; i < num_readers; i++) {
-			if (!poll_fds[i].revents)
+			short revents = poll_fds[i].revents;
+
+			if (!revents || removed[i])
 				continue;
 
-			r = readers[i]->ops->handle_ready_fd(readers[i]);
+			r = 0;
+			if ((revents & POLLOUT) && readers[i]->ops->handle_writable)
+				r = readers[i]->ops->handle_writable(readers[i]);
+			if (!r && (revents & ~POLLOUT) && !removed[i])
+				r = readers[i]->ops->handle_ready_fd(readers[i]);
 			if (r) {
 				should_quit = 1;
 				if (r > 0)
@@ -101,6 +328,8 @@ static int main_loop(void)
 				break;
 			}
 		}
+
+		reap_readers();
 	}
 
 	return r;
@@ -109,14 +338,24 @@ static int main_loop(void)
 static void fini(void)
 {
 	int i;
-	for (i = 0; i < num_readers; i++) {
+
+	reap_readers();
+	/* before the signals are unblocked, like the readers below */
+	shm_writer_fini();
+	recording_close();
+	/*
+	 * In reverse, the signal reader unblocks the signals and a pending
+	 * one could kill us before the later readers clean up.
+	 */
+	for (i = num_readers - 1; i >= 0; i--) {
 		if (readers[i]->ops->fini)
 			readers[i]->ops->fini(readers[i]);
 		free(readers[i]);
 	}
 	pa_fini();
-	sym_translator_fini();
-	lat_translator_fini();
+	symbol_loader_fini();
+	filter_fini();
+	stack_table_fini();
 }
 
 static int init(void)
@@ -124,30 +363,56 @@ static int init(void)
 	int r, i;
 	struct sched_param schedp;
 
-	r = lat_translator_init();
-	if (r)
-		fprintf(stderr, "Warning: Failed to load latencytop translations.\n");
-
-	r = sym_translator_init();
-	if (r) {
-		fprintf(stderr, "Failed to init the symbol map.\n");
-		goto err;
-	}
-
-	pa_init();
+	r = pa_init();
+	if (r < 0)
+		return r;
 
-	readers[num_readers++] = stap_reader_new();
+	readers[num_readers++] = arg_input ? stap_reader_new_file(arg_input) : stap_reader_new();
 	readers[num_readers++] = signal_reader_new();
+	if (arg_daemon)
+		readers[num_readers++] = listener_new(arg_daemon);
+	else if (arg_interactive)
+		readers[num_readers++] = tui_reader_new();
+	else
+		readers[num_readers++] = command_reader_new();
+	if (arg_metrics)
+		readers[num_readers++] = metrics_listener_new(arg_metrics);
 	assert(num_readers <= MAX_READERS);
 
-	fprintf(stderr, "Initializing Systemtap probe...\n");
+	if (arg_shm) {
+		r = shm_writer_init(arg_shm);
+		if (r < 0)
+			goto err;
+	}
+	if (arg_record) {
+		r = recording_open(arg_record);
+		if (r < 0)
+			goto err;
+	}
 
+	/* before the stap child inherits stderr */
+	if (arg_interactive) {
+		r = tui_init();
+		if (r < 0)
+			goto err;
+	}
+
+	if (arg_input)
+		fprintf(stderr, "Reading the probe's output from %s...\n", arg_input);
+	else
+		fprintf(stderr, "Initializing Systemtap probe...\n");
+
+	/* The stap reader is first, so the probe compiles while we load symbols */
 	for (i = 0; i < num_readers; i++) {
 		r = start_reader(i);
 		if (r < 0)
 			goto err;
 	}
 
+	r = symbol_loader_start();
+	if (r < 0)
+		goto err;
+
 	memset(&schedp, 0, sizeof(schedp));
 	schedp.sched_priority = 10;
 	r = sched_setscheduler(0, SCHED_FIFO, &schedp);
@@ -164,60 +429,181 @@ err:
 static void usage_and_exit(int code)
 {
 	fprintf(stderr,
-"Usage: lattop [-i INTERVAL] [-c COUNT] [-s SORT_BY] [-r]\n"
-"  -i, --interval=INTERVAL      time in seconds between printouts (default: 5)\n"
+"Usage: lattop [-i INTERVAL] [-c COUNT] [-s SORT_BY] [-r] [-f FORMAT] [-I]\n"
+"       lattop --daemon[=SOCKET] [-i INTERVAL] [probe options]\n"
+"       lattop --report=FILE [--from=TIME] [--to=TIME] [-s SORT_BY] [-r] [-f FORMAT]\n"
+"              [-p PID] [-C PREFIX]\n"
+"       lattop --merge [-s SORT_BY] [-r] [-f FORMAT] [-o FILE] [-C PREFIX] SNAPSHOT...\n"
+"       lattop --connect[=SOCKET] [-i INTERVAL] [-c COUNT] [-s SORT_BY] [-r] [-f FORMAT]\n"
+"              [-p PID] [-C PREFIX]\n"
+"  -i, --interval=INTERVAL      time in seconds between printouts, e.g. 0.5 (default: 5)\n"
 "  -c, --count=COUNT            stop after COUNT printouts\n"
 "  -s, --sort=SORT_BY           sort the output by one of:\n"
 "                                'max'      maximum latency (default)\n"
 "                                'total'    total latency\n"
 "                                'pid'      pid of the process\n"
+"                                'count'    number of latency events\n"
+"                                'sleep'    total latency in interruptible sleeps\n"
+"                                'block'    total latency in uninterruptible\n"
+"                                           blocks (D state, mostly I/O)\n"
 "  -r, --reverse                reverse the sort order\n"
+"  -f, --format=FORMAT          output format, one of:\n"
+"                                'text'     human readable (default)\n"
+"                                'json'     JSON Lines, a record per thread and stack\n"
+"                                'csv'      CSV, a row per thread and stack\n"
+"                                'folded'   collapsed stacks for flamegraph.pl\n"
+"                                'pprof'    pprof profile.proto, needs --output\n"
+"                                'snapshot' the run's sum by comm and symbolic\n"
+"                                           stack for --merge, needs --output\n"
+"                                'tree'     call tree of all the stacks, top-down\n"
+"                                           from the outermost functions\n"
+"                                'callers'  call tree, bottom-up from the innermost\n"
+"                                           functions to their callers\n"
+"      --tree-depth=LEVELS      print the call trees LEVELS deep (default: %u)\n"
+"      --tree-min=PERCENT       print the call tree nodes with at least PERCENT of\n"
+"                               the total latency (default: %g)\n"
+"  -I, --interactive            full-screen view instead of the reports\n"
+"  -D, --daemon[=SOCKET]        run one probe for the clients connecting to SOCKET\n"
+"                               (default: " DEFAULT_SOCKET "), -i is the resolution\n"
+"                               of the clients' intervals (default: 1)\n"
+"  -A, --connect[=SOCKET]       show reports from a running daemon, with own sort,\n"
+"                               format, interval and pid/comm filters\n"
+"  -P, --metrics=ADDR           serve OpenMetrics over HTTP at [IPV4:]PORT (loopback\n"
+"                               by default) or at a UNIX socket path\n"
+"  -L, --metrics-limit=SERIES   at most SERIES comm and stack series in the metrics,\n"
+"                               the rest is added to one overflow series (default: %u)\n"
+"  -S, --shm[=NAME]             publish every interval in shared memory NAME\n"
+"                               (default: " LATTOP_SHM_DEFAULT_NAME "), see lattop_shm.h\n"
+"  -w, --record=FILE            append every interval to the recording FILE\n"
+"  -Y, --report=FILE            show the intervals recorded in FILE instead of probing\n"
+"      --from=TIME, --to=TIME   only the intervals that ended in this range, TIME is\n"
+"                               YYYY-MM-DD [HH:MM[:SS]], HH:MM[:SS] (the last one)\n"
+"                               or @SECONDS since the epoch\n"
+"  -j, --merge                  add up the SNAPSHOT files, e.g. of several hosts or\n"
+"                               runs, into one report or snapshot\n"
+"  -b, --diff=BASELINE          compare every report to the BASELINE snapshot and rank\n"
+"                               the stacks by the change of the sort key (text, json)\n"
+"      --input=FILE             read the probe's output from FILE instead of running\n"
+"                               it, e.g. from lattop-gen, and end the last interval\n"
+"                               at its end\n"
+"      --kallsyms=FILE          load the symbols from FILE, not /proc/kallsyms\n"
+"  -o, --output=FILE            append the reports to FILE instead of stdout\n"
+"                               (pprof and snapshot replace FILE with every interval)\n"
 "  -m, --min-latency=MIN        ignore latencies shorter than MIN microseconds\n"
 "  -M, --max-interruptible=MAX  ignore latencies from interruptible sleeps longer\n"
 "                               than MAX microseconds (default: 5000)\n"
-"  -p, --pid-filter=PID         show only the process with the given PID\n");
+"  -p, --pid-filter=PID[,PID..] show only the processes with the given PIDs\n"
+"  -t, --pid-tree=PID[,PID..]   show only the given processes and their descendants\n"
+"  -C, --comm=PREFIX            show only tasks whose name starts with PREFIX\n"
+"  -g, --cgroup=PATH            show only tasks in the given cgroup (v2)\n"
+"The task filters can be repeated, a task is shown if it matches any of them.\n"
+"  -B, --cpu-budget=PERCENT     sample events when lattop uses more CPU than this\n"
+"  -R, --max-rate=EVENTS        sample events when there are more per second\n"
+"  -T, --tid-rate=EVENTS        let at most EVENTS per second of every thread through\n"
+"      --stack-depth=FRAMES     record up to FRAMES frames of every stack\n"
+"                               (default: %u, at most %u)\n"
+"      --by-function            key the stacks by the functions instead of the return\n"
+"                               addresses, merging the call sites within a function\n"
+"      --drop=PATTERN           leave out the frames of the functions matching the\n"
+"                               glob PATTERN, e.g. --drop='*schedule*'\n"
+"      --collapse=PATTERN       keep only the outermost of consecutive frames matching\n"
+"                               PATTERN, e.g. --collapse='ext4_*'\n"
+"The frame rules can be repeated, the first matching one applies. With --drop,\n"
+"the probe records twice the stack depth to make up for the dropped frames.\n"
+"\n"
+"The filters can be changed while running by commands on stdin, or in the\n"
+"interactive mode at the prompt of the ':' key:\n"
+"  min-latency USEC, max-interruptible USEC,\n"
+"  pid-filter PID, pid-tree PID, comm-filter PREFIX, cgroup-filter PATH,\n"
+"  no-filter (removes all task filters)\n"
+"In the interactive mode, the keys m/t/p/c/s/b change the sort order, r reverses\n"
+"it, Enter shows the selected process's stacks and a stack's frames, Esc goes\n"
+"back and q quits.\n"
+"SIGUSR1 doubles the minimal latency to shed load, SIGUSR2 restores it.\n",
+	DEFAULT_TREE_DEPTH, DEFAULT_TREE_MIN, DEFAULT_METRICS_LIMIT, DEFAULT_BT_LEN, MAX_BT_LEN);
 	exit(code);
 }
 
+/* long options without a short one */
+enum {
+	ARG_FROM = 0x100,
+	ARG_TO,
+	ARG_STACK_DEPTH,
+	ARG_BY_FUNCTION,
+	ARG_DROP,
+	ARG_COLLAPSE,
+	ARG_TREE_DEPTH,
+	ARG_TREE_MIN,
+	ARG_INPUT,
+	ARG_KALLSYMS,
+};
+
 static void parse_argv(int argc, char *argv[])
 {
-	char *endptr;
-	int c, i, option_index = 0;
+	char *endptr, *tok;
+	unsigned long value;
+	double seconds;
+	int c, i, r, option_index = 0;
 
 	static const struct option long_options[] = {
 		{ "interval",          required_argument, 0, 'i' },
 		{ "count",             required_argument, 0, 'c' },
 		{ "sort",              required_argument, 0, 's' },
 		{ "reverse",           no_argument,       0, 'r' },
+		{ "format",            required_argument, 0, 'f' },
+		{ "interactive",       no_argument,       0, 'I' },
+		{ "daemon",            optional_argument, 0, 'D' },
+		{ "connect",           optional_argument, 0, 'A' },
+		{ "metrics",           required_argument, 0, 'P' },
+		{ "metrics-limit",     required_argument, 0, 'L' },
+		{ "shm",               optional_argument, 0, 'S' },
+		{ "record",            required_argument, 0, 'w' },
+		{ "report",            required_argument, 0, 'Y' },
+		{ "from",              required_argument, 0, ARG_FROM },
+		{ "to",                required_argument, 0, ARG_TO },
+		{ "merge",             no_argument,       0, 'j' },
+		{ "diff",              required_argument, 0, 'b' },
+		{ "output",            required_argument, 0, 'o' },
 		{ "min-latency",       required_argument, 0, 'm' },
 		{ "max-interruptible", required_argument, 0, 'M' },
 		{ "pid-filter",        required_argument, 0, 'p' },
+		{ "pid-tree",          required_argument, 0, 't' },
+		{ "comm",              required_argument, 0, 'C' },
+		{ "cgroup",            required_argument, 0, 'g' },
+		{ "cpu-budget",        required_argument, 0, 'B' },
+		{ "max-rate",          required_argument, 0, 'R' },
+		{ "tid-rate",          required_argument, 0, 'T' },
+		{ "stack-depth",       required_argument, 0, ARG_STACK_DEPTH },
+		{ "by-function",       no_argument,       0, ARG_BY_FUNCTION },
+		{ "drop",              required_argument, 0, ARG_DROP },
+		{ "collapse",          required_argument, 0, ARG_COLLAPSE },
+		{ "tree-depth",        required_argument, 0, ARG_TREE_DEPTH },
+		{ "tree-min",          required_argument, 0, ARG_TREE_MIN },
+		{ "input",             required_argument, 0, ARG_INPUT },
+		{ "kallsyms",          required_argument, 0, ARG_KALLSYMS },
 		{ "help",              no_argument,       0, 'h' },
 		{ 0,                   0,                 0,  0  }
 	};
 
-	static const char *sort_types[_NR_SORT_BY] = {
-		[SORT_BY_MAX_LATENCY]   = "max",
-		[SORT_BY_TOTAL_LATENCY] = "total",
-		[SORT_BY_PID]           = "pid",
-	};
-
 	for (;;) {
-		c = getopt_long(argc, argv, "i:c:s:rm:M:p:h", long_options, &option_index);
+		c = getopt_long(argc, argv, "i:c:s:rf:ID::A::P:L:S::w:Y:jb:o:m:M:p:t:C:g:B:R:T:h", long_options, &option_index);
 		if (c == -1)
 			break;
 
 		switch (c) {
 		case 'i':
-			arg_interval = atoi(optarg);
-			if (arg_interval <= 0) {
-				fprintf(stderr, "Interval must be a positive number.\n");
+			/* in milliseconds, up to 30 days */
+			seconds = strtod(optarg, &endptr);
+			if (endptr == optarg || *endptr || !(seconds >= 0.001 && seconds <= 2592000)) {
+				fprintf(stderr, "Interval must be from 0.001 to 2592000 seconds.\n");
 				exit(1);
 			}
+			arg_interval_ms = seconds * MSEC_PER_SEC + 0.5;
+			interval_given = true;
 			break;
 		case 'c':
 			arg_count = atoi(optarg);
-			if (arg_interval < 0) {
+			if (arg_count < 0) {
 				fprintf(stderr, "Count must be positive (or zero for infinite).\n");
 				exit(1);
 			}
@@ -226,18 +612,61 @@ static void parse_argv(int argc, char *argv[])
 			arg_reverse = true;
 			break;
 		case 's':
-			for (i = 0; i < _NR_SORT_BY; i++) {
-				if (!strcasecmp(optarg, sort_types[i]))
-					break;
+			i = lattop_parse_sort(optarg);
+			if (i < 0) {
+				fprintf(stderr, "Unknown sort type '%s'. Must be one of: max, total, pid, count, sleep, block\n", optarg);
+				exit(1);
 			}
 
-			if (i == _NR_SORT_BY) {
-				fprintf(stderr, "Unknown sort type '%s'. Must be one of: max, total, pid\n", optarg);
+			arg_sort = i;
+
+			break;
+		case 'f':
+			i = lattop_parse_format(optarg);
+			if (i < 0) {
+				fprintf(stderr, "Unknown format '%s'. Must be one of: text, json, csv, folded, pprof, snapshot, tree, callers\n", optarg);
 				exit(1);
 			}
 
-			arg_sort = i;
+			arg_format = i;
 
+			break;
+		case 'I':
+			arg_interactive = true;
+			break;
+		case 'D':
+			arg_daemon = optarg ?: DEFAULT_SOCKET;
+			break;
+		case 'A':
+			arg_connect = optarg ?: DEFAULT_SOCKET;
+			break;
+		case 'P':
+			arg_metrics = optarg;
+			break;
+		case 'S':
+			arg_shm = optarg ?: LATTOP_SHM_DEFAULT_NAME;
+			break;
+		case 'w':
+			arg_record = optarg;
+			break;
+		case 'Y':
+			arg_report = optarg;
+			break;
+		case 'j':
+			arg_merge = true;
+			break;
+		case 'b':
+			arg_diff = optarg;
+			break;
+		case ARG_FROM:
+		case ARG_TO:
+			if (parse_timestamp(optarg, c == ARG_FROM ? &report_from : &report_to) < 0) {
+				fprintf(stderr, "Invalid time '%s'\n", optarg);
+				exit(1);
+			}
+			break;
+		case 'o':
+			arg_output = optarg;
 			break;
 		case 'm':
 			errno = 0;
@@ -258,13 +687,87 @@ static void parse_argv(int argc, char *argv[])
 			arg_max_interruptible_delay *= NSEC_PER_USEC;
 			break;
 		case 'p':
+		case 't':
+			for (tok = strtok(optarg, ","); tok; tok = strtok(NULL, ",")) {
+				if (filter_add(c == 'p' ? FILTER_PID : FILTER_PID_TREE, tok) < 0) {
+					fprintf(stderr, "Invalid PID specification '%s'\n", tok);
+					exit(1);
+				}
+			}
+			break;
+		case 'C':
+			if (filter_add(FILTER_COMM, optarg) < 0) {
+				fprintf(stderr, "Invalid process name prefix '%s'\n", optarg);
+				exit(1);
+			}
+			break;
+		case 'g':
+			r = filter_add(FILTER_CGROUP, optarg);
+			if (r < 0) {
+				fprintf(stderr, "Invalid cgroup '%s': %s\n", optarg, strerror(-r));
+				exit(1);
+			}
+			break;
+		case 'B':
+		case 'R':
+		case 'T':
+		case 'L':
 			errno = 0;
-			arg_pid_filter = strtoul(optarg, &endptr, 10);
-			if (errno || endptr == optarg || *endptr != '\0') {
-				fprintf(stderr, "Invalid PID specification '%s'\n", optarg);
+			value = strtoul(optarg, &endptr, 10);
+			if (errno || endptr == optarg || *endptr != '\0' || value > UINT_MAX) {
+				fprintf(stderr, "Invalid number '%s'\n", optarg);
+				exit(1);
+			}
+			*(c == 'B' ? &arg_cpu_budget : c == 'R' ? &arg_max_rate :
+			  c == 'T' ? &arg_tid_rate : &arg_metrics_limit) = value;
+			break;
+		case ARG_STACK_DEPTH:
+			errno = 0;
+			value = strtoul(optarg, &endptr, 10);
+			if (errno || endptr == optarg || *endptr != '\0' ||
+			    value < 1 || value > MAX_BT_LEN) {
+				fprintf(stderr, "Invalid stack depth '%s', it must be 1 to %u\n",
+				        optarg, MAX_BT_LEN);
+				exit(1);
+			}
+			arg_stack_depth = value;
+			break;
+		case ARG_BY_FUNCTION:
+			arg_by_function = true;
+			break;
+		case ARG_TREE_DEPTH:
+			errno = 0;
+			value = strtoul(optarg, &endptr, 10);
+			if (errno || endptr == optarg || *endptr != '\0' || value < 1 || value > MAX_BT_LEN) {
+				fprintf(stderr, "Invalid tree depth '%s', it must be 1 to %u\n",
+				        optarg, MAX_BT_LEN);
+				exit(1);
+			}
+			arg_tree_depth = value;
+			break;
+		case ARG_TREE_MIN:
+			errno = 0;
+			arg_tree_min = strtod(optarg, &endptr);
+			if (errno || endptr == optarg || *endptr != '\0' ||
+			    !(arg_tree_min >= 0 && arg_tree_min <= 100)) {
+				fprintf(stderr, "Invalid percentage '%s'\n", optarg);
+				exit(1);
+			}
+			break;
+		case ARG_DROP:
+		case ARG_COLLAPSE:
+			r = stack_rewrite_add_rule(c == ARG_DROP ? FOLD_DROP : FOLD_COLLAPSE, optarg);
+			if (r < 0) {
+				fprintf(stderr, "Invalid frame rule '%s': %s\n", optarg, strerror(-r));
 				exit(1);
 			}
 			break;
+		case ARG_INPUT:
+			arg_input = optarg;
+			break;
+		case ARG_KALLSYMS:
+			arg_kallsyms = optarg;
+			break;
 		case 'h':
 			usage_and_exit(0);
 		case '?':
@@ -273,8 +776,69 @@ static void parse_argv(int argc, char *argv[])
 		}
 	}
 
-	if (optind < argc)
+	if (arg_merge != (optind < argc))
 		usage_and_exit(1);
+
+	if ((arg_format == FORMAT_PPROF || arg_format == FORMAT_SNAPSHOT) && !arg_output) {
+		fprintf(stderr, "The %s format needs --output.\n", lattop_format_name(arg_format));
+		exit(1);
+	}
+
+	if (arg_interactive && (arg_format != FORMAT_TEXT || arg_output)) {
+		fprintf(stderr, "The interactive mode does not write reports, --format and --output make no sense with it.\n");
+		exit(1);
+	}
+
+	if (arg_daemon && (arg_interactive || arg_connect || arg_output)) {
+		fprintf(stderr, "The daemon serves its reports to the clients only.\n");
+		exit(1);
+	}
+	if (arg_connect && (arg_interactive || arg_format == FORMAT_PPROF || arg_format == FORMAT_SNAPSHOT)) {
+		fprintf(stderr, "--connect works with the text, json, csv, folded, tree and callers formats.\n");
+		exit(1);
+	}
+	if (arg_connect && (arg_metrics || arg_shm || arg_record)) {
+		fprintf(stderr, "The metrics, the snapshot and the recording are written by the daemon, not by --connect.\n");
+		exit(1);
+	}
+	if (arg_report && (arg_interactive || arg_daemon || arg_connect || arg_metrics ||
+	                   arg_shm || arg_record)) {
+		fprintf(stderr, "--report only prints the reports of a recording.\n");
+		exit(1);
+	}
+	if (arg_report && (filter_has_type(FILTER_PID_TREE) || filter_has_type(FILTER_CGROUP))) {
+		fprintf(stderr, "The pid tree and cgroup filters cannot be applied to a recording.\n");
+		exit(1);
+	}
+	if (arg_merge && (arg_interactive || arg_daemon || arg_connect || arg_metrics ||
+	                  arg_shm || arg_record || arg_report)) {
+		fprintf(stderr, "--merge only adds up snapshot files.\n");
+		exit(1);
+	}
+	if (arg_merge && (filter_has_type(FILTER_PID) || filter_has_type(FILTER_PID_TREE) ||
+	                  filter_has_type(FILTER_CGROUP))) {
+		fprintf(stderr, "Snapshots have no pids, only the comm filter applies to --merge.\n");
+		exit(1);
+	}
+	if (arg_diff && (arg_interactive || arg_daemon || arg_connect ||
+	                 (arg_format != FORMAT_TEXT && arg_format != FORMAT_JSON))) {
+		fprintf(stderr, "--diff works with the text and json reports.\n");
+		exit(1);
+	}
+	if (arg_input && (arg_connect || arg_report || arg_merge)) {
+		fprintf(stderr, "--input replaces the probe, it makes no sense without one.\n");
+		exit(1);
+	}
+	if (arg_input && (filter_active() || arg_min_delay || arg_cpu_budget || arg_max_rate ||
+	                  arg_tid_rate)) {
+		fprintf(stderr, "The filters and the sampling are applied by the probe, not to --input.\n");
+		exit(1);
+	}
+	if (arg_daemon && !interval_given)
+		arg_interval_ms = MSEC_PER_SEC;
+
+	initial_min_delay = arg_min_delay;
+	initial_max_interruptible_delay = arg_max_interruptible_delay;
 }
 
 int main(int argc, char *argv[])
@@ -283,6 +847,15 @@ int main(int argc, char *argv[])
 
 	parse_argv(argc, argv);
 
+	if (arg_connect)
+		return client_run(arg_connect) < 0;
+	if (arg_diff && diff_init(arg_diff) < 0)
+		return 1;
+	if (arg_report)
+		return recording_report(arg_report, report_from, report_to) < 0;
+	if (arg_merge)
+		return snapshot_merge(argv + optind, argc - optind) < 0;
+
 	if (init())
 		return 1;
 
@@ -1,25 +1,81 @@
 #ifndef _LATTOP_H
 #define _LATTOP_H
 
+#include <sys/types.h>
 #include <stdbool.h>
 
 #include "polled_reader.h"
 
 void lattop_reader_started(struct polled_reader *r);
+/* The reader's fd will not be polled anymore */
+void lattop_reader_stopped(struct polled_reader *r);
+/* Starts polling a reader, e.g. a daemon client */
+int  lattop_add_reader(struct polled_reader *r);
+/* The reader will be finalized and freed after the current poll round */
+void lattop_remove_reader(struct polled_reader *r);
+/* Also calls handle_writable when the fd is writable */
+void lattop_reader_want_write(struct polled_reader *r, bool want);
+
+/* Push changed arg_* delay limits or task filters to the probe */
+void lattop_delays_changed(void);
+void lattop_filters_changed(void);
+void lattop_sampling_changed(void);
+void lattop_shed_load(void);
+void lattop_restore_filters(void);
 
 enum sort_by {
 	SORT_BY_MAX_LATENCY,
 	SORT_BY_TOTAL_LATENCY,
 	SORT_BY_PID,
+	SORT_BY_COUNT,
+	SORT_BY_SLEEP,
+	SORT_BY_BLOCK,
 	_NR_SORT_BY
 };
 
-extern int arg_interval;
+enum output_format {
+	FORMAT_TEXT,
+	FORMAT_JSON,
+	FORMAT_CSV,
+	FORMAT_FOLDED,
+	FORMAT_PPROF,
+	FORMAT_SNAPSHOT,
+	FORMAT_TREE,
+	FORMAT_CALLERS,
+	_NR_FORMATS
+};
+
+int lattop_parse_sort(const char *name);
+const char *lattop_sort_name(enum sort_by sort);
+int lattop_parse_format(const char *name);
+const char *lattop_format_name(enum output_format format);
+
+extern unsigned arg_interval_ms;
 extern int arg_count;
 extern enum sort_by arg_sort;
 extern bool arg_reverse;
+extern enum output_format arg_format;
+extern const char *arg_output;
 extern unsigned long long arg_min_delay;
 extern unsigned long long arg_max_interruptible_delay;
-extern pid_t arg_pid_filter;
+extern unsigned arg_cpu_budget;
+extern unsigned arg_max_rate;
+extern unsigned arg_tid_rate;
+extern unsigned arg_stack_depth;
+extern bool arg_by_function;
+/* The cutoffs of the tree and callers formats */
+#define DEFAULT_TREE_DEPTH 16
+#define DEFAULT_TREE_MIN 1.0
+extern unsigned arg_tree_depth;
+extern double arg_tree_min;
+extern bool arg_interactive;
+extern const char *arg_daemon;
+extern const char *arg_connect;
+extern const char *arg_metrics;
+extern unsigned arg_metrics_limit;
+extern const char *arg_shm;
+extern const char *arg_record;
+extern const char *arg_diff;
+extern const char *arg_kallsyms;
 
 #endif
@@ -0,0 +1,124 @@
+/*
+ * The reader side of lattop_shm.h.
+ *
+ * Copyright 2026 agent
+ * Author: agent <agent@local>
+ * License: GPLv2
+ */
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "lattop_shm.h"
+
+static int remap(struct lattop_shm *r)
+{
+	struct stat st;
+	void *map;
+
+	if (fstat(r->fd, &st) < 0)
+		return -errno;
+	if (st.st_size < sizeof(struct lattop_shm_header))
+		return -EAGAIN;
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, r->fd, 0);
+	if (map == MAP_FAILED)
+		return -errno;
+
+	if (r->map)
+		munmap(r->map, r->len);
+	r->map = map;
+	r->len = st.st_size;
+	return 0;
+}
+
+int lattop_shm_open(struct lattop_shm *r, const char *name)
+{
+	int ret;
+
+	r->map = NULL;
+	r->len = 0;
+	r->fd = shm_open(name, O_RDONLY|O_CLOEXEC, 0);
+	if (r->fd < 0)
+		return -errno;
+
+	ret = remap(r);
+	if (ret < 0)
+		lattop_shm_close(r);
+	return ret;
+}
+
+void lattop_shm_close(struct lattop_shm *r)
+{
+	if (r->map)
+		munmap(r->map, r->len);
+	if (r->fd >= 0)
+		close(r->fd);
+	r->map = NULL;
+	r->fd = -1;
+}
+
+/* The number of elements of an array that lie within the mapping */
+static uint32_t clamp(const struct lattop_shm *r, uint64_t off, uint32_t n, size_t size)
+{
+	if (off > r->len)
+		return 0;
+	if (n > (r->len - off) / size)
+		n = (r->len - off) / size;
+	return n;
+}
+
+int lattop_shm_begin(struct lattop_shm *r, struct lattop_shm_view *v)
+{
+	const struct lattop_shm_header *hdr;
+	int ret;
+
+	for (;;) {
+		hdr = r->map;
+		if (__atomic_load_n(&hdr->magic, __ATOMIC_RELAXED) != LATTOP_SHM_MAGIC)
+			return -ESTALE;
+
+		v->seq = __atomic_load_n(&hdr->seq, __ATOMIC_ACQUIRE);
+		if (v->seq & 1) {
+			sched_yield();
+			continue;
+		}
+		if (hdr->size <= r->len)
+			break;
+
+		/* lattop has grown the region */
+		ret = remap(r);
+		if (ret < 0)
+			return ret;
+	}
+
+	v->hdr = hdr;
+	v->nr_threads = clamp(r, hdr->threads_off, hdr->nr_threads, sizeof(*v->threads));
+	v->nr_accounts = clamp(r, hdr->accounts_off, hdr->nr_accounts, sizeof(*v->accounts));
+	v->nr_stacks = clamp(r, hdr->stacks_off, hdr->nr_stacks, sizeof(*v->stacks));
+	v->nr_frames = clamp(r, hdr->frames_off, hdr->nr_frames, sizeof(*v->frames));
+	v->strings_len = clamp(r, hdr->strings_off, hdr->strings_len, 1);
+	v->threads = (const void*) ((const char*) r->map + (v->nr_threads ? hdr->threads_off : 0));
+	v->accounts = (const void*) ((const char*) r->map + (v->nr_accounts ? hdr->accounts_off : 0));
+	v->stacks = (const void*) ((const char*) r->map + (v->nr_stacks ? hdr->stacks_off : 0));
+	v->frames = (const void*) ((const char*) r->map + (v->nr_frames ? hdr->frames_off : 0));
+	v->strings = (const char*) r->map + (v->strings_len ? hdr->strings_off : 0);
+	return 0;
+}
+
+bool lattop_shm_retry(const struct lattop_shm_view *v)
+{
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	return __atomic_load_n(&v->hdr->seq, __ATOMIC_RELAXED) != v->seq;
+}
+
+const char *lattop_shm_string(const struct lattop_shm_view *v, uint32_t off)
+{
+	if (off >= v->strings_len || !memchr(v->strings + off, '\0', v->strings_len - off))
+		return "";
+	return v->strings + off;
+}
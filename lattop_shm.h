@@ -0,0 +1,120 @@
+/*
+ * The live snapshot lattop publishes with --shm, and a small library to
+ * read it. This header is meant to be copied into the consumers, it
+ * depends on nothing else from lattop.
+ *
+ * The region starts with a header followed by flat arrays: threads,
+ * accounts (a thread's latencies in one stack), stacks, frames and a
+ * string table. Everything refers to the other arrays by index and to
+ * the strings by offset, offset 0 being the empty string.
+ *
+ * The header's seq is a seqlock: odd while lattop rewrites the region.
+ * A reader gets pointers into the mapping with lattop_shm_begin(), reads
+ * what it needs and then checks lattop_shm_retry(). If that says the
+ * snapshot changed meanwhile, everything read must be thrown away.
+ *
+ * Copyright 2026 agent
+ * Author: agent <agent@local>
+ * License: GPLv2
+ */
+#ifndef _LATTOP_SHM_H
+#define _LATTOP_SHM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define LATTOP_SHM_DEFAULT_NAME "/lattop"
+#define LATTOP_SHM_MAGIC 0x4d53544cU	/* "LTSM", zeroed when lattop exits */
+#define LATTOP_SHM_VERSION 1
+
+struct lattop_shm_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t seq;			/* odd while being written */
+	uint32_t sample_factor;		/* the events were sampled 1:sample_factor */
+	uint64_t size;			/* of the region, it only grows */
+	uint64_t interval_seq;		/* number of the interval, from 0 */
+	int64_t  interval_end;		/* seconds since the epoch */
+	uint32_t interval_ms;
+	uint32_t nr_threads;
+	uint32_t nr_accounts;
+	uint32_t nr_stacks;
+	uint32_t nr_frames;
+	uint32_t strings_len;
+	/* byte offsets of the arrays from the start of the region */
+	uint64_t threads_off;
+	uint64_t accounts_off;
+	uint64_t stacks_off;
+	uint64_t frames_off;
+	uint64_t strings_off;
+};
+
+struct lattop_shm_thread {
+	int32_t pid;
+	int32_t tid;
+	uint32_t comm;			/* string */
+	uint32_t first_account;		/* the thread's accounts are consecutive */
+	uint32_t nr_accounts;
+	uint32_t count;
+	uint64_t total;			/* ns, sums over the accounts */
+	uint64_t max;
+};
+
+struct lattop_shm_account {
+	uint32_t thread;
+	uint32_t stack;
+	uint32_t count;
+	uint32_t pad;
+	uint64_t total;			/* ns */
+	uint64_t max;
+};
+
+struct lattop_shm_stack {
+	uint32_t stack_id;		/* stable for the life of lattop */
+	uint32_t translation;		/* string, empty without one */
+	uint32_t first_frame;
+	uint32_t nr_frames;		/* innermost first */
+};
+
+struct lattop_shm_frame {
+	uint64_t ip;
+	uint32_t symbol;		/* string */
+	uint32_t pad;
+};
+
+/* A reader's mapping of the region */
+struct lattop_shm {
+	int fd;
+	void *map;
+	size_t len;
+};
+
+/* Pointers into the mapping, valid until lattop_shm_retry() */
+struct lattop_shm_view {
+	const struct lattop_shm_header *hdr;
+	uint32_t seq;
+	uint32_t nr_threads, nr_accounts, nr_stacks, nr_frames, strings_len;
+	const struct lattop_shm_thread *threads;
+	const struct lattop_shm_account *accounts;
+	const struct lattop_shm_stack *stacks;
+	const struct lattop_shm_frame *frames;
+	const char *strings;
+};
+
+/* Maps the region published under name, returns 0 or -errno */
+int  lattop_shm_open(struct lattop_shm *r, const char *name);
+void lattop_shm_close(struct lattop_shm *r);
+
+/*
+ * Waits for a complete snapshot and fills v. Returns 0, or -ESTALE when
+ * lattop has exited and the region must be reopened. The counts in v are
+ * clamped to the mapping, so even a torn read does not fault.
+ */
+int  lattop_shm_begin(struct lattop_shm *r, struct lattop_shm_view *v);
+/* True if the snapshot changed since lattop_shm_begin() */
+bool lattop_shm_retry(const struct lattop_shm_view *v);
+/* The string at off, "" for a bad offset */
+const char *lattop_shm_string(const struct lattop_shm_view *v, uint32_t off);
+
+#endif
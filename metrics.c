@@ -0,0 +1,638 @@
+/*
+ * An OpenMetrics endpoint. The latencies are kept as cumulative series
+ * per comm and stack id, at most arg_metrics_limit of them, the rest is
+ * added to one overflow series. The whole HTTP response is rendered once
+ * per interval; a scrape only sends the cached page.
+ *
+ * Copyright 2026 agent
+ * Author: agent <agent@local>
+ * License: GPLv2
+ */
+
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "metrics.h"
+
+#include "back_trace.h"
+#include "daemon.h"
+#include "fnv1a.h"
+#include "lattop.h"
+#include "outbuf.h"
+#include "process.h"
+#include "process_accountant.h"
+#include "stack_table.h"
+#include "sym_translator.h"
+#include "timespan.h"
+
+/* connections that have not sent a request by then are closed */
+#define HTTP_TIMEOUT 10
+
+#define OVERFLOW_ID (-2)
+
+struct series {
+	char comm[16];
+	int stack_id;		/* -1 in an empty slot */
+	char *translation;
+	uint64_t total;		/* cumulative */
+	uint64_t count;
+	uint64_t hist[LA_HIST_BUCKETS];
+	struct latency_account interval;	/* the last interval only */
+};
+
+/* a rendered response, shared by the connections sending it */
+struct page {
+	unsigned refs;
+	size_t len;
+	char data[];
+};
+
+struct http_conn {
+	/* must be first */
+	struct polled_reader pr;
+
+	int fd;
+	time_t since;
+	bool gone;
+	char req[1024];
+	unsigned req_len;
+
+	struct page *page;	/* or NULL for a static response */
+	const char *out;
+	size_t out_len, out_pos;
+};
+
+struct metrics_listener {
+	/* must be first */
+	struct polled_reader pr;
+
+	int fd;
+	const char *addr;
+	const char *unix_path;
+};
+
+static struct series *slots;
+static unsigned nr_slots, nr_series;
+static struct series overflow = { .stack_id = OVERFLOW_ID, .translation = "" };
+static struct page *cur_page;
+static struct outbuf body;
+
+static struct http_conn *conns[MAX_HTTP_CONNS];
+static unsigned nr_conns;
+
+static const char not_found[] =
+	"HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+static const char bad_request[] =
+	"HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+static const char not_allowed[] =
+	"HTTP/1.1 405 Method Not Allowed\r\nAllow: GET\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+static const char unavailable[] =
+	"HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+
+static void page_put(struct page *p)
+{
+	if (p && --p->refs == 0)
+		free(p);
+}
+
+static unsigned series_hash(const char comm[16], int stack_id)
+{
+	return (fnv1a_bytes(comm, strnlen(comm, 16)) ^ stack_id) * 2654435761U;
+}
+
+static int grow_slots(void)
+{
+	struct series *old = slots;
+	unsigned old_nr = nr_slots, i, j;
+
+	nr_slots = old_nr ? old_nr * 2 : 256;
+	slots = calloc(nr_slots, sizeof(struct series));
+	if (!slots) {
+		slots = old;
+		nr_slots = old_nr;
+		return -ENOMEM;
+	}
+	for (i = 0; i < nr_slots; i++)
+		slots[i].stack_id = -1;
+
+	for (i = 0; i < old_nr; i++) {
+		if (old[i].stack_id < 0)
+			continue;
+		j = series_hash(old[i].comm, old[i].stack_id) & (nr_slots - 1);
+		while (slots[j].stack_id >= 0)
+			j = (j + 1) & (nr_slots - 1);
+		slots[j] = old[i];
+	}
+
+	free(old);
+	return 0;
+}
+
+static char *make_translation(const struct back_trace *bt)
+{
+	const char *t = bt_translate(bt);
+
+	/* without a translation, the innermost function */
+	if (!t)
+		t = sym_translator_lookup(bt->trace[0]);
+	return strdup(t ?: "");
+}
+
+/* The slot of the series, or the empty slot where it belongs */
+static struct series *find_slot(const char comm[16], int stack_id)
+{
+	unsigned i = series_hash(comm, stack_id) & (nr_slots - 1);
+
+	while (slots[i].stack_id >= 0 &&
+	       (slots[i].stack_id != stack_id || strncmp(slots[i].comm, comm, 16)))
+		i = (i + 1) & (nr_slots - 1);
+	return &slots[i];
+}
+
+static struct series *get_series(const char comm[16], int id)
+{
+	struct back_trace bt;
+	struct series *s;
+
+	if (nr_slots) {
+		s = find_slot(comm, id);
+		if (s->stack_id >= 0)
+			return s;
+	}
+
+	if (nr_series >= arg_metrics_limit)
+		return &overflow;
+	if (2 * (nr_series + 1) > nr_slots && grow_slots() < 0)
+		return &overflow;
+
+	s = find_slot(comm, id);
+	memcpy(s->comm, comm, 16);
+	s->stack_id = id;
+	stack_table_get(id, &bt);
+	s->translation = make_translation(&bt);
+	nr_series++;
+	return s;
+}
+
+static void fold_process(struct process *p, void *userdata)
+{
+	struct rb_node *node;
+	struct series *s;
+	unsigned i;
+
+	for (node = rb_first(&p->bt2la_map); node; node = rb_next(node)) {
+		struct bt2la *b = rb_entry(node, struct bt2la, rb_node);
+
+		s = get_series(p->comm, b->stack_id);
+		s->total += b->la.total;
+		s->count += b->la.count;
+		for (i = 0; i < LA_HIST_BUCKETS; i++)
+			s->hist[i] += b->la.hist[i];
+		la_merge(&s->interval, &b->la);
+	}
+}
+
+static void put_seconds(struct outbuf *ob, uint64_t ns)
+{
+	char frac[10];
+	int i;
+
+	ob_put_u64(ob, ns / NSEC_PER_SEC);
+	ns %= NSEC_PER_SEC;
+	if (!ns)
+		return;
+
+	snprintf(frac, sizeof(frac), "%09llu", (unsigned long long) ns);
+	for (i = 8; frac[i] == '0'; i--)
+		frac[i] = '\0';
+	ob_putc(ob, '.');
+	ob_puts(ob, frac);
+}
+
+static void put_label(struct outbuf *ob, const char *name, const char *value)
+{
+	ob_puts(ob, name);
+	ob_puts(ob, "=\"");
+	for (; *value; value++) {
+		if (*value == '\\' || *value == '"')
+			ob_putc(ob, '\\');
+		if (*value == '\n')
+			ob_puts(ob, "\\n");
+		else
+			ob_putc(ob, *value);
+	}
+	ob_putc(ob, '"');
+}
+
+static void put_labels(struct outbuf *ob, const struct series *s)
+{
+	char id[16];
+
+	if (s->stack_id == OVERFLOW_ID)
+		strcpy(id, "overflow");
+	else
+		snprintf(id, sizeof(id), "%d", s->stack_id);
+
+	put_label(ob, "comm", s->comm);
+	ob_putc(ob, ',');
+	put_label(ob, "stack_id", id);
+	ob_putc(ob, ',');
+	put_label(ob, "translation", s->translation);
+}
+
+/* upper bound of bucket i in ns */
+static void render_histogram(struct outbuf *ob, const struct series *s)
+{
+	uint64_t cumulative = 0;
+	unsigned i;
+
+	for (i = 0; i < LA_HIST_BUCKETS - 1; i++) {
+		cumulative += s->hist[i];
+		ob_puts(ob, "lattop_latency_seconds_bucket{");
+		put_labels(ob, s);
+		ob_puts(ob, ",le=\"");
+		put_seconds(ob, la_bucket_bound(i));
+		ob_puts(ob, "\"} ");
+		ob_put_u64(ob, cumulative);
+		ob_putc(ob, '\n');
+	}
+
+	ob_puts(ob, "lattop_latency_seconds_bucket{");
+	put_labels(ob, s);
+	ob_puts(ob, ",le=\"+Inf\"} ");
+	ob_put_u64(ob, s->count);
+	ob_puts(ob, "\nlattop_latency_seconds_count{");
+	put_labels(ob, s);
+	ob_puts(ob, "} ");
+	ob_put_u64(ob, s->count);
+	ob_puts(ob, "\nlattop_latency_seconds_sum{");
+	put_labels(ob, s);
+	ob_puts(ob, "} ");
+	put_seconds(ob, s->total);
+	ob_putc(ob, '\n');
+}
+
+static void render_summary(struct outbuf *ob, const struct series *s)
+{
+	static const struct {
+		const char *label;
+		unsigned permille;
+	} quantiles[] = {
+		{ "0.5", 500 }, { "0.9", 900 }, { "0.99", 990 }, { "1", 1000 },
+	};
+	unsigned i;
+
+	for (i = 0; s->interval.count && i < sizeof(quantiles)/sizeof(quantiles[0]); i++) {
+		ob_puts(ob, "lattop_interval_latency_seconds{");
+		put_labels(ob, s);
+		ob_puts(ob, ",quantile=\"");
+		ob_puts(ob, quantiles[i].label);
+		ob_puts(ob, "\"} ");
+		put_seconds(ob, la_quantile(&s->interval, quantiles[i].permille));
+		ob_putc(ob, '\n');
+	}
+
+	ob_puts(ob, "lattop_interval_latency_seconds_count{");
+	put_labels(ob, s);
+	ob_puts(ob, "} ");
+	ob_put_u64(ob, s->count);
+	ob_puts(ob, "\nlattop_interval_latency_seconds_sum{");
+	put_labels(ob, s);
+	ob_puts(ob, "} ");
+	put_seconds(ob, s->total);
+	ob_putc(ob, '\n');
+}
+
+static void render_page(void)
+{
+	struct page *p;
+	char head[256];
+	unsigned i;
+	int n;
+
+	body.len = 0;
+	ob_puts(&body,
+		"# TYPE lattop_latency_seconds histogram\n"
+		"# UNIT lattop_latency_seconds seconds\n"
+		"# HELP lattop_latency_seconds Latencies of the tasks by comm and kernel stack.\n");
+	for (i = 0; i < nr_slots; i++)
+		if (slots[i].stack_id >= 0)
+			render_histogram(&body, &slots[i]);
+	if (overflow.count)
+		render_histogram(&body, &overflow);
+
+	ob_puts(&body,
+		"# TYPE lattop_interval_latency_seconds summary\n"
+		"# UNIT lattop_interval_latency_seconds seconds\n"
+		"# HELP lattop_interval_latency_seconds Latency quantiles of the last interval, "
+		"the histogram bucket bounds except for the exact maximum.\n");
+	for (i = 0; i < nr_slots; i++)
+		if (slots[i].stack_id >= 0)
+			render_summary(&body, &slots[i]);
+	if (overflow.count)
+		render_summary(&body, &overflow);
+
+	ob_printf(&body,
+		"# TYPE lattop_metrics_series gauge\n"
+		"# HELP lattop_metrics_series Number of series by comm and stack.\n"
+		"lattop_metrics_series %u\n"
+		"# TYPE lattop_metrics_series_limit gauge\n"
+		"# HELP lattop_metrics_series_limit Further stacks go to the stack_id=\"overflow\" series.\n"
+		"lattop_metrics_series_limit %u\n"
+		"# EOF\n", nr_series, arg_metrics_limit);
+
+	if (body.error)
+		return;
+
+	n = snprintf(head, sizeof(head),
+		"HTTP/1.1 200 OK\r\n"
+		"Content-Type: application/openmetrics-text; version=1.0.0; charset=utf-8\r\n"
+		"Content-Length: %zu\r\n"
+		"Connection: close\r\n\r\n", body.len);
+
+	p = malloc(sizeof(struct page) + n + body.len);
+	if (!p)
+		return;
+	p->refs = 1;
+	p->len = n + body.len;
+	memcpy(p->data, head, n);
+	memcpy(p->data + n, body.data, body.len);
+
+	page_put(cur_page);
+	cur_page = p;
+}
+
+static void conn_drop(struct http_conn *c)
+{
+	c->gone = true;
+	lattop_remove_reader(&c->pr);
+}
+
+static void conn_flush(struct http_conn *c)
+{
+	ssize_t n;
+
+	while (c->out_pos < c->out_len) {
+		n = send(c->fd, c->out + c->out_pos, c->out_len - c->out_pos,
+		         MSG_NOSIGNAL|MSG_DONTWAIT);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN)
+				lattop_reader_want_write(&c->pr, true);
+			else
+				conn_drop(c);
+			return;
+		}
+		c->out_pos += n;
+	}
+	conn_drop(c);
+}
+
+static void conn_respond(struct http_conn *c, const char *data, size_t len)
+{
+	c->out = data;
+	c->out_len = len;
+	conn_flush(c);
+}
+
+static void conn_request(struct http_conn *c)
+{
+	char method[8], path[64];
+
+	if (sscanf(c->req, "%7s %63s", method, path) != 2) {
+		conn_respond(c, bad_request, sizeof(bad_request) - 1);
+		return;
+	}
+	if (strcmp(method, "GET")) {
+		conn_respond(c, not_allowed, sizeof(not_allowed) - 1);
+		return;
+	}
+	if (strcmp(path, "/metrics") && strcmp(path, "/")) {
+		conn_respond(c, not_found, sizeof(not_found) - 1);
+		return;
+	}
+	if (!cur_page)
+		render_page();
+	if (!cur_page) {
+		conn_respond(c, unavailable, sizeof(unavailable) - 1);
+		return;
+	}
+
+	c->page = cur_page;
+	c->page->refs++;
+	conn_respond(c, c->page->data, c->page->len);
+}
+
+static int conn_handle_ready_fd(struct polled_reader *pr)
+{
+	struct http_conn *c = (struct http_conn*) pr;
+	ssize_t n;
+
+	n = recv(c->fd, c->req + c->req_len, sizeof(c->req) - c->req_len - 1, MSG_DONTWAIT);
+	if (n < 0 && (errno == EAGAIN || errno == EINTR))
+		return 0;
+	if (n <= 0) {
+		conn_drop(c);
+		return 0;
+	}
+
+	/* the response is on its way, the rest of the request does not matter */
+	if (c->out)
+		return 0;
+
+	c->req_len += n;
+	c->req[c->req_len] = '\0';
+	if (strstr(c->req, "\r\n\r\n") || strstr(c->req, "\n\n"))
+		conn_request(c);
+	else if (c->req_len == sizeof(c->req) - 1)
+		conn_respond(c, bad_request, sizeof(bad_request) - 1);
+
+	return 0;
+}
+
+static int conn_handle_writable(struct polled_reader *pr)
+{
+	conn_flush((struct http_conn*) pr);
+	return 0;
+}
+
+static int conn_get_fd(struct polled_reader *pr)
+{
+	return ((struct http_conn*) pr)->fd;
+}
+
+static void conn_fini(struct polled_reader *pr)
+{
+	struct http_conn *c = (struct http_conn*) pr;
+	unsigned i;
+
+	for (i = 0; i < nr_conns; i++) {
+		if (conns[i] == c) {
+			conns[i] = conns[--nr_conns];
+			break;
+		}
+	}
+
+	close(c->fd);
+	page_put(c->page);
+}
+
+static const struct polled_reader_ops conn_ops = {
+	.fini = conn_fini,
+	.get_fd = conn_get_fd,
+	.handle_ready_fd = conn_handle_ready_fd,
+	.handle_writable = conn_handle_writable,
+};
+
+void metrics_update(void)
+{
+	time_t now = time(NULL);
+	unsigned i;
+
+	for (i = 0; i < nr_slots; i++)
+		memset(&slots[i].interval, 0, sizeof(slots[i].interval));
+	memset(&overflow.interval, 0, sizeof(overflow.interval));
+
+	pa_for_each_process(fold_process, NULL);
+	render_page();
+
+	for (i = 0; i < nr_conns; i++)
+		if (!conns[i]->gone && now - conns[i]->since > HTTP_TIMEOUT)
+			conn_drop(conns[i]);
+}
+
+static int metrics_listener_handle_ready_fd(struct polled_reader *pr)
+{
+	struct metrics_listener *l = (struct metrics_listener*) pr;
+	struct http_conn *c;
+	int fd;
+
+	fd = accept4(l->fd, NULL, NULL, SOCK_NONBLOCK|SOCK_CLOEXEC);
+	if (fd < 0)
+		return 0;
+
+	c = nr_conns < MAX_HTTP_CONNS ? calloc(1, sizeof(struct http_conn)) : NULL;
+	if (c) {
+		c->pr.ops = &conn_ops;
+		c->fd = fd;
+		c->since = time(NULL);
+	}
+	if (!c || lattop_add_reader(&c->pr) < 0) {
+		send(fd, unavailable, sizeof(unavailable) - 1, MSG_NOSIGNAL|MSG_DONTWAIT);
+		close(fd);
+		free(c);
+		return 0;
+	}
+
+	conns[nr_conns++] = c;
+	return 0;
+}
+
+static int listen_tcp(const char *addr)
+{
+	struct sockaddr_in sa = { .sin_family = AF_INET };
+	char host[64] = "127.0.0.1";
+	const char *colon = strrchr(addr, ':');
+	unsigned port;
+	int fd, r, one = 1;
+
+	if (colon) {
+		if (colon - addr >= sizeof(host))
+			return -EINVAL;
+		memcpy(host, addr, colon - addr);
+		host[colon - addr] = '\0';
+		addr = colon + 1;
+	}
+	if (sscanf(addr, "%u", &port) != 1 || port > 65535 ||
+	    inet_pton(AF_INET, host, &sa.sin_addr) != 1)
+		return -EINVAL;
+	sa.sin_port = htons(port);
+
+	fd = socket(AF_INET, SOCK_STREAM|SOCK_NONBLOCK|SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return -errno;
+	if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) < 0 ||
+	    bind(fd, (struct sockaddr*) &sa, sizeof(sa)) < 0 || listen(fd, 16) < 0) {
+		r = -errno;
+		close(fd);
+		return r;
+	}
+	return fd;
+}
+
+static int metrics_listener_start(struct polled_reader *pr)
+{
+	struct metrics_listener *l = (struct metrics_listener*) pr;
+
+	if (l->addr[0] == '/') {
+		l->fd = listen_unix_socket(l->addr);
+		if (l->fd >= 0)
+			l->unix_path = l->addr;
+	} else
+		l->fd = listen_tcp(l->addr);
+
+	if (l->fd < 0) {
+		fprintf(stderr, "Cannot serve the metrics at %s: %s\n", l->addr, strerror(-l->fd));
+		return l->fd;
+	}
+
+	fprintf(stderr, "Serving the metrics at %s\n", l->addr);
+	return 0;
+}
+
+static void metrics_listener_fini(struct polled_reader *pr)
+{
+	struct metrics_listener *l = (struct metrics_listener*) pr;
+	unsigned i;
+
+	if (l->fd >= 0)
+		close(l->fd);
+	if (l->unix_path)
+		unlink(l->unix_path);
+
+	for (i = 0; i < nr_slots; i++)
+		if (slots[i].stack_id >= 0)
+			free(slots[i].translation);
+	free(slots);
+	slots = NULL;
+	nr_slots = nr_series = 0;
+	page_put(cur_page);
+	cur_page = NULL;
+	ob_free(&body);
+}
+
+static int metrics_listener_get_fd(struct polled_reader *pr)
+{
+	return ((struct metrics_listener*) pr)->fd;
+}
+
+static const struct polled_reader_ops metrics_listener_ops = {
+	.fini = metrics_listener_fini,
+	.start = metrics_listener_start,
+	.get_fd = metrics_listener_get_fd,
+	.handle_ready_fd = metrics_listener_handle_ready_fd,
+};
+
+struct polled_reader *metrics_listener_new(const char *addr)
+{
+	struct metrics_listener *l;
+
+	l = calloc(1, sizeof(struct metrics_listener));
+	if (l == NULL)
+		return NULL;
+
+	l->pr.ops = &metrics_listener_ops;
+	l->addr = addr;
+	l->fd = -1;
+
+	return &l->pr;
+}
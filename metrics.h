@@ -0,0 +1,23 @@
+/*
+ * Copyright 2026 agent
+ * Author: agent <agent@local>
+ * License: GPLv2
+ */
+#ifndef _METRICS_H
+#define _METRICS_H
+
+#include "polled_reader.h"
+
+#define MAX_HTTP_CONNS 16
+#define DEFAULT_METRICS_LIMIT 500
+
+/*
+ * Serves the metrics over HTTP at addr: PORT or ADDRESS:PORT (IPv4,
+ * loopback by default) or the path of a UNIX socket.
+ */
+struct polled_reader *metrics_listener_new(const char *addr);
+
+/* Adds the interval's latencies to the metrics and renders the page */
+void metrics_update(void);
+
+#endif
@@ -0,0 +1,192 @@
+/*
+ * Copyright 2026 agent
+ * Author: agent <agent@local>
+ * License: GPLv2
+ */
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "outbuf.h"
+
+int ob_reserve(struct outbuf *ob, size_t len)
+{
+	size_t new_alloc;
+	char *new_data;
+
+	if (ob->alloc - ob->len >= len)
+		return 0;
+
+	new_alloc = ob->alloc ? ob->alloc : 64*1024;
+	while (new_alloc - ob->len < len)
+		new_alloc *= 2;
+
+	new_data = realloc(ob->data, new_alloc);
+	if (!new_data) {
+		ob->error = -ENOMEM;
+		return -ENOMEM;
+	}
+
+	ob->data = new_data;
+	ob->alloc = new_alloc;
+	return 0;
+}
+
+void ob_write(struct outbuf *ob, const void *data, size_t len)
+{
+	if (ob_reserve(ob, len) < 0)
+		return;
+	memcpy(ob->data + ob->len, data, len);
+	ob->len += len;
+}
+
+void ob_printf(struct outbuf *ob, const char *fmt, ...)
+{
+	va_list ap;
+	int n;
+
+	if (!ob->data && ob_reserve(ob, 1) < 0)
+		return;
+
+	va_start(ap, fmt);
+	n = vsnprintf(ob->data + ob->len, ob->alloc - ob->len, fmt, ap);
+	va_end(ap);
+	if (n < 0)
+		return;
+
+	if ((size_t) n >= ob->alloc - ob->len) {
+		if (ob_reserve(ob, n + 1) < 0)
+			return;
+		va_start(ap, fmt);
+		vsnprintf(ob->data + ob->len, ob->alloc - ob->len, fmt, ap);
+		va_end(ap);
+	}
+
+	ob->len += n;
+}
+
+static const char digit_pairs[201] =
+	"00010203040506070809"
+	"10111213141516171819"
+	"20212223242526272829"
+	"30313233343536373839"
+	"40414243444546474849"
+	"50515253545556575859"
+	"60616263646566676869"
+	"70717273747576777879"
+	"80818283848586878889"
+	"90919293949596979899";
+
+void ob_put_u64(struct outbuf *ob, uint64_t value)
+{
+	char tmp[20], *p = tmp + sizeof(tmp);
+
+	/* two digits at a time, from the end */
+	while (value >= 100) {
+		unsigned i = (value % 100) * 2;
+		value /= 100;
+		*--p = digit_pairs[i + 1];
+		*--p = digit_pairs[i];
+	}
+	if (value >= 10) {
+		*--p = digit_pairs[value * 2 + 1];
+		*--p = digit_pairs[value * 2];
+	} else
+		*--p = '0' + value;
+
+	ob_write(ob, p, tmp + sizeof(tmp) - p);
+}
+
+void ob_put_i64(struct outbuf *ob, int64_t value)
+{
+	if (value < 0) {
+		ob_putc(ob, '-');
+		ob_put_u64(ob, -(uint64_t) value);
+	} else
+		ob_put_u64(ob, value);
+}
+
+void ob_put_hex(struct outbuf *ob, uint64_t value)
+{
+	static const char hex[16] = "0123456789abcdef";
+	char tmp[18], *p = tmp + sizeof(tmp);
+
+	do {
+		*--p = hex[value & 0xf];
+		value >>= 4;
+	} while (value);
+	*--p = 'x';
+	*--p = '0';
+
+	ob_write(ob, p, tmp + sizeof(tmp) - p);
+}
+
+void ob_put_json_string(struct outbuf *ob, const char *s)
+{
+	const char *run;
+
+	ob_putc(ob, '"');
+	for (;;) {
+		/* copy runs of plain characters at once */
+		for (run = s; *s && *s != '"' && *s != '\\' && (unsigned char) *s >= 0x20; s++)
+			;
+		ob_write(ob, run, s - run);
+
+		if (!*s)
+			break;
+		if (*s == '"' || *s == '\\') {
+			ob_putc(ob, '\\');
+			ob_putc(ob, *s);
+		} else
+			ob_printf(ob, "\\u%04x", (unsigned char) *s);
+		s++;
+	}
+	ob_putc(ob, '"');
+}
+
+void ob_put_csv_string(struct outbuf *ob, const char *s)
+{
+	if (!s[strcspn(s, ",\"\r\n")]) {
+		ob_puts(ob, s);
+		return;
+	}
+
+	ob_putc(ob, '"');
+	for (; *s; s++) {
+		if (*s == '"')
+			ob_putc(ob, '"');
+		ob_putc(ob, *s);
+	}
+	ob_putc(ob, '"');
+}
+
+int ob_flush(struct outbuf *ob, int fd)
+{
+	size_t done = 0;
+	ssize_t n;
+	int r = ob->error;
+
+	while (done < ob->len) {
+		n = write(fd, ob->data + done, ob->len - done);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			r = -errno;
+			break;
+		}
+		done += n;
+	}
+
+	ob->len = 0;
+	ob->error = 0;
+	return r;
+}
+
+void ob_free(struct outbuf *ob)
+{
+	free(ob->data);
+	ob->data = NULL;
+	ob->len = ob->alloc = 0;
+}
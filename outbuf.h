@@ -0,0 +1,50 @@
+/*
+ * Copyright 2026 agent
+ * Author: agent <agent@local>
+ * License: GPLv2
+ */
+#ifndef _OUTBUF_H
+#define _OUTBUF_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * A growing output buffer. Reports are rendered into one and written
+ * with a single write(), the buffer is reused for the next report.
+ */
+struct outbuf {
+	char *data;
+	size_t len, alloc;
+	int error;	/* sticky -ENOMEM */
+};
+
+int  ob_reserve(struct outbuf *ob, size_t len);
+void ob_write(struct outbuf *ob, const void *data, size_t len);
+void ob_printf(struct outbuf *ob, const char *fmt, ...)
+	__attribute__((format(printf, 2, 3)));
+void ob_put_u64(struct outbuf *ob, uint64_t value);
+void ob_put_i64(struct outbuf *ob, int64_t value);
+void ob_put_hex(struct outbuf *ob, uint64_t value);
+/* JSON string including the quotes */
+void ob_put_json_string(struct outbuf *ob, const char *s);
+/* CSV field, quoted if needed */
+void ob_put_csv_string(struct outbuf *ob, const char *s);
+
+/* Writes everything to fd and empties the buffer */
+int  ob_flush(struct outbuf *ob, int fd);
+void ob_free(struct outbuf *ob);
+
+static inline void ob_putc(struct outbuf *ob, char c)
+{
+	if (ob->len < ob->alloc || ob_reserve(ob, 1) == 0)
+		ob->data[ob->len++] = c;
+}
+
+static inline void ob_puts(struct outbuf *ob, const char *s)
+{
+	ob_write(ob, s, strlen(s));
+}
+
+#endif
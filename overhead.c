@@ -0,0 +1,601 @@
+/*
+ * lattop-overhead: how much lattop slows down the monitored workload.
+ *
+ * Runs fixed local workloads (futex ping-pong, pipe ping-pong, fsync
+ * loop) without lattop and then under each lattop configuration, and
+ * prints their throughput and latency percentiles, the change against
+ * the run without lattop and the CPU used by lattop and its stap
+ * children, as one JSON document on stdout. Progress goes to stderr.
+ *
+ * Needs the privileges to load the probe (root or the stapusr group).
+ * Without them it prints {"skipped":"..."} and exits with 77, the
+ * "skipped" exit status of the test harnesses.
+ *
+ * Copyright 2026 agent
+ * Author: agent <agent@local>
+ * License: GPLv2
+ */
+#include <sys/prctl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <linux/futex.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <grp.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define EXIT_SKIPPED 77
+#define MAX_CONFIGS 8
+#define MAX_SAMPLES (4 * 1024 * 1024)
+
+/* how long to wait for lattop to compile and load the probe */
+#define ATTACH_TIMEOUT 300
+
+struct config {
+	const char *name;
+	const char *args;	/* extra lattop arguments, split at spaces */
+};
+
+struct result {
+	bool valid;
+	const char *skipped;
+	double ops_per_sec;
+	uint64_t p50, p99, p999;	/* ns */
+	double cpu_percent;		/* of lattop and its children */
+};
+
+struct run {
+	uint64_t end;		/* ns, CLOCK_MONOTONIC */
+	uint32_t *samples;	/* ns per op */
+	unsigned long n_samples;
+	unsigned long long ops;
+	int pipes[2][2];
+	int fd;
+	volatile int futex_word;
+	volatile bool stop;
+};
+
+struct workload {
+	const char *name;
+	int  (*setup)(struct run *run);
+	void *(*peer)(void *arg);	/* the other side, if any */
+	int  (*op)(struct run *run);	/* one timed operation */
+	void (*stop)(struct run *run);	/* makes the peer return */
+	void (*teardown)(struct run *run);
+};
+
+static const char *arg_lattop = "./lattop";
+static const char *arg_dir = "/var/tmp";
+static unsigned arg_duration = 5;
+static struct config configs[MAX_CONFIGS];
+static unsigned n_configs;
+
+static uint64_t now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static long futex(volatile int *uaddr, int op, int val)
+{
+	return syscall(SYS_futex, uaddr, op, val, NULL, NULL, 0);
+}
+
+/* futex ping-pong: the op wakes the peer and waits to be woken back */
+
+static void *futex_peer(void *arg)
+{
+	struct run *run = arg;
+
+	prctl(PR_SET_NAME, "ovh-futex-peer");
+	while (!run->stop) {
+		while (run->futex_word != 1 && !run->stop)
+			futex(&run->futex_word, FUTEX_WAIT_PRIVATE, 0);
+		run->futex_word = 0;
+		futex(&run->futex_word, FUTEX_WAKE_PRIVATE, 1);
+	}
+	return NULL;
+}
+
+static int futex_op(struct run *run)
+{
+	run->futex_word = 1;
+	futex(&run->futex_word, FUTEX_WAKE_PRIVATE, 1);
+	while (run->futex_word == 1)
+		futex(&run->futex_word, FUTEX_WAIT_PRIVATE, 1);
+	return 0;
+}
+
+static void futex_stop(struct run *run)
+{
+	run->futex_word = 1;
+	futex(&run->futex_word, FUTEX_WAKE_PRIVATE, 1);
+}
+
+/* pipe ping-pong: a byte there and back */
+
+static int pipe_setup(struct run *run)
+{
+	if (pipe(run->pipes[0]) < 0 || pipe(run->pipes[1]) < 0) {
+		perror("pipe");
+		return -errno;
+	}
+	return 0;
+}
+
+static void *pipe_peer(void *arg)
+{
+	struct run *run = arg;
+	char c;
+
+	prctl(PR_SET_NAME, "ovh-pipe-peer");
+	/* ends when the op side closes its end */
+	while (read(run->pipes[0][0], &c, 1) == 1)
+		if (write(run->pipes[1][1], &c, 1) != 1)
+			break;
+	return NULL;
+}
+
+static int pipe_op(struct run *run)
+{
+	char c = 'x';
+
+	if (write(run->pipes[0][1], &c, 1) != 1 || read(run->pipes[1][0], &c, 1) != 1)
+		return -EIO;
+	return 0;
+}
+
+static void pipe_stop(struct run *run)
+{
+	close(run->pipes[0][1]);
+}
+
+static void pipe_teardown(struct run *run)
+{
+	close(run->pipes[0][0]);
+	close(run->pipes[1][0]);
+	close(run->pipes[1][1]);
+}
+
+/* fsync loop: rewrite a block and fsync it */
+
+static int fsync_setup(struct run *run)
+{
+	char path[4096];
+
+	snprintf(path, sizeof(path), "%s/lattop-overhead-XXXXXX", arg_dir);
+	run->fd = mkstemp(path);
+	if (run->fd < 0) {
+		fprintf(stderr, "Cannot create a file in %s: %s\n", arg_dir, strerror(errno));
+		return -errno;
+	}
+	unlink(path);
+	return 0;
+}
+
+static int fsync_op(struct run *run)
+{
+	static char block[4096];
+
+	if (pwrite(run->fd, block, sizeof(block), 0) != sizeof(block) || fsync(run->fd) < 0)
+		return -errno;
+	return 0;
+}
+
+static void fsync_teardown(struct run *run)
+{
+	close(run->fd);
+}
+
+static const struct workload workloads[] = {
+	{ "futex", NULL,        futex_peer, futex_op, futex_stop, NULL           },
+	{ "pipe",  pipe_setup,  pipe_peer,  pipe_op,  pipe_stop,  pipe_teardown  },
+	{ "fsync", fsync_setup, NULL,       fsync_op, NULL,       fsync_teardown },
+};
+#define N_WORKLOADS (sizeof(workloads) / sizeof(workloads[0]))
+
+static int cmp_u32(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t*) a, y = *(const uint32_t*) b;
+
+	return x < y ? -1 : x > y;
+}
+
+static uint64_t percentile(const uint32_t *sorted, unsigned long n, unsigned permille)
+{
+	return n ? sorted[(n - 1) * permille / 1000] : 0;
+}
+
+static int run_workload(const struct workload *w, struct result *res)
+{
+	struct run run = {};
+	pthread_t peer;
+	uint64_t start, t, prev;
+	int r;
+
+	run.samples = malloc(MAX_SAMPLES * sizeof(uint32_t));
+	if (!run.samples)
+		return -ENOMEM;
+	if (w->setup) {
+		r = w->setup(&run);
+		if (r < 0)
+			goto out;
+	}
+	if (w->peer) {
+		r = -pthread_create(&peer, NULL, w->peer, &run);
+		if (r < 0) {
+			fprintf(stderr, "Cannot create a thread: %s\n", strerror(-r));
+			if (w->stop)
+				w->stop(&run);
+			goto out_teardown;
+		}
+	}
+
+	prctl(PR_SET_NAME, "ovh-workload");
+	start = prev = t = now();
+	run.end = start + arg_duration * 1000000000ULL;
+	do {
+		r = w->op(&run);
+		if (r < 0) {
+			fprintf(stderr, "The %s workload failed: %s\n", w->name, strerror(-r));
+			break;
+		}
+		t = now();
+		/* past the buffer, only the throughput counts */
+		if (run.n_samples < MAX_SAMPLES)
+			run.samples[run.n_samples++] = t - prev < UINT32_MAX ? t - prev : UINT32_MAX;
+		run.ops++;
+		prev = t;
+	} while (t < run.end);
+
+	run.stop = true;
+	if (w->stop)
+		w->stop(&run);
+	if (w->peer)
+		pthread_join(peer, NULL);
+
+	if (r == 0) {
+		qsort(run.samples, run.n_samples, sizeof(uint32_t), cmp_u32);
+		res->valid = true;
+		res->ops_per_sec = run.ops * 1e9 / (t - start);
+		res->p50 = percentile(run.samples, run.n_samples, 500);
+		res->p99 = percentile(run.samples, run.n_samples, 990);
+		res->p999 = percentile(run.samples, run.n_samples, 999);
+	}
+
+out_teardown:
+	if (w->teardown)
+		w->teardown(&run);
+out:
+	free(run.samples);
+	return r;
+}
+
+/*
+ * CPU time in clock ticks of the process and its descendants: lattop,
+ * stap and stapio, which relays the probe's output.
+ */
+static unsigned long long tree_cpu_ticks(pid_t root)
+{
+	enum { MAX_PROCS = 32768 };
+	static pid_t pids[MAX_PROCS], ppids[MAX_PROCS];
+	static unsigned long long ticks[MAX_PROCS];
+	static bool in_tree[MAX_PROCS];
+	unsigned long long sum = 0;
+	unsigned n = 0, i, j;
+	struct dirent *de;
+	bool changed;
+	DIR *d;
+
+	d = opendir("/proc");
+	if (!d)
+		return 0;
+	while ((de = readdir(d)) && n < MAX_PROCS) {
+		unsigned long utime, stime;
+		char path[300], buf[1024], *p;
+		ssize_t len;
+		int fd;
+
+		if (de->d_name[0] < '0' || de->d_name[0] > '9')
+			continue;
+		snprintf(path, sizeof(path), "/proc/%s/stat", de->d_name);
+		fd = open(path, O_RDONLY | O_CLOEXEC);
+		if (fd < 0)
+			continue;
+		len = read(fd, buf, sizeof(buf) - 1);
+		close(fd);
+		if (len <= 0)
+			continue;
+		buf[len] = '\0';
+		/* the comm may contain anything, parse from its closing ')' */
+		p = strrchr(buf, ')');
+		if (!p || sscanf(p + 2, "%*c %d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu",
+		                 &ppids[n], &utime, &stime) != 3)
+			continue;
+		pids[n] = atoi(de->d_name);
+		ticks[n] = utime + stime;
+		in_tree[n] = pids[n] == root;
+		n++;
+	}
+	closedir(d);
+
+	do {
+		changed = false;
+		for (i = 0; i < n; i++) {
+			if (in_tree[i])
+				continue;
+			for (j = 0; j < n; j++) {
+				if (in_tree[j] && pids[j] == ppids[i]) {
+					in_tree[i] = changed = true;
+					break;
+				}
+			}
+		}
+	} while (changed);
+
+	for (i = 0; i < n; i++)
+		if (in_tree[i])
+			sum += ticks[i];
+	return sum;
+}
+
+/*
+ * Starts lattop with the config's arguments and waits for the probe:
+ * the first report appears in the output file one interval after that.
+ */
+static pid_t start_lattop(const struct config *c, const char *output, const char **why)
+{
+	char *argv[64], *args = NULL, *tok, *save;
+	unsigned argc = 0;
+	struct stat st;
+	uint64_t deadline;
+	pid_t pid;
+	int status, fd;
+
+	argv[argc++] = (char*) arg_lattop;
+	argv[argc++] = "-i1";
+	argv[argc++] = "-fjson";
+	argv[argc++] = "-o";
+	argv[argc++] = (char*) output;
+	if (c->args) {
+		args = strdup(c->args);
+		for (tok = strtok_r(args, " ", &save); tok && argc < 63; tok = strtok_r(NULL, " ", &save))
+			argv[argc++] = tok;
+	}
+	argv[argc] = NULL;
+
+	pid = fork();
+	if (pid < 0) {
+		perror("fork");
+		free(args);
+		*why = "cannot fork";
+		return -1;
+	}
+	if (pid == 0) {
+		fd = open("/dev/null", O_RDWR);
+		dup2(fd, STDIN_FILENO);
+		dup2(fd, STDOUT_FILENO);
+		execv(arg_lattop, argv);
+		fprintf(stderr, "Cannot execute %s: %s\n", arg_lattop, strerror(errno));
+		_exit(127);
+	}
+	free(args);
+
+	deadline = now() + ATTACH_TIMEOUT * 1000000000ULL;
+	for (;;) {
+		if (waitpid(pid, &status, WNOHANG) == pid) {
+			*why = "lattop exited before the probe was loaded";
+			return -1;
+		}
+		if (stat(output, &st) == 0 && st.st_size > 0)
+			return pid;
+		if (now() > deadline) {
+			kill(pid, SIGTERM);
+			waitpid(pid, &status, 0);
+			*why = "the probe was not loaded in time";
+			return -1;
+		}
+		usleep(100000);
+	}
+}
+
+static void stop_lattop(pid_t pid)
+{
+	int status;
+
+	kill(pid, SIGINT);
+	waitpid(pid, &status, 0);
+}
+
+static void run_config(const struct config *c, struct result *results)
+{
+	char output[] = "/tmp/lattop-overhead-report-XXXXXX";
+	unsigned long long ticks;
+	const char *why = NULL;
+	uint64_t start;
+	pid_t pid = 0;
+	unsigned i;
+	int fd;
+
+	/* the baseline runs without lattop */
+	if (c->args) {
+		fd = mkstemp(output);
+		if (fd < 0) {
+			why = "cannot create the report file";
+		} else {
+			close(fd);
+			fprintf(stderr, "Starting lattop (%s)...\n", c->name);
+			pid = start_lattop(c, output, &why);
+			unlink(output);
+		}
+		if (pid <= 0) {
+			fprintf(stderr, "Skipping lattop (%s): %s\n", c->name, why);
+			for (i = 0; i < N_WORKLOADS; i++)
+				results[i].skipped = why;
+			return;
+		}
+	}
+
+	for (i = 0; i < N_WORKLOADS; i++) {
+		fprintf(stderr, "Running %s with lattop (%s) for %u s...\n",
+		        workloads[i].name, c->name, arg_duration);
+		ticks = pid ? tree_cpu_ticks(pid) : 0;
+		start = now();
+		if (run_workload(&workloads[i], &results[i]) < 0)
+			results[i].skipped = "the workload failed";
+		if (pid)
+			results[i].cpu_percent = (tree_cpu_ticks(pid) - ticks) * 1e11 /
+			                         sysconf(_SC_CLK_TCK) / (now() - start);
+	}
+
+	if (pid)
+		stop_lattop(pid);
+}
+
+static double change_percent(double value, double base)
+{
+	return base ? (value - base) * 100 / base : 0;
+}
+
+static void print_results(struct result results[][N_WORKLOADS])
+{
+	const struct result *base, *res;
+	unsigned i, c;
+
+	printf("{\"duration\":%u,\"workloads\":[", arg_duration);
+	for (i = 0; i < N_WORKLOADS; i++) {
+		base = &results[0][i];
+		printf("%s\n {\"name\":\"%s\",\"configs\":[", i ? "," : "", workloads[i].name);
+		for (c = 0; c < n_configs; c++) {
+			res = &results[c][i];
+			printf("%s\n  {\"name\":\"%s\",\"lattop_args\":\"%s\"", c ? "," : "",
+			       configs[c].name, configs[c].args ?: "");
+			if (!res->valid) {
+				printf(",\"skipped\":\"%s\"}", res->skipped ?: "not run");
+				continue;
+			}
+			printf(",\"ops_per_sec\":%.1f,\"p50_ns\":%llu,\"p99_ns\":%llu,\"p999_ns\":%llu",
+			       res->ops_per_sec, (unsigned long long) res->p50,
+			       (unsigned long long) res->p99, (unsigned long long) res->p999);
+			if (c > 0) {
+				printf(",\"lattop_cpu_percent\":%.1f", res->cpu_percent);
+				if (base->valid)
+					printf(",\"ops_per_sec_change_percent\":%.2f,\"p99_change_percent\":%.2f"
+					       ",\"p999_change_percent\":%.2f",
+					       change_percent(res->ops_per_sec, base->ops_per_sec),
+					       change_percent(res->p99, base->p99),
+					       change_percent(res->p999, base->p999));
+			}
+			printf("}");
+		}
+		printf("]}");
+	}
+	printf("]}\n");
+}
+
+/* Returns why the probe cannot be loaded, or NULL */
+static const char *missing_privileges(void)
+{
+	gid_t groups[256];
+	struct group *gr;
+	int n, i;
+
+	if (geteuid() == 0)
+		return NULL;
+	gr = getgrnam("stapusr");
+	if (gr) {
+		if (getegid() == gr->gr_gid)
+			return NULL;
+		n = getgroups(256, groups);
+		for (i = 0; i < n; i++)
+			if (groups[i] == gr->gr_gid)
+				return NULL;
+	}
+	return "loading the probe needs root or the stapusr group";
+}
+
+static void usage_and_exit(int code)
+{
+	fprintf(stderr,
+"Usage: lattop-overhead [-l LATTOP] [-d SECONDS] [-D DIR] [-c NAME=ARGS]...\n"
+"  -l LATTOP    the lattop binary (default: ./lattop)\n"
+"  -d SECONDS   run every workload this long (default: 5)\n"
+"  -D DIR       the fsync workload's file is in DIR (default: /var/tmp)\n"
+"  -c NAME=ARGS measure lattop started with ARGS, e.g. -c sampled='-R 1000',\n"
+"               can be repeated (default: the configurations below)\n"
+"By default lattop is measured as it is, with a task filter that no task\n"
+"matches (the probe's cost alone), and with events sampled at 1000/s.\n");
+	exit(code);
+}
+
+int main(int argc, char *argv[])
+{
+	static struct result results[MAX_CONFIGS][N_WORKLOADS];
+	const char *why;
+	char *eq;
+	unsigned c;
+	int opt;
+
+	configs[n_configs++] = (struct config) { "none", NULL };
+
+	while ((opt = getopt(argc, argv, "l:d:D:c:h")) != -1) {
+		switch (opt) {
+		case 'l':
+			arg_lattop = optarg;
+			break;
+		case 'd':
+			arg_duration = strtoul(optarg, NULL, 10);
+			break;
+		case 'D':
+			arg_dir = optarg;
+			break;
+		case 'c':
+			eq = strchr(optarg, '=');
+			if (!eq || eq == optarg || n_configs == MAX_CONFIGS)
+				usage_and_exit(1);
+			*eq = '\0';
+			configs[n_configs++] = (struct config) { optarg, eq + 1 };
+			break;
+		case 'h':
+			usage_and_exit(0);
+		default:
+			usage_and_exit(1);
+		}
+	}
+	if (optind < argc || !arg_duration)
+		usage_and_exit(1);
+
+	if (n_configs == 1) {
+		configs[n_configs++] = (struct config) { "default", "" };
+		configs[n_configs++] = (struct config) { "probe-only", "-C ovh-nonesuch" };
+		configs[n_configs++] = (struct config) { "sampled", "-R 1000" };
+	}
+
+	why = missing_privileges();
+	if (!why && access(arg_lattop, X_OK) < 0)
+		why = "the lattop binary is missing";
+	if (why) {
+		fprintf(stderr, "Skipping: %s\n", why);
+		printf("{\"skipped\":\"%s\"}\n", why);
+		return EXIT_SKIPPED;
+	}
+
+	for (c = 0; c < n_configs; c++)
+		run_config(&configs[c], results[c]);
+
+	print_results(results);
+	return 0;
+}
@@ -13,6 +13,8 @@ struct polled_reader_ops {
 	int (*start)(struct polled_reader *pr);
 	int (*get_fd)(struct polled_reader *pr);
 	int (*handle_ready_fd)(struct polled_reader *pr);
+	/* optional, see lattop_reader_want_write() */
+	int (*handle_writable)(struct polled_reader *pr);
 };
 
 struct polled_reader {
@@ -0,0 +1,97 @@
+/*
+ * USDT probe points in lattop's own hot paths, for perf, bpftrace and
+ * SystemTap:
+ *
+ *   bpftrace -l 'usdt:/usr/bin/lattop:*'
+ *   bpftrace -e 'usdt:/usr/bin/lattop:lattop:report_write { @[arg1] = hist(arg1); }'
+ *
+ * An unattached probe is a nop. The arguments are only made available
+ * in registers or memory, so pass values that are computed anyway.
+ *
+ * <sys/sdt.h> is used if available. Otherwise, on x86-64 and aarch64,
+ * the same ELF notes are emitted here, with every argument widened to
+ * 64 bits. Elsewhere, or with -DLATTOP_NO_PROBES, the probes compile
+ * to nothing (make CPPFLAGS=-DLATTOP_NO_PROBES).
+ *
+ * Copyright 2026 agent
+ * Author: agent <agent@local>
+ * License: GPLv2
+ */
+#ifndef _PROBES_H
+#define _PROBES_H
+
+#if !defined(LATTOP_NO_PROBES) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#define _LATTOP_SYS_SDT
+#endif
+#endif
+
+#if defined(_LATTOP_SYS_SDT)
+
+#include <sys/sdt.h>
+
+#define LATTOP_PROBE0(name)			DTRACE_PROBE(lattop, name)
+#define LATTOP_PROBE1(name, a)			DTRACE_PROBE1(lattop, name, a)
+#define LATTOP_PROBE2(name, a, b)		DTRACE_PROBE2(lattop, name, a, b)
+#define LATTOP_PROBE3(name, a, b, c)		DTRACE_PROBE3(lattop, name, a, b, c)
+#define LATTOP_PROBE4(name, a, b, c, d)		DTRACE_PROBE4(lattop, name, a, b, c, d)
+
+#elif !defined(LATTOP_NO_PROBES) && (defined(__x86_64__) || defined(__aarch64__))
+
+/*
+ * A .note.stapsdt note per probe: the nop's address, the link time
+ * address of .stapsdt.base (to find the load bias), no semaphore, the
+ * provider, the name and the arguments as "8@<operand>".
+ */
+#define _LATTOP_PROBE(name, args, ...)						\
+	__asm__ __volatile__ (							\
+		"990:	nop\n"							\
+		"	.pushsection .note.stapsdt,\"?\",\"note\"\n"		\
+		"	.balign 4\n"						\
+		"	.4byte 992f-991f, 994f-993f, 3\n"			\
+		"991:	.asciz \"stapsdt\"\n"					\
+		"992:	.balign 4\n"						\
+		"993:	.8byte 990b\n"						\
+		"	.8byte _.stapsdt.base\n"				\
+		"	.8byte 0\n"						\
+		"	.asciz \"lattop\"\n"					\
+		"	.asciz \"" #name "\"\n"					\
+		"	.asciz \"" args "\"\n"					\
+		"994:	.balign 4\n"						\
+		"	.popsection\n"						\
+		"	.ifndef _.stapsdt.base\n"				\
+		"	.pushsection .stapsdt.base,\"aG\",\"progbits\",.stapsdt.base,comdat\n" \
+		"	.weak _.stapsdt.base\n"					\
+		"	.hidden _.stapsdt.base\n"				\
+		"_.stapsdt.base: .space 1\n"					\
+		"	.size _.stapsdt.base, 1\n"				\
+		"	.popsection\n"						\
+		"	.endif\n"						\
+		: : __VA_ARGS__)
+
+#define _LATTOP_ARG(x)	"nor" ((long) (x))
+
+#define LATTOP_PROBE0(name)							\
+	_LATTOP_PROBE(name, "", "i" (0))
+#define LATTOP_PROBE1(name, a)							\
+	_LATTOP_PROBE(name, "-8@%0", _LATTOP_ARG(a))
+#define LATTOP_PROBE2(name, a, b)						\
+	_LATTOP_PROBE(name, "-8@%0 -8@%1", _LATTOP_ARG(a), _LATTOP_ARG(b))
+#define LATTOP_PROBE3(name, a, b, c)						\
+	_LATTOP_PROBE(name, "-8@%0 -8@%1 -8@%2",				\
+	              _LATTOP_ARG(a), _LATTOP_ARG(b), _LATTOP_ARG(c))
+#define LATTOP_PROBE4(name, a, b, c, d)						\
+	_LATTOP_PROBE(name, "-8@%0 -8@%1 -8@%2 -8@%3",				\
+	              _LATTOP_ARG(a), _LATTOP_ARG(b), _LATTOP_ARG(c), _LATTOP_ARG(d))
+
+#else
+
+#define LATTOP_PROBE0(name)			do { } while (0)
+#define LATTOP_PROBE1(name, a)			do { (void) (a); } while (0)
+#define LATTOP_PROBE2(name, a, b)		do { (void) (a); (void) (b); } while (0)
+#define LATTOP_PROBE3(name, a, b, c)		do { (void) (a); (void) (b); (void) (c); } while (0)
+#define LATTOP_PROBE4(name, a, b, c, d)		do { (void) (a); (void) (b); (void) (c); (void) (d); } while (0)
+
+#endif
+
+#endif
@@ -10,37 +10,151 @@
 
 #include "process.h"
 
+#include "stack_table.h"
 #include "timespan.h"
-#include "lat_translator.h"
 #include "lattop.h"
 
 static void la_clear(struct latency_account *la)
 {
-	la->total = la->max = la->count = 0;
+	memset(la, 0, sizeof(*la));
 }
 
-static void la_init(struct latency_account *la, uint64_t delay)
+const char *la_state_name(enum la_state state)
 {
-	la->total = delay;
-	la->max   = delay;
-	la->count = 1;
+	static const char *const names[_LA_NR_STATES] = {
+		[LA_SLEEP] = "sleep",
+		[LA_BLOCK] = "block",
+	};
+
+	return names[state];
+}
+
+unsigned la_bucket(uint64_t delay)
+{
+	unsigned b;
+
+	if (delay <= NSEC_PER_USEC)
+		return 0;
+	b = 64 - __builtin_clzll((delay - 1) / NSEC_PER_USEC);
+	return b < LA_HIST_BUCKETS ? b : LA_HIST_BUCKETS - 1;
+}
+
+uint64_t la_bucket_bound(unsigned i)
+{
+	return NSEC_PER_USEC << i;
+}
+
+uint64_t la_quantile(const struct latency_account *la, unsigned permille)
+{
+	uint64_t rank = ((uint64_t) la->count * permille + 999) / 1000, seen = 0;
+	unsigned i;
+
+	for (i = 0; i < LA_HIST_BUCKETS - 1; i++) {
+		seen += la->hist[i];
+		if (seen >= rank)
+			return la_bucket_bound(i) < la->max ? la_bucket_bound(i) : la->max;
+	}
+	return la->max;
+}
+
+static void la_add_exemplar(struct latency_account *la, const struct la_event *ev)
+{
+	struct la_event *heap = la->exemplars, tmp;
+	unsigned i, child, n = la->n_exemplars;
+
+	if (n < LA_EXEMPLARS) {
+		/* sift up */
+		for (i = n; i > 0 && heap[(i - 1) / 2].delay > ev->delay; i = (i - 1) / 2)
+			heap[i] = heap[(i - 1) / 2];
+		heap[i] = *ev;
+		la->n_exemplars++;
+		return;
+	}
+
+	/* the common case, nothing to do */
+	if (ev->delay <= heap[0].delay)
+		return;
+
+	/* replace the smallest and sift it down */
+	tmp = *ev;
+	for (i = 0; (child = 2 * i + 1) < n; i = child) {
+		if (child + 1 < n && heap[child + 1].delay < heap[child].delay)
+			child++;
+		if (tmp.delay <= heap[child].delay)
+			break;
+		heap[i] = heap[child];
+	}
+	heap[i] = tmp;
+}
+
+static int compare_exemplars(const void *p1, const void *p2)
+{
+	const struct la_event *e1 = p1, *e2 = p2;
+
+	if (e1->delay < e2->delay)
+		return 1;
+	else if (e1->delay > e2->delay)
+		return -1;
+	else
+		return 0;
+}
+
+unsigned la_sorted_exemplars(const struct latency_account *la, struct la_event *array)
+{
+	memcpy(array, la->exemplars, la->n_exemplars * sizeof(struct la_event));
+	qsort(array, la->n_exemplars, sizeof(struct la_event), compare_exemplars);
+	return la->n_exemplars;
 }
 
-static void la_add_delay(struct latency_account *la, uint64_t delay)
+/* weight > 1 when the probe samples 1 in weight events */
+static void la_init(struct latency_account *la, const struct la_event *ev, unsigned weight)
 {
-	la->total += delay;
-	if (la->max < delay)
-		la->max = delay;
-	la->count++;
+	la_clear(la);
+	la->total = ev->delay * weight;
+	la->max   = ev->delay;
+	la->count = weight;
+	la->hist[la_bucket(ev->delay)] = weight;
+	la->state_total[la_event_state(ev)] = ev->delay * weight;
+	la->state_max[la_event_state(ev)]   = ev->delay;
+	la->state_count[la_event_state(ev)] = weight;
+	la->n_exemplars = 1;
+	la->exemplars[0] = *ev;
 }
 
-static void la_sum_delay(struct latency_account *la,
-                                const struct latency_account *other)
+static void la_add_delay(struct latency_account *la, const struct la_event *ev, unsigned weight)
 {
+	enum la_state s = la_event_state(ev);
+
+	la->total += ev->delay * weight;
+	if (la->max < ev->delay)
+		la->max = ev->delay;
+	la->count += weight;
+	la->hist[la_bucket(ev->delay)] += weight;
+	la->state_total[s] += ev->delay * weight;
+	if (la->state_max[s] < ev->delay)
+		la->state_max[s] = ev->delay;
+	la->state_count[s] += weight;
+	la_add_exemplar(la, ev);
+}
+
+void la_merge(struct latency_account *la, const struct latency_account *other)
+{
+	unsigned i;
+
 	la->total += other->total;
 	if (la->max < other->max)
 		la->max = other->max;
 	la->count += other->count;
+	for (i = 0; i < LA_HIST_BUCKETS; i++)
+		la->hist[i] += other->hist[i];
+	for (i = 0; i < _LA_NR_STATES; i++) {
+		la->state_total[i] += other->state_total[i];
+		if (la->state_max[i] < other->state_max[i])
+			la->state_max[i] = other->state_max[i];
+		la->state_count[i] += other->state_count[i];
+	}
+	for (i = 0; i < other->n_exemplars; i++)
+		la_add_exemplar(la, &other->exemplars[i]);
 }
 
 static int compare_by_max_latency(const void *p1, const void *p2)
@@ -69,48 +183,121 @@ static int compare_by_total_latency(const void *p1, const void *p2)
 		return 0;
 }
 
-void process_dump(struct process *p)
+static int compare_by_count(const void *p1, const void *p2)
 {
-	struct rb_node *node;
-	struct bt2la **array;
-	char sym_bt[1000], commpidtid[52], total[32], max[32];
-	unsigned n = 0;
+	struct bt2la *b1 = *(struct bt2la**)p1;
+	struct bt2la *b2 = *(struct bt2la**)p2;
+
+	if (b1->la.count < b2->la.count)
+		return 1;
+	else if (b1->la.count > b2->la.count)
+		return -1;
+	else
+		return 0;
+}
+
+static int compare_by_sleep_latency(const void *p1, const void *p2)
+{
+	struct bt2la *b1 = *(struct bt2la**)p1;
+	struct bt2la *b2 = *(struct bt2la**)p2;
+
+	if (b1->la.state_total[LA_SLEEP] < b2->la.state_total[LA_SLEEP])
+		return 1;
+	else if (b1->la.state_total[LA_SLEEP] > b2->la.state_total[LA_SLEEP])
+		return -1;
+	else
+		return 0;
+}
+
+static int compare_by_block_latency(const void *p1, const void *p2)
+{
+	struct bt2la *b1 = *(struct bt2la**)p1;
+	struct bt2la *b2 = *(struct bt2la**)p2;
+
+	if (b1->la.state_total[LA_BLOCK] < b2->la.state_total[LA_BLOCK])
+		return 1;
+	else if (b1->la.state_total[LA_BLOCK] > b2->la.state_total[LA_BLOCK])
+		return -1;
+	else
+		return 0;
+}
+
+void process_sort_bt2las(struct bt2la **array, unsigned n, enum sort_by sort, bool reverse)
+{
+	struct bt2la *tmp;
+	unsigned i;
 
 	static int (*const sort_func[_NR_SORT_BY])(const void *, const void *) = {
 		[SORT_BY_MAX_LATENCY]   = compare_by_max_latency,
 		[SORT_BY_TOTAL_LATENCY] = compare_by_total_latency,
 		[SORT_BY_PID]           = compare_by_max_latency, /* sorting by pid makes no sense within a process */
+		[SORT_BY_COUNT]         = compare_by_count,
+		[SORT_BY_SLEEP]         = compare_by_sleep_latency,
+		[SORT_BY_BLOCK]         = compare_by_block_latency,
 	};
 
+	qsort(array, n, sizeof(struct bt2la*), sort_func[sort]);
+
+	if (reverse) {
+		for (i = 0; i < n / 2; i++) {
+			tmp = array[i];
+			array[i] = array[n - i - 1];
+			array[n - i - 1] = tmp;
+		}
+	}
+}
+
+unsigned process_sorted_bt2las(struct process *p, struct bt2la **array,
+                               enum sort_by sort, bool reverse)
+{
+	struct rb_node *node;
+	unsigned n = 0;
+
+	for (node = rb_first(&p->bt2la_map); node; node = rb_next(node)) {
+		struct bt2la *bt2la = rb_entry(node, struct bt2la, rb_node);
+		array[n++] = bt2la;
+	}
+
+	assert(n == p->bt2la_count);
+	process_sort_bt2las(array, n, sort, reverse);
+
+	return n;
+}
+
+void process_dump(struct process *p, struct outbuf *ob, enum sort_by sort, bool reverse)
+{
+	struct bt2la **array;
+	struct back_trace bt;
+	char sym_bt[MAX_BT_LEN * 64], commpidtid[52], total[32], max[32], sleep[32], block[32];
+	unsigned n;
+
 	format_timespan(total, 32, p->summarized.total/1000, 3);
 	format_timespan(max,   32, p->summarized.max/1000,   3);
+	format_timespan(sleep, 32, p->summarized.state_total[LA_SLEEP]/1000, 3);
+	format_timespan(block, 32, p->summarized.state_total[LA_BLOCK]/1000, 3);
 
 	if (p->pid != p->tid)
 		snprintf(commpidtid, sizeof(commpidtid), "%s (%d, thread %d)", p->comm, p->pid, p->tid);
 	else
 		snprintf(commpidtid, sizeof(commpidtid), "%s (%d)", p->comm, p->pid);
 
-	printf("%-51s Max:%8s Total:%8s\n", commpidtid, max, total);
+	ob_printf(ob, "%-51s Max:%8s Total:%8s Sleep:%8s Block:%8s\n",
+	          commpidtid, max, total, sleep, block);
 
 	array = alloca(sizeof(struct bt2la*) * p->bt2la_count);
-
-	for (node = rb_first(&p->bt2la_map); node; node = rb_next(node)) {
-		struct bt2la *bt2la = rb_entry(node, struct bt2la, rb_node);
-		array[n++] = bt2la;
-	}
-
-	assert(n == p->bt2la_count);
-	qsort(array, n, sizeof(struct bt2la*), sort_func[arg_sort]);
+	process_sorted_bt2las(p, array, sort, reverse);
 
 	for (n = 0; n < p->bt2la_count; n++) {
-		struct bt2la *bt2la = array[!arg_reverse ? n : p->bt2la_count - n - 1];
+		struct bt2la *bt2la = array[n];
 		double percentage = (bt2la->la.total*100.0)/p->summarized.total;
 		const char *translation;
 
-		bt_save_symbolic(&bt2la->bt, sym_bt+1, sizeof(sym_bt)-1);
-		translation = lat_translator_translate_stack(sym_bt+1);
+		stack_table_get(bt2la->stack_id, &bt);
+		translation = bt_translate(&bt);
 		if (!translation) {
-			size_t end = strnlen(sym_bt+1, 49);
+			size_t end;
+			bt_save_symbolic(&bt, sym_bt+1, sizeof(sym_bt)-1);
+			end = strnlen(sym_bt+1, 49);
 			sym_bt[0] = '[';
 			/* this is safe, because sym_bt array is way larger than our strnlen limit above */
 			sym_bt[end+1] = ']';
@@ -121,7 +308,7 @@ void process_dump(struct process *p)
 		format_timespan(total, 32, bt2la->la.total/1000, 3);
 		format_timespan(max,   32, bt2la->la.max/1000,   3);
 
-		printf(" %-51s Max:%8s %5.1f%%\n", translation ?: sym_bt, max, percentage);
+		ob_printf(ob, " %-51s Max:%8s %5.1f%%\n", translation ?: sym_bt, max, percentage);
 	}
 }
 
@@ -132,34 +319,31 @@ void process_summarize(struct process *p)
 	la_clear(&p->summarized);
 	for (node = rb_first(&p->bt2la_map); node; node = rb_next(node)) {
 		struct bt2la *bt2la = rb_entry(node, struct bt2la, rb_node);
-		la_sum_delay(&p->summarized, &bt2la->la);
+		la_merge(&p->summarized, &bt2la->la);
 	}
 }
 
 /*
  * Search the rb-tree
- * Returns the node with the same back_trace if it exists.
+ * Returns the node with the same stack if it exists.
  * If not, returns NULL, and sets the 'parent' and 'link' pointers to where
  * the newly created node should be put.
  */
-static struct bt2la *rb_search_bt2la(struct process *process,
-                                     struct back_trace *bt,
+static struct bt2la *rb_search_bt2la(struct process *process, int stack_id,
                                      struct rb_node **pparent,
                                      struct rb_node ***plink)
 {
 	struct rb_node **p = &process->bt2la_map.rb_node;
 	struct rb_node *parent = NULL;
 	struct bt2la *bt2la;
-	int cmp;
 
 	while (*p) {
 		parent = *p;
 		bt2la = rb_entry(parent, struct bt2la, rb_node);
 
-		cmp = bt_compare(bt, &bt2la->bt);
-		if (cmp < 0)
+		if (stack_id < bt2la->stack_id)
 			p = &(*p)->rb_left;
-		else if (cmp > 0)
+		else if (stack_id > bt2la->stack_id)
 			p = &(*p)->rb_right;
 		else
 			return bt2la;
@@ -171,26 +355,49 @@ static struct bt2la *rb_search_bt2la(struct process *process,
 	return NULL;
 }
 
-void process_suffer_latency(struct process *p, uint64_t delay,
-                            struct back_trace *bt)
+static struct bt2la *get_bt2la(struct process *p, int stack_id, bool *is_new)
 {
 	struct bt2la *item;
 	struct rb_node *parent;
 	struct rb_node **link;
 
-	item = rb_search_bt2la(p, bt, &parent, &link);
-	if (item) {
-		la_add_delay(&item->la, delay);
-		return;
-	}
+	item = rb_search_bt2la(p, stack_id, &parent, &link);
+	*is_new = !item;
+	if (item)
+		return item;
 
 	item = malloc(sizeof(struct bt2la));
-	item->bt = *bt;
-	la_init(&item->la, delay);
+	item->stack_id = stack_id;
 
 	rb_link_node(&item->rb_node, parent, link);
 	rb_insert_color(&item->rb_node, &p->bt2la_map);
 	p->bt2la_count++;
+	return item;
+}
+
+void process_suffer_latency(struct process *p, const struct la_event *ev, unsigned weight,
+                            int stack_id)
+{
+	struct bt2la *item;
+	bool is_new;
+
+	item = get_bt2la(p, stack_id, &is_new);
+	if (is_new)
+		la_init(&item->la, ev, weight);
+	else
+		la_add_delay(&item->la, ev, weight);
+}
+
+void process_add_account(struct process *p, int stack_id, const struct latency_account *la)
+{
+	struct bt2la *item;
+	bool is_new;
+
+	item = get_bt2la(p, stack_id, &is_new);
+	if (is_new)
+		item->la = *la;
+	else
+		la_merge(&item->la, la);
 }
 
 
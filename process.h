@@ -7,26 +7,79 @@
 #define _PROCESS_H
 
 #include <sys/types.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include "rbtree.h"
 #include "back_trace.h"
+#include "outbuf.h"
+#include "lattop.h"
+
+/*
+ * Bucket 0 counts the delays up to 1 us, bucket i those in
+ * (2^(i-1), 2^i] us and the last one everything longer.
+ */
+#define LA_HIST_BUCKETS 24
+
+/* The largest events an account remembers */
+#define LA_EXEMPLARS 4
+
+/* The state a task waited in */
+enum la_state {
+	LA_SLEEP,		/* interruptible, 'S' */
+	LA_BLOCK,		/* uninterruptible, 'B', mostly I/O */
+	_LA_NR_STATES
+};
+
+/* An event as the probe reports it */
+struct la_event {
+	uint64_t time;		/* ns since the epoch, when the wait ended */
+	uint64_t delay;		/* ns */
+	pid_t tid;
+	uint16_t cpu;
+	char type;		/* 'S'leep or 'B'lock */
+};
 
 struct latency_account {
 	uint64_t total;
 	uint64_t max;
-	int count;
+	uint64_t count;
+	uint64_t hist[LA_HIST_BUCKETS];
+	/* the same by the state, an array per field, not an account per state */
+	uint64_t state_total[_LA_NR_STATES];
+	uint64_t state_max[_LA_NR_STATES];
+	uint64_t state_count[_LA_NR_STATES];
+	/* a min-heap by the delay, the smallest of them at [0] */
+	unsigned n_exemplars;
+	struct la_event exemplars[LA_EXEMPLARS];
 };
 
+static inline enum la_state la_event_state(const struct la_event *ev)
+{
+	return ev->type == 'B' ? LA_BLOCK : LA_SLEEP;
+}
+
+/* "sleep" or "block" */
+const char *la_state_name(enum la_state state);
+
+unsigned la_bucket(uint64_t delay);
+/* The upper bound of bucket i in ns */
+uint64_t la_bucket_bound(unsigned i);
+/* The upper bound of the bucket holding the quantile, at most the maximum */
+uint64_t la_quantile(const struct latency_account *la, unsigned permille);
+void la_merge(struct latency_account *la, const struct latency_account *other);
+/* Fills array with the exemplars, the largest delay first, returns their count */
+unsigned la_sorted_exemplars(const struct latency_account *la, struct la_event *array);
+
 struct bt2la {
 	struct rb_node rb_node;
-	struct back_trace bt;	/* key in the rb-tree */
+	int stack_id;		/* key in the rb-tree, see stack_table.h */
 	struct latency_account la;
 };
 
 struct process {
 	struct rb_node rb_node;		/* tree of processes, sorted by tid */
-	struct rb_root bt2la_map;	/* this process's latencies, sorted by the backtrace */
+	struct rb_root bt2la_map;	/* this process's latencies, sorted by the stack id */
 	pid_t pid;
 	pid_t tid;
 	char comm[16];
@@ -34,11 +87,17 @@ struct process {
 	unsigned bt2la_count;
 };
 
-void process_suffer_latency(struct process *p, uint64_t delay,
-                            struct back_trace *bt);
+void process_suffer_latency(struct process *p, const struct la_event *ev, unsigned weight,
+                            int stack_id);
+/* Merges an account of the stack, e.g. from another interval */
+void process_add_account(struct process *p, int stack_id, const struct latency_account *la);
 struct process *process_new(pid_t pid, pid_t tid, const char comm[16]);
 void process_summarize(struct process *p);
-void process_dump(struct process *p);
+void process_sort_bt2las(struct bt2la **array, unsigned n, enum sort_by sort, bool reverse);
+/* Fills array with the bt2las in the report order, returns their count */
+unsigned process_sorted_bt2las(struct process *p, struct bt2la **array,
+                               enum sort_by sort, bool reverse);
+void process_dump(struct process *p, struct outbuf *ob, enum sort_by sort, bool reverse);
 void process_fini(struct process *p);
 
 #endif
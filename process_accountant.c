@@ -4,17 +4,36 @@
  * License: GPLv2
  */
 #include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
+#include <string.h>
 #include <time.h>
+#include <unistd.h>
 
 #include "process_accountant.h"
 
+#include "call_tree.h"
 #include "lattop.h"
 #include "process.h"
 #include "rbtree.h"
+#include "report.h"
+#include "snapshot.h"
+#include "stack_rewrite.h"
+#include "stack_table.h"
+#include "diff.h"
+#include "self_stats.h"
+#include "probes.h"
 
 static struct rb_root processes;
 static unsigned count;
+static unsigned long events;
+static unsigned max_weight;	/* the highest sampling factor of the interval */
+static unsigned long seq;	/* number of dumped intervals */
+static struct outbuf report_buf;
+static int output_fd = STDOUT_FILENO;
+/* false when the call tree is the only aggregation */
+static bool keep_threads = true;
 
 static void pa_delete_rbtree(struct rb_node *n)
 {
@@ -33,6 +52,9 @@ void pa_clear(void)
 	pa_delete_rbtree(processes.rb_node);
 	processes = RB_ROOT;
 	count = 0;
+	events = 0;
+	max_weight = 1;
+	call_tree_clear();
 }
 
 static int compare_by_max_latency(const void *p1, const void *p2)
@@ -78,45 +100,204 @@ static int compare_by_pid(const void *p1, const void *p2)
 		return 0;
 }
 
-void pa_dump_and_clear(void)
+static int compare_by_count(const void *p1, const void *p2)
 {
-	struct rb_node *node;
-	struct process *process, **array;
-	time_t cur_time;
-	unsigned n = 0;
+	struct process *pr1 = *(struct process**)p1;
+	struct process *pr2 = *(struct process**)p2;
+
+	if (pr1->summarized.count < pr2->summarized.count)
+		return 1;
+	else if (pr1->summarized.count > pr2->summarized.count)
+		return -1;
+	else
+		return 0;
+}
 
+static int compare_by_sleep_latency(const void *p1, const void *p2)
+{
+	struct process *pr1 = *(struct process**)p1;
+	struct process *pr2 = *(struct process**)p2;
+
+	if (pr1->summarized.state_total[LA_SLEEP] < pr2->summarized.state_total[LA_SLEEP])
+		return 1;
+	else if (pr1->summarized.state_total[LA_SLEEP] > pr2->summarized.state_total[LA_SLEEP])
+		return -1;
+	else
+		return 0;
+}
+
+static int compare_by_block_latency(const void *p1, const void *p2)
+{
+	struct process *pr1 = *(struct process**)p1;
+	struct process *pr2 = *(struct process**)p2;
+
+	if (pr1->summarized.state_total[LA_BLOCK] < pr2->summarized.state_total[LA_BLOCK])
+		return 1;
+	else if (pr1->summarized.state_total[LA_BLOCK] > pr2->summarized.state_total[LA_BLOCK])
+		return -1;
+	else
+		return 0;
+}
+
+void pa_sort_processes(struct process **array, unsigned n, enum sort_by sort)
+{
 	static int (*const sort_func[_NR_SORT_BY])(const void *, const void *) = {
 		[SORT_BY_MAX_LATENCY]   = compare_by_max_latency,
 		[SORT_BY_TOTAL_LATENCY] = compare_by_total_latency,
 		[SORT_BY_PID]           = compare_by_pid,
+		[SORT_BY_COUNT]         = compare_by_count,
+		[SORT_BY_SLEEP]         = compare_by_sleep_latency,
+		[SORT_BY_BLOCK]         = compare_by_block_latency,
 	};
 
-	time(&cur_time);
+	qsort(array, n, sizeof(struct process*), sort_func[sort]);
+}
 
-	array = alloca(sizeof(struct process*) * count);
+static void text_begin(struct outbuf *ob, const struct report_info *ri)
+{
+	ob_putc(ob, '\n');
+}
 
-	/* summarize processes */
-	for (node = rb_first(&processes); node; node = rb_next(node)) {
-		process = rb_entry(node, struct process, rb_node);
-		process_summarize(process);
-		array[n++] = process;
-	}
+static void text_process(struct outbuf *ob, const struct report_info *ri,
+                         struct process *p)
+{
+	process_dump(p, ob, ri->sort, ri->reverse);
+}
+
+static void text_end(struct outbuf *ob, const struct report_info *ri)
+{
+	if (ri->sample_factor > 1)
+		ob_printf(ob, "Sampled up to 1 in %u events, counts and totals are scaled.\n",
+		          ri->sample_factor);
+	ob_printf(ob, "=== %s", ctime(&ri->time));
+}
+
+const struct report_writer text_writer = {
+	.begin = text_begin,
+	.process = text_process,
+	.end = text_end,
+};
+
+static const struct report_writer *const writers[_NR_FORMATS] = {
+	[FORMAT_TEXT] = &text_writer,
+	[FORMAT_JSON] = &json_writer,
+	[FORMAT_CSV]  = &csv_writer,
+	[FORMAT_FOLDED] = &folded_writer,
+	[FORMAT_PPROF] = &pprof_writer,
+	[FORMAT_SNAPSHOT] = &snapshot_writer,
+	[FORMAT_TREE] = &tree_writer,
+	[FORMAT_CALLERS] = &callers_writer,
+};
+
+static void render_report(struct outbuf *ob, const struct report_info *ri,
+                          const struct report_writer *writer,
+                          struct process **array, unsigned n)
+{
+	uint64_t t = self_stats_clock();
+	unsigned i;
+
+	for (i = 0; i < n; i++)
+		process_summarize(array[i]);
 
 	/* sort by whatever key */
-	assert(n == count);
-	qsort(array, count, sizeof(struct process*), sort_func[arg_sort]);
+	pa_sort_processes(array, n, ri->sort);
+	self_stats.stage_ns[STAGE_SORT] += self_stats_clock() - t;
 
-	/* dump processes */
-	putchar('\n');
-	if (!arg_reverse)
-		for (n = 0; n < count; n++)
-			process_dump(array[n]);
+	writer->begin(ob, ri);
+	if (!ri->reverse)
+		for (i = 0; i < n; i++)
+			writer->process(ob, ri, array[i]);
 	else
-		for (n = count; n > 0; n--)
-			process_dump(array[n-1]);
-	printf("=== %s", ctime(&cur_time));
+		for (i = n; i > 0; i--)
+			writer->process(ob, ri, array[i-1]);
+	writer->end(ob, ri);
+}
+
+void pa_render_report(struct outbuf *ob, const struct report_info *ri,
+                      enum output_format format,
+                      struct process **array, unsigned n)
+{
+	render_report(ob, ri, writers[format], array, n);
+}
 
+void pa_dump_and_clear(void)
+{
+	pa_dump_and_clear_at(time(NULL));
+}
+
+void pa_dump_and_clear_at(time_t t)
+{
+	struct rb_node *node;
+	struct process **array;
+	struct report_info ri;
+	const struct report_writer *writer;
+	uint64_t start, sort, symbolize;
+	size_t len;
+	unsigned n = 0;
+	int r;
+
+	ri.time = t;
+	ri.seq = seq++;
+	ri.sample_factor = max_weight;
+	ri.sort = arg_sort;
+	ri.reverse = arg_reverse;
+
+	array = alloca(sizeof(struct process*) * count);
+	for (node = rb_first(&processes); node; node = rb_next(node))
+		array[n++] = rb_entry(node, struct process, rb_node);
+	assert(n == count);
+
+	/* render the whole report, then write it at once */
+	start = self_stats_clock();
+	sort = self_stats.stage_ns[STAGE_SORT];
+	symbolize = self_stats.stage_ns[STAGE_SYMBOLIZE];
+	writer = arg_diff ? &diff_writer : writers[arg_format];
+	render_report(&report_buf, &ri, writer, array, n);
+	/* without the write, it comes after the footer */
+	self_stats.stage_ns[STAGE_PRINT] += self_stats_clock() - start -
+		(self_stats.stage_ns[STAGE_SORT] - sort) -
+		(self_stats.stage_ns[STAGE_SYMBOLIZE] - symbolize);
+	self_stats_render(&report_buf, &ri, arg_format, array, n);
+	self_stats_reset();
+	LATTOP_PROBE3(report_render, n, report_buf.len, self_stats_clock() - start);
+
+	start = self_stats_clock();
+	len = report_buf.len;
+	r = writer->flush ? writer->flush(&report_buf) : ob_flush(&report_buf, output_fd);
+	if (r < 0)
+		fprintf(stderr, "Failed to write the report: %s\n", strerror(-r));
+	LATTOP_PROBE3(report_write, len, self_stats_clock() - start, r);
+
+	start = self_stats_clock();
 	pa_clear();
+	LATTOP_PROBE2(report_clear, n, self_stats_clock() - start);
+}
+
+void pa_take_snapshot(struct pa_snapshot *s)
+{
+	struct rb_node *node;
+
+	time(&s->info.time);
+	s->info.seq = seq++;
+	s->info.sample_factor = max_weight;
+	s->info.sort = arg_sort;
+	s->info.reverse = arg_reverse;
+
+	for (node = rb_first(&processes); node; node = rb_next(node))
+		process_summarize(rb_entry(node, struct process, rb_node));
+
+	s->processes = processes;
+	s->count = count;
+
+	processes = RB_ROOT;
+	pa_clear();
+}
+
+void pa_snapshot_free(struct pa_snapshot *s)
+{
+	pa_delete_rbtree(s->processes.rb_node);
+	s->processes = RB_ROOT;
+	s->count = 0;
 }
 
 static struct process *search_process(pid_t tid, struct rb_node **pparent,
@@ -144,8 +325,7 @@ static struct process *search_process(pid_t tid, struct rb_node **pparent,
 	return NULL;
 }
 
-void pa_account_latency(pid_t pid, pid_t tid, const char comm[16], uint64_t delay,
-                        struct back_trace *bt)
+static struct process *get_process(pid_t pid, pid_t tid, const char comm[16])
 {
 	struct process *process;
 	struct rb_node *parent;
@@ -158,16 +338,102 @@ void pa_account_latency(pid_t pid, pid_t tid, const char comm[16], uint64_t dela
 		rb_insert_color(&process->rb_node, &processes);
 		count++;
 	}
-	process_suffer_latency(process, delay, bt);
+	return process;
 }
 
+void pa_account_latency(pid_t pid, const char comm[16], const struct la_event *ev,
+                        unsigned weight, const struct back_trace *bt)
+{
+	struct back_trace buf;
+	struct process *process;
+	int stack_id;
+
+	LATTOP_PROBE4(account, pid, ev->tid, ev->delay, weight);
+	stack_id = stack_table_intern(stack_rewrite(bt, &buf));
+	if (stack_id < 0)
+		return;
+	if (call_tree_fed())
+		call_tree_add(stack_id, weight, ev->delay * weight, ev->delay);
+	if (keep_threads) {
+		process = get_process(pid, ev->tid, comm);
+		process_suffer_latency(process, ev, weight, stack_id);
+	}
+
+	events++;
+	if (weight > max_weight)
+		max_weight = weight;
+}
+
+void pa_account_merge(pid_t pid, pid_t tid, const char comm[16],
+                      int stack_id, const struct latency_account *la,
+                      unsigned sample_factor)
+{
+	stack_id = stack_rewrite_id(stack_id);
+	if (stack_id < 0)
+		return;
+	if (call_tree_fed())
+		call_tree_add(stack_id, la->count, la->total, la->max);
+	if (keep_threads)
+		process_add_account(get_process(pid, tid, comm), stack_id, la);
+
+	events += la->count;
+	if (sample_factor > max_weight)
+		max_weight = sample_factor;
+}
+
+void pa_for_each_process(void (*fn)(struct process *p, void *userdata), void *userdata)
+{
+	struct rb_node *node;
+
+	for (node = rb_first(&processes); node; node = rb_next(node))
+		fn(rb_entry(node, struct process, rb_node), userdata);
+}
 
-void pa_init(void)
+unsigned long pa_event_count(void)
+{
+	return events;
+}
+
+
+int pa_init(void)
 {
 	processes = RB_ROOT;
+	max_weight = 1;
+
+	/*
+	 * The tree formats are aggregated into the call tree as the events
+	 * come. The threads' accounts are still kept for the recording and
+	 * the publishers. The daemon renders its clients' trees from them.
+	 */
+	if ((arg_format == FORMAT_TREE || arg_format == FORMAT_CALLERS) && !arg_daemon &&
+	    !arg_diff) {
+		call_tree_feed(arg_format == FORMAT_CALLERS);
+		keep_threads = arg_record || arg_metrics || arg_shm;
+	}
+
+	/* pprof and snapshots write whole files themselves */
+	if (arg_output && !writers[arg_format]->flush) {
+		output_fd = open(arg_output, O_WRONLY|O_CREAT|O_APPEND|O_CLOEXEC, 0644);
+		if (output_fd < 0) {
+			int r = -errno;
+			fprintf(stderr, "Cannot open %s: %s\n", arg_output, strerror(errno));
+			output_fd = STDOUT_FILENO;
+			return r;
+		}
+	}
+
+	return 0;
 }
 
 void pa_fini(void)
 {
 	pa_clear();
+	ob_free(&report_buf);
+	profile_writer_fini();
+	call_tree_fini();
+	snapshot_writer_fini();
+	diff_fini();
+	stack_rewrite_fini();
+	if (output_fd != STDOUT_FILENO)
+		close(output_fd);
 }
@@ -8,14 +8,39 @@
 
 #include <sys/types.h>
 #include <stdint.h>
+#include <time.h>
 
 #include "back_trace.h"
+#include "lattop.h"
+#include "rbtree.h"
+#include "report.h"
 
-void pa_init(void);
+/* An interval's processes, taken over from the accountant */
+struct pa_snapshot {
+	struct rb_root processes;	/* summarized, sorted by tid */
+	unsigned count;
+	struct report_info info;
+};
+
+int  pa_init(void);
 void pa_fini(void);
 
-void pa_account_latency(pid_t pid, pid_t tid, const char comm[16],
-                        uint64_t delay, struct back_trace *bt);
+void pa_account_latency(pid_t pid, const char comm[16], const struct la_event *ev,
+                        unsigned weight, const struct back_trace *bt);
+/* Adds an already accounted stack, e.g. from a recording */
+void pa_account_merge(pid_t pid, pid_t tid, const char comm[16],
+                      int stack_id, const struct latency_account *la,
+                      unsigned sample_factor);
 void pa_dump_and_clear(void);
+/* The same for an interval that ended at t */
+void pa_dump_and_clear_at(time_t t);
+/* Ends the interval like pa_dump_and_clear(), but keeps the data */
+void pa_take_snapshot(struct pa_snapshot *s);
+void pa_snapshot_free(struct pa_snapshot *s);
+void pa_sort_processes(struct process **array, unsigned n, enum sort_by sort);
+/* Calls fn for every thread of the current interval, not summarized */
+void pa_for_each_process(void (*fn)(struct process *p, void *userdata), void *userdata);
+/* number of events accounted since the last dump */
+unsigned long pa_event_count(void);
 
 #endif
@@ -0,0 +1,486 @@
+/*
+ * Report writers for profiling tools. The (thread, stack) -> latency
+ * aggregates are an off-CPU profile:
+ *
+ *  folded - Brendan Gregg's collapsed stacks for flamegraph.pl,
+ *           "comm;outermost;...;innermost total_ns", one line per stack
+ *  pprof  - profile.proto with the sample types latency/nanoseconds and
+ *           events/count, encoded by hand. Strings, functions and
+ *           locations are deduplicated.
+ *
+ * Copyright 2026 agent
+ * Author: agent <agent@local>
+ * License: GPLv2
+ */
+#include <alloca.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "report.h"
+
+#include "back_trace.h"
+#include "lattop.h"
+#include "stack_table.h"
+#include "sym_translator.h"
+#include "timespan.h"
+
+static void folded_begin(struct outbuf *ob, const struct report_info *ri)
+{
+}
+
+static void folded_process(struct outbuf *ob, const struct report_info *ri,
+                           struct process *p)
+{
+	struct back_trace bt;
+	struct rb_node *node;
+	const char *sym;
+	unsigned i;
+
+	for (node = rb_first(&p->bt2la_map); node; node = rb_next(node)) {
+		struct bt2la *bt2la = rb_entry(node, struct bt2la, rb_node);
+
+		/* ';' separates frames, so it must not appear in comm */
+		for (i = 0; p->comm[i]; i++)
+			ob_putc(ob, p->comm[i] == ';' ? '_' : p->comm[i]);
+
+		/* the root of the flame graph is the outermost frame */
+		for (i = stack_table_get(bt2la->stack_id, &bt); i > 0; i--) {
+			ob_putc(ob, ';');
+			sym = sym_translator_lookup(bt.trace[i-1]);
+			if (sym)
+				ob_puts(ob, sym);
+			else
+				ob_put_hex(ob, bt.trace[i-1]);
+		}
+
+		ob_putc(ob, ' ');
+		ob_put_u64(ob, bt2la->la.total);
+		ob_putc(ob, '\n');
+	}
+}
+
+static void folded_end(struct outbuf *ob, const struct report_info *ri)
+{
+}
+
+const struct report_writer folded_writer = {
+	.begin = folded_begin,
+	.process = folded_process,
+	.end = folded_end,
+};
+
+/* protobuf wire format */
+enum { WIRE_VARINT = 0, WIRE_BYTES = 2 };
+
+static void pb_varint(struct outbuf *ob, uint64_t v)
+{
+	while (v >= 0x80) {
+		ob_putc(ob, (v & 0x7f) | 0x80);
+		v >>= 7;
+	}
+	ob_putc(ob, v);
+}
+
+static void pb_uint(struct outbuf *ob, unsigned field, uint64_t v)
+{
+	pb_varint(ob, field << 3 | WIRE_VARINT);
+	pb_varint(ob, v);
+}
+
+static void pb_bytes(struct outbuf *ob, unsigned field, const void *data, size_t len)
+{
+	pb_varint(ob, field << 3 | WIRE_BYTES);
+	pb_varint(ob, len);
+	ob_write(ob, data, len);
+}
+
+/* profile.proto field numbers */
+enum {
+	PROFILE_SAMPLE_TYPE = 1,
+	PROFILE_SAMPLE = 2,
+	PROFILE_LOCATION = 4,
+	PROFILE_FUNCTION = 5,
+	PROFILE_STRING_TABLE = 6,
+	PROFILE_TIME_NANOS = 9,
+	PROFILE_DURATION_NANOS = 10,
+	VALUE_TYPE_TYPE = 1,
+	VALUE_TYPE_UNIT = 2,
+	SAMPLE_LOCATION_ID = 1,
+	SAMPLE_VALUE = 2,
+	SAMPLE_LABEL = 3,
+	LABEL_KEY = 1,
+	LABEL_STR = 2,
+	LABEL_NUM = 3,
+	LOCATION_ID = 1,
+	LOCATION_ADDRESS = 3,
+	LOCATION_LINE = 4,
+	LINE_FUNCTION_ID = 1,
+	FUNCTION_ID = 1,
+	FUNCTION_NAME = 2,
+	FUNCTION_SYSTEM_NAME = 3,
+};
+
+/*
+ * Per-profile tables. Hash tables are open addressing with linear probing,
+ * kept at most half full, and hold 1-based indexes (0 is an empty slot).
+ */
+struct pprof {
+	struct outbuf samples;	/* encoded Sample messages */
+	struct outbuf tmp;	/* scratch for nested messages */
+	struct outbuf sample, packed;	/* scratch for a Sample and its packed fields */
+
+	struct outbuf strings;	/* "str\0str\0..." */
+	size_t *string_offsets;
+	unsigned n_strings, strings_alloc;
+	unsigned *string_hash, string_hash_size;
+
+	unsigned long *loc_addrs;	/* location id - 1 -> address */
+	unsigned *loc_functions;	/* location id - 1 -> function id */
+	unsigned n_locs, locs_alloc;
+	unsigned *loc_hash, loc_hash_size;
+
+	unsigned *function_names;	/* function id - 1 -> string index */
+	unsigned n_functions, functions_alloc;
+	unsigned *function_hash, function_hash_size; /* keyed by string index */
+};
+
+static struct pprof pp;
+
+static uint64_t hash_bytes(const char *s)
+{
+	uint64_t h = 14695981039346656037ULL;
+
+	while (*s) {
+		h ^= (unsigned char) *s++;
+		h *= 1099511628211ULL;
+	}
+	return h;
+}
+
+static uint64_t hash_u64(uint64_t v)
+{
+	v ^= v >> 33;
+	v *= 0xff51afd7ed558ccdULL;
+	v ^= v >> 33;
+	return v;
+}
+
+static bool grow(void **array, unsigned *alloc, unsigned n, size_t size)
+{
+	void *new_array;
+	unsigned new_alloc;
+
+	if (n < *alloc)
+		return true;
+
+	new_alloc = *alloc ? 2 * *alloc : 256;
+	new_array = realloc(*array, new_alloc * size);
+	if (!new_array)
+		return false;
+
+	*array = new_array;
+	*alloc = new_alloc;
+	return true;
+}
+
+/* makes room for one more entry in the hash table, rehashing if needed */
+static bool grow_hash(unsigned **table, unsigned *size, unsigned n,
+                      uint64_t (*key_hash)(unsigned index))
+{
+	unsigned *new_table, new_size, i, slot;
+
+	if (2 * (n + 1) <= *size)
+		return true;
+
+	new_size = *size ? 2 * *size : 512;
+	new_table = calloc(new_size, sizeof(unsigned));
+	if (!new_table)
+		return false;
+
+	for (i = 0; i < *size; i++) {
+		if (!(*table)[i])
+			continue;
+		slot = key_hash((*table)[i] - 1) & (new_size - 1);
+		while (new_table[slot])
+			slot = (slot + 1) & (new_size - 1);
+		new_table[slot] = (*table)[i];
+	}
+
+	free(*table);
+	*table = new_table;
+	*size = new_size;
+	return true;
+}
+
+static const char *string_at(unsigned index)
+{
+	return pp.strings.data + pp.string_offsets[index];
+}
+
+static uint64_t string_key_hash(unsigned index)
+{
+	return hash_bytes(string_at(index));
+}
+
+static uint64_t loc_key_hash(unsigned index)
+{
+	return hash_u64(pp.loc_addrs[index]);
+}
+
+static uint64_t function_key_hash(unsigned index)
+{
+	return hash_u64(pp.function_names[index]);
+}
+
+/* Returns the string table index of s, adding it if new */
+static unsigned intern_string(const char *s)
+{
+	unsigned slot;
+
+	if (!grow_hash(&pp.string_hash, &pp.string_hash_size, pp.n_strings, string_key_hash) ||
+	    !grow((void**) &pp.string_offsets, &pp.strings_alloc, pp.n_strings, sizeof(size_t)))
+		return 0;
+
+	slot = hash_bytes(s) & (pp.string_hash_size - 1);
+	while (pp.string_hash[slot]) {
+		if (!strcmp(string_at(pp.string_hash[slot] - 1), s))
+			return pp.string_hash[slot] - 1;
+		slot = (slot + 1) & (pp.string_hash_size - 1);
+	}
+
+	pp.string_offsets[pp.n_strings] = pp.strings.len;
+	ob_write(&pp.strings, s, strlen(s) + 1);
+	pp.string_hash[slot] = ++pp.n_strings;
+	return pp.n_strings - 1;
+}
+
+static unsigned intern_function(unsigned name)
+{
+	unsigned slot;
+
+	if (!grow_hash(&pp.function_hash, &pp.function_hash_size, pp.n_functions, function_key_hash) ||
+	    !grow((void**) &pp.function_names, &pp.functions_alloc, pp.n_functions, sizeof(unsigned)))
+		return 0;
+
+	slot = hash_u64(name) & (pp.function_hash_size - 1);
+	while (pp.function_hash[slot]) {
+		if (pp.function_names[pp.function_hash[slot] - 1] == name)
+			return pp.function_hash[slot];
+		slot = (slot + 1) & (pp.function_hash_size - 1);
+	}
+
+	pp.function_names[pp.n_functions] = name;
+	pp.function_hash[slot] = ++pp.n_functions;
+	return pp.n_functions;
+}
+
+/* Returns the location id of the address, adding it if new */
+static unsigned intern_location(unsigned long addr)
+{
+	const char *sym;
+	char hex[24];
+	unsigned slot, function;
+
+	if (!grow_hash(&pp.loc_hash, &pp.loc_hash_size, pp.n_locs, loc_key_hash))
+		return 0;
+
+	if (pp.n_locs == pp.locs_alloc) {
+		unsigned alloc = pp.locs_alloc, *functions;
+
+		if (!grow((void**) &pp.loc_addrs, &alloc, pp.n_locs, sizeof(unsigned long)))
+			return 0;
+		functions = realloc(pp.loc_functions, alloc * sizeof(unsigned));
+		if (!functions)
+			return 0;
+		pp.loc_functions = functions;
+		pp.locs_alloc = alloc;
+	}
+
+	slot = hash_u64(addr) & (pp.loc_hash_size - 1);
+	while (pp.loc_hash[slot]) {
+		if (pp.loc_addrs[pp.loc_hash[slot] - 1] == addr)
+			return pp.loc_hash[slot];
+		slot = (slot + 1) & (pp.loc_hash_size - 1);
+	}
+
+	sym = sym_translator_lookup(addr);
+	if (!sym) {
+		snprintf(hex, sizeof(hex), "0x%lx", addr);
+		sym = hex;
+	}
+	function = intern_function(intern_string(sym));
+
+	pp.loc_addrs[pp.n_locs] = addr;
+	pp.loc_functions[pp.n_locs] = function;
+	pp.loc_hash[slot] = ++pp.n_locs;
+	return pp.n_locs;
+}
+
+static void pprof_reset(void)
+{
+	pp.samples.len = 0;
+	pp.strings.len = 0;
+	pp.n_strings = pp.n_locs = pp.n_functions = 0;
+	if (pp.string_hash)
+		memset(pp.string_hash, 0, pp.string_hash_size * sizeof(unsigned));
+	if (pp.loc_hash)
+		memset(pp.loc_hash, 0, pp.loc_hash_size * sizeof(unsigned));
+	if (pp.function_hash)
+		memset(pp.function_hash, 0, pp.function_hash_size * sizeof(unsigned));
+
+	/* string_table[0] must be "" */
+	intern_string("");
+}
+
+static void pprof_begin(struct outbuf *ob, const struct report_info *ri)
+{
+	pprof_reset();
+}
+
+static void encode_label(struct outbuf *ob, unsigned key, const char *str, int64_t num)
+{
+	pp.tmp.len = 0;
+	pb_uint(&pp.tmp, LABEL_KEY, key);
+	if (str)
+		pb_uint(&pp.tmp, LABEL_STR, intern_string(str));
+	else
+		pb_uint(&pp.tmp, LABEL_NUM, num);
+	pb_bytes(ob, SAMPLE_LABEL, pp.tmp.data, pp.tmp.len);
+}
+
+static void pprof_process(struct outbuf *ob, const struct report_info *ri,
+                          struct process *p)
+{
+	struct outbuf *sample = &pp.sample, *packed = &pp.packed;
+	struct back_trace bt;
+	struct rb_node *node;
+	unsigned i, len;
+	unsigned key_pid = intern_string("pid");
+	unsigned key_tid = intern_string("tid");
+	unsigned key_comm = intern_string("comm");
+
+	for (node = rb_first(&p->bt2la_map); node; node = rb_next(node)) {
+		struct bt2la *bt2la = rb_entry(node, struct bt2la, rb_node);
+
+		/* location ids, leaf first */
+		len = stack_table_get(bt2la->stack_id, &bt);
+		sample->len = 0;
+		packed->len = 0;
+		for (i = 0; i < len; i++)
+			pb_varint(packed, intern_location(bt.trace[i]));
+		pb_bytes(sample, SAMPLE_LOCATION_ID, packed->data, packed->len);
+
+		packed->len = 0;
+		pb_varint(packed, bt2la->la.total);
+		pb_varint(packed, bt2la->la.count);
+		pb_bytes(sample, SAMPLE_VALUE, packed->data, packed->len);
+
+		encode_label(sample, key_pid, NULL, p->pid);
+		encode_label(sample, key_tid, NULL, p->tid);
+		encode_label(sample, key_comm, p->comm, 0);
+
+		pb_bytes(&pp.samples, PROFILE_SAMPLE, sample->data, sample->len);
+	}
+}
+
+static void encode_value_type(struct outbuf *ob, const char *type, const char *unit)
+{
+	pp.tmp.len = 0;
+	pb_uint(&pp.tmp, VALUE_TYPE_TYPE, intern_string(type));
+	pb_uint(&pp.tmp, VALUE_TYPE_UNIT, intern_string(unit));
+	pb_bytes(ob, PROFILE_SAMPLE_TYPE, pp.tmp.data, pp.tmp.len);
+}
+
+static void pprof_end(struct outbuf *ob, const struct report_info *ri)
+{
+	struct outbuf line = {};
+	unsigned i;
+
+	encode_value_type(ob, "latency", "nanoseconds");
+	encode_value_type(ob, "events", "count");
+
+	ob_write(ob, pp.samples.data, pp.samples.len);
+
+	for (i = 0; i < pp.n_locs; i++) {
+		line.len = 0;
+		pb_uint(&line, LINE_FUNCTION_ID, pp.loc_functions[i]);
+
+		pp.tmp.len = 0;
+		pb_uint(&pp.tmp, LOCATION_ID, i + 1);
+		pb_uint(&pp.tmp, LOCATION_ADDRESS, pp.loc_addrs[i]);
+		pb_bytes(&pp.tmp, LOCATION_LINE, line.data, line.len);
+		pb_bytes(ob, PROFILE_LOCATION, pp.tmp.data, pp.tmp.len);
+	}
+	ob_free(&line);
+
+	for (i = 0; i < pp.n_functions; i++) {
+		pp.tmp.len = 0;
+		pb_uint(&pp.tmp, FUNCTION_ID, i + 1);
+		pb_uint(&pp.tmp, FUNCTION_NAME, pp.function_names[i]);
+		pb_uint(&pp.tmp, FUNCTION_SYSTEM_NAME, pp.function_names[i]);
+		pb_bytes(ob, PROFILE_FUNCTION, pp.tmp.data, pp.tmp.len);
+	}
+
+	/* no more strings can be added from here on */
+	for (i = 0; i < pp.n_strings; i++)
+		pb_bytes(ob, PROFILE_STRING_TABLE, string_at(i), strlen(string_at(i)));
+
+	pb_uint(ob, PROFILE_TIME_NANOS, (uint64_t) ri->time * NSEC_PER_SEC);
+	pb_uint(ob, PROFILE_DURATION_NANOS, arg_interval_ms * NSEC_PER_MSEC);
+}
+
+/* Every interval replaces the output file, atomically */
+int replace_output_file(struct outbuf *ob)
+{
+	char *tmp;
+	int fd, r;
+
+	if (asprintf(&tmp, "%s.tmp", arg_output) < 0)
+		return -ENOMEM;
+
+	fd = open(tmp, O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC, 0644);
+	if (fd < 0) {
+		r = -errno;
+		goto out;
+	}
+
+	r = ob_flush(ob, fd);
+	if (close(fd) < 0 && r == 0)
+		r = -errno;
+	if (r == 0 && rename(tmp, arg_output) < 0)
+		r = -errno;
+	if (r < 0)
+		unlink(tmp);
+out:
+	ob->len = 0;
+	free(tmp);
+	return r;
+}
+
+const struct report_writer pprof_writer = {
+	.begin = pprof_begin,
+	.process = pprof_process,
+	.end = pprof_end,
+	.flush = replace_output_file,
+};
+
+void profile_writer_fini(void)
+{
+	ob_free(&pp.samples);
+	ob_free(&pp.tmp);
+	ob_free(&pp.sample);
+	ob_free(&pp.packed);
+	ob_free(&pp.strings);
+	free(pp.string_offsets);
+	free(pp.string_hash);
+	free(pp.loc_addrs);
+	free(pp.loc_functions);
+	free(pp.loc_hash);
+	free(pp.function_names);
+	free(pp.function_hash);
+	memset(&pp, 0, sizeof(pp));
+}
@@ -0,0 +1,982 @@
+/*
+ * Recording of the intervals into an append-only file, and reports from it.
+ *
+ * The file starts with a header, then come records: a type byte, the
+ * length of the payload and the payload. Numbers are LEB128 varints,
+ * signed ones zigzag encoded, and mostly deltas:
+ *
+ *   DICT      the comms, symbols and stacks first used by the following
+ *             intervals. Their ids are implicit, counted from 0 through
+ *             all the DICTs of the file.
+ *   INTERVAL  the accounts of one interval, by thread and stack id, with
+ *             their exemplars since version 2 and split by the sleep or
+ *             block state since version 3
+ *   INDEX     ends every batch: the offsets of the batch's DICT and
+ *             INTERVALs with their times, and the offset of the previous
+ *             INDEX
+ *
+ * The header points to the last INDEX, so a reader finds all records by
+ * following the chain and decodes only the intervals it is asked for.
+ * A batch written before a crash, but not linked from the header, is
+ * found by scanning the short tail after the last linked INDEX.
+ * A restarted writer appends after the last complete batch and counts
+ * the dictionary ids on.
+ *
+ * Copyright 2026 agent
+ * Author: agent <agent@local>
+ * License: GPLv2
+ */
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <endian.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "recording.h"
+
+#include "array.h"
+#include "filter.h"
+#include "fnv1a.h"
+#include "governor.h"
+#include "lat_translator.h"
+#include "lattop.h"
+#include "outbuf.h"
+#include "process.h"
+#include "process_accountant.h"
+#include "stack_table.h"
+#include "sym_translator.h"
+
+#define REC_MAGIC "LATTOPRC"
+#define REC_VERSION 3
+/* without the exemplars and the states */
+#define REC_VERSION_MIN 1
+/* magic[8], le32 version, le32 header size, le64 last INDEX, le64 creation time */
+#define REC_HEADER_SIZE 64
+#define REC_LAST_INDEX_OFF 16
+
+enum {
+	REC_DICT = 1,
+	REC_INTERVAL,
+	REC_INDEX,
+};
+
+/* a batch is written when either is reached */
+#define BATCH_INTERVALS 16
+#define BATCH_BYTES (256*1024)
+
+static void put_varint(struct outbuf *ob, uint64_t v)
+{
+	while (v >= 0x80) {
+		ob_putc(ob, (v & 0x7f) | 0x80);
+		v >>= 7;
+	}
+	ob_putc(ob, v);
+}
+
+static void put_svarint(struct outbuf *ob, int64_t v)
+{
+	put_varint(ob, ((uint64_t) v << 1) ^ (uint64_t) (v >> 63));
+}
+
+static void put_record(struct outbuf *ob, unsigned type, const struct outbuf *payload)
+{
+	ob_putc(ob, type);
+	put_varint(ob, payload->len);
+	ob_write(ob, payload->data, payload->len);
+}
+
+/*
+ * The writer.
+ */
+
+static int rec_fd = -1;
+static const char *rec_path;
+static uint64_t file_end, last_index;
+
+/* the pending DICT, in parts because it starts with the counts */
+static struct outbuf new_comms, new_symbols, new_stacks;
+static unsigned nr_new_comms, nr_new_symbols, nr_new_stacks;
+static unsigned long prev_symbol, prev_ip;
+
+/* the pending INTERVAL records and their times and offsets in it */
+static struct outbuf intervals;
+static time_t interval_time[BATCH_INTERVALS];
+static size_t interval_pos[BATCH_INTERVALS];
+static unsigned nr_intervals;
+
+static struct outbuf batch, scratch, threads;
+static int rec_error;	/* of the interval being added */
+
+/* file ids + 1, by symbol index and stack table id */
+static uint32_t *symbol_ids, *stack_ids;
+static unsigned symbol_ids_len, stack_ids_len;
+static unsigned nr_symbols, nr_stacks;
+
+/* comms, open addressing, at most half full */
+struct comm_slot {
+	char comm[16];
+	uint32_t id;	/* + 1, 0 if empty */
+};
+static struct comm_slot *comm_slots;
+static unsigned nr_comm_slots, nr_comms;
+/* the comms of the file before a restart, not in the slots */
+static unsigned first_comm;
+
+static unsigned comm_hash(const char comm[16])
+{
+	return fnv1a_bytes(comm, strnlen(comm, 16));
+}
+
+static struct comm_slot *find_comm(const char comm[16])
+{
+	unsigned i = comm_hash(comm) & (nr_comm_slots - 1);
+
+	while (comm_slots[i].id && strncmp(comm_slots[i].comm, comm, 16))
+		i = (i + 1) & (nr_comm_slots - 1);
+	return &comm_slots[i];
+}
+
+static int grow_comms(void)
+{
+	struct comm_slot *old = comm_slots, *s;
+	unsigned old_nr = nr_comm_slots, i;
+
+	nr_comm_slots = old_nr ? old_nr * 2 : 256;
+	comm_slots = calloc(nr_comm_slots, sizeof(struct comm_slot));
+	if (!comm_slots) {
+		comm_slots = old;
+		nr_comm_slots = old_nr;
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < old_nr; i++) {
+		if (!old[i].id)
+			continue;
+		s = find_comm(old[i].comm);
+		*s = old[i];
+	}
+	free(old);
+	return 0;
+}
+
+static uint32_t comm_id(const char comm[16])
+{
+	struct comm_slot *s;
+	size_t len = strnlen(comm, 15);
+
+	if (2 * (nr_comms + 1) > nr_comm_slots && grow_comms() < 0) {
+		rec_error = -ENOMEM;
+		return 0;
+	}
+
+	s = find_comm(comm);
+	if (!s->id) {
+		memcpy(s->comm, comm, len);
+		s->comm[len] = '\0';
+		s->id = ++nr_comms;
+		put_varint(&new_comms, len);
+		ob_write(&new_comms, comm, len);
+		nr_new_comms++;
+	}
+	return first_comm + s->id - 1;
+}
+
+static void add_symbol(unsigned long ip)
+{
+	const char *name;
+	int index;
+
+	index = sym_translator_lookup_index(ip);
+	if (index < 0 || grow_array(&symbol_ids, &symbol_ids_len, index, sizeof(uint32_t)) < 0 ||
+	    symbol_ids[index])
+		return;
+
+	symbol_ids[index] = ++nr_symbols;
+	name = sym_translator_name(index);
+	put_svarint(&new_symbols, sym_translator_addr(index) - prev_symbol);
+	prev_symbol = sym_translator_addr(index);
+	put_varint(&new_symbols, strlen(name));
+	ob_puts(&new_symbols, name);
+	nr_new_symbols++;
+}
+
+static uint32_t stack_file_id(int id)
+{
+	struct back_trace bt;
+	unsigned i, n;
+	bool cached = grow_array(&stack_ids, &stack_ids_len, id, sizeof(uint32_t)) == 0;
+
+	if (cached && stack_ids[id])
+		return stack_ids[id] - 1;
+
+	n = stack_table_get(id, &bt);
+	put_varint(&new_stacks, n);
+	for (i = 0; i < n; i++) {
+		put_svarint(&new_stacks, bt.trace[i] - prev_ip);
+		prev_ip = bt.trace[i];
+		add_symbol(bt.trace[i]);
+	}
+	nr_new_stacks++;
+
+	if (cached)
+		stack_ids[id] = nr_stacks + 1;
+	return nr_stacks++;
+}
+
+struct threads_state {
+	unsigned nr_threads;
+	pid_t prev_pid;
+};
+
+static void add_process(struct process *p, void *userdata)
+{
+	struct threads_state *ts = userdata;
+	struct rb_node *node;
+	uint32_t stack, prev_stack = 0;
+	unsigned i, mask;
+
+	ts->nr_threads++;
+	put_svarint(&threads, p->pid - ts->prev_pid);
+	put_svarint(&threads, p->tid - p->pid);
+	put_varint(&threads, comm_id(p->comm));
+	put_varint(&threads, p->bt2la_count);
+	ts->prev_pid = p->pid;
+
+	for (node = rb_first(&p->bt2la_map); node; node = rb_next(node)) {
+		struct bt2la *b = rb_entry(node, struct bt2la, rb_node);
+
+		stack = stack_file_id(b->stack_id);
+		put_svarint(&threads, (int64_t) stack - prev_stack);
+		prev_stack = stack;
+		put_varint(&threads, b->la.count);
+		put_varint(&threads, b->la.total);
+		put_varint(&threads, b->la.max);
+
+		for (i = 0, mask = 0; i < LA_HIST_BUCKETS; i++)
+			if (b->la.hist[i])
+				mask |= 1U << i;
+		put_varint(&threads, mask);
+		for (i = 0; i < LA_HIST_BUCKETS; i++)
+			if (b->la.hist[i])
+				put_varint(&threads, b->la.hist[i]);
+
+		put_varint(&threads, b->la.n_exemplars);
+		for (i = 0; i < b->la.n_exemplars; i++) {
+			const struct la_event *ev = &b->la.exemplars[i];
+
+			put_varint(&threads, ev->time);
+			put_varint(&threads, ev->delay);
+			put_svarint(&threads, ev->tid - p->tid);
+			put_varint(&threads, ev->cpu);
+			put_varint(&threads, ev->type);
+		}
+
+		for (i = 0; i < _LA_NR_STATES; i++) {
+			put_varint(&threads, b->la.state_count[i]);
+			put_varint(&threads, b->la.state_total[i]);
+			put_varint(&threads, b->la.state_max[i]);
+		}
+	}
+}
+
+static int write_all(int fd, const char *data, size_t len)
+{
+	ssize_t n;
+
+	while (len) {
+		n = write(fd, data, len);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+		data += n;
+		len -= n;
+	}
+	return 0;
+}
+
+static void put_le64(char *p, uint64_t v)
+{
+	v = htole64(v);
+	memcpy(p, &v, sizeof(v));
+}
+
+static int flush_batch(void)
+{
+	uint64_t dict_off = 0, base, prev;
+	char le[8];
+	unsigned i;
+	int r;
+
+	if (!nr_intervals)
+		return 0;
+
+	batch.len = 0;
+	if (nr_new_comms || nr_new_symbols || nr_new_stacks) {
+		scratch.len = 0;
+		put_varint(&scratch, nr_new_comms);
+		ob_write(&scratch, new_comms.data, new_comms.len);
+		put_varint(&scratch, nr_new_symbols);
+		ob_write(&scratch, new_symbols.data, new_symbols.len);
+		put_varint(&scratch, nr_new_stacks);
+		ob_write(&scratch, new_stacks.data, new_stacks.len);
+		dict_off = file_end;
+		put_record(&batch, REC_DICT, &scratch);
+	}
+
+	base = file_end + batch.len;
+	ob_write(&batch, intervals.data, intervals.len);
+
+	scratch.len = 0;
+	put_varint(&scratch, last_index);
+	put_varint(&scratch, dict_off ? 1 : 0);
+	if (dict_off)
+		put_varint(&scratch, dict_off);
+	put_varint(&scratch, nr_intervals);
+	for (i = 0, prev = 0; i < nr_intervals; i++) {
+		put_svarint(&scratch, interval_time[i] - (i ? interval_time[i-1] : 0));
+		put_varint(&scratch, base + interval_pos[i] - prev);
+		prev = base + interval_pos[i];
+	}
+	last_index = file_end + batch.len;
+	put_record(&batch, REC_INDEX, &scratch);
+
+	if (batch.error || scratch.error)
+		return -ENOMEM;
+	r = write_all(rec_fd, batch.data, batch.len);
+	if (r < 0)
+		return r;
+	file_end += batch.len;
+
+	put_le64(le, last_index);
+	if (pwrite(rec_fd, le, sizeof(le), REC_LAST_INDEX_OFF) != sizeof(le))
+		return -errno;
+
+	new_comms.len = new_symbols.len = new_stacks.len = intervals.len = 0;
+	nr_new_comms = nr_new_symbols = nr_new_stacks = nr_intervals = 0;
+	prev_symbol = prev_ip = 0;
+	return 0;
+}
+
+static void recording_failed(int r)
+{
+	fprintf(stderr, "Recording into %s failed: %s\n", rec_path, strerror(-r));
+	close(rec_fd);
+	rec_fd = -1;
+}
+
+void recording_add_interval(void)
+{
+	struct threads_state ts = {};
+	int r;
+
+	if (rec_fd < 0)
+		return;
+
+	threads.len = 0;
+	rec_error = 0;
+	pa_for_each_process(add_process, &ts);
+	if (rec_error || threads.error || new_comms.error || new_symbols.error || new_stacks.error) {
+		recording_failed(-ENOMEM);
+		return;
+	}
+
+	scratch.len = 0;
+	interval_time[nr_intervals] = time(NULL);
+	put_varint(&scratch, interval_time[nr_intervals]);
+	put_varint(&scratch, arg_interval_ms);
+	put_varint(&scratch, governor_sample_factor());
+	put_varint(&scratch, ts.nr_threads);
+	ob_write(&scratch, threads.data, threads.len);
+	interval_pos[nr_intervals++] = intervals.len;
+	put_record(&intervals, REC_INTERVAL, &scratch);
+
+	if (nr_intervals < BATCH_INTERVALS &&
+	    intervals.len + new_stacks.len + new_symbols.len < BATCH_BYTES)
+		return;
+
+	r = flush_batch();
+	if (r < 0)
+		recording_failed(r);
+}
+
+static int recording_resume(uint64_t size);
+
+int recording_open(const char *path)
+{
+	char header[REC_HEADER_SIZE] = REC_MAGIC;
+	struct stat st;
+	uint32_t le;
+	int r;
+
+	rec_path = path;
+	rec_fd = open(path, O_RDWR|O_CREAT|O_CLOEXEC, 0644);
+	if (rec_fd < 0 || fstat(rec_fd, &st) < 0) {
+		r = -errno;
+		fprintf(stderr, "Cannot create %s: %s\n", path, strerror(errno));
+		if (rec_fd >= 0)
+			close(rec_fd);
+		rec_fd = -1;
+		return r;
+	}
+
+	/* a restarted lattop appends to its earlier recording */
+	if (st.st_size) {
+		r = recording_resume(st.st_size);
+		if (r < 0) {
+			close(rec_fd);
+			rec_fd = -1;
+		}
+		return r;
+	}
+
+	le = htole32(REC_VERSION);
+	memcpy(header + 8, &le, 4);
+	le = htole32(REC_HEADER_SIZE);
+	memcpy(header + 12, &le, 4);
+	put_le64(header + 24, time(NULL));
+
+	r = write_all(rec_fd, header, sizeof(header));
+	if (r < 0) {
+		recording_failed(r);
+		return r;
+	}
+	file_end = REC_HEADER_SIZE;
+	return 0;
+}
+
+void recording_close(void)
+{
+	int r;
+
+	if (rec_fd >= 0) {
+		r = flush_batch();
+		if (r < 0)
+			recording_failed(r);
+		else
+			close(rec_fd);
+		rec_fd = -1;
+	}
+
+	ob_free(&new_comms);
+	ob_free(&new_symbols);
+	ob_free(&new_stacks);
+	ob_free(&intervals);
+	ob_free(&batch);
+	ob_free(&scratch);
+	ob_free(&threads);
+	free(symbol_ids);
+	free(stack_ids);
+	free(comm_slots);
+	symbol_ids = stack_ids = NULL;
+	comm_slots = NULL;
+}
+
+/*
+ * The reader.
+ */
+
+struct rec_interval {
+	time_t time;
+	uint64_t off;
+};
+
+struct recording {
+	const char *path;
+	const uint8_t *map;
+	size_t len;
+	unsigned version;
+
+	uint64_t *dicts;
+	unsigned nr_dicts, dicts_alloc;
+	struct rec_interval *intervals;
+	unsigned nr_intervals, intervals_alloc;
+
+	char (*comms)[16];
+	unsigned nr_comms, comms_alloc;
+	int *stacks;		/* stack table ids */
+	unsigned nr_stacks, stacks_alloc;
+};
+
+struct cursor {
+	const uint8_t *p, *end;
+	bool bad;
+};
+
+static uint64_t get_varint(struct cursor *c)
+{
+	uint64_t v = 0;
+	unsigned shift;
+
+	for (shift = 0; shift < 64; shift += 7) {
+		if (c->p >= c->end)
+			break;
+		v |= (uint64_t) (*c->p & 0x7f) << shift;
+		if (!(*c->p++ & 0x80))
+			return v;
+	}
+	c->bad = true;
+	return 0;
+}
+
+static int64_t get_svarint(struct cursor *c)
+{
+	uint64_t v = get_varint(c);
+
+	return (v >> 1) ^ -(v & 1);
+}
+
+/* Parses the record at off, returns its end or 0 if it is cut off */
+static uint64_t get_record(const struct recording *r, uint64_t off,
+                           unsigned *type, struct cursor *payload)
+{
+	struct cursor c = { r->map + off, r->map + r->len };
+	uint64_t len;
+
+	if (off >= r->len)
+		return 0;
+	*type = *c.p++;
+	len = get_varint(&c);
+	if (c.bad || len > (uint64_t) (c.end - c.p))
+		return 0;
+
+	payload->p = c.p;
+	payload->end = c.p + len;
+	payload->bad = false;
+	return payload->end - r->map;
+}
+
+static int add_dict_off(struct recording *r, uint64_t off)
+{
+	if (grow_array(&r->dicts, &r->dicts_alloc, r->nr_dicts, sizeof(*r->dicts)) < 0)
+		return -ENOMEM;
+	r->dicts[r->nr_dicts++] = off;
+	return 0;
+}
+
+static int add_interval_off(struct recording *r, time_t t, uint64_t off)
+{
+	if (grow_array(&r->intervals, &r->intervals_alloc, r->nr_intervals,
+		       sizeof(*r->intervals)) < 0)
+		return -ENOMEM;
+	r->intervals[r->nr_intervals].time = t;
+	r->intervals[r->nr_intervals++].off = off;
+	return 0;
+}
+
+/* Collects the offsets from an INDEX, returns the previous INDEX */
+static int64_t read_index(struct recording *r, struct cursor *c)
+{
+	uint64_t prev, n, i, off = 0;
+	time_t t = 0;
+	int ret = 0;
+
+	prev = get_varint(c);
+	for (n = get_varint(c), i = 0; i < n && !c->bad && !ret; i++)
+		ret = add_dict_off(r, get_varint(c));
+	for (n = get_varint(c), i = 0; i < n && !c->bad && !ret; i++) {
+		t += get_svarint(c);
+		off += get_varint(c);
+		ret = add_interval_off(r, t, off);
+	}
+
+	if (ret)
+		return ret;
+	return c->bad ? -EBADMSG : (int64_t) prev;
+}
+
+static int read_dict(struct recording *r, struct cursor *c)
+{
+	unsigned long addr = 0, ip = 0;
+	uint64_t n, i, j, len, frames;
+	struct back_trace bt;
+	char name[1024];
+	int ret;
+
+	for (n = get_varint(c), i = 0; i < n && !c->bad; i++) {
+		if (grow_array(&r->comms, &r->comms_alloc, r->nr_comms, 16) < 0)
+			return -ENOMEM;
+		len = get_varint(c);
+		if (len > 15 || len > c->end - c->p)
+			return -EBADMSG;
+		memcpy(r->comms[r->nr_comms], c->p, len);
+		r->comms[r->nr_comms++][len] = '\0';
+		c->p += len;
+	}
+
+	for (n = get_varint(c), i = 0; i < n && !c->bad; i++) {
+		addr += get_svarint(c);
+		len = get_varint(c);
+		if (len >= sizeof(name) || len > c->end - c->p)
+			return -EBADMSG;
+		memcpy(name, c->p, len);
+		name[len] = '\0';
+		c->p += len;
+		ret = sym_translator_add(addr, name);
+		if (ret < 0)
+			return ret;
+	}
+
+	for (n = get_varint(c), i = 0; i < n && !c->bad; i++) {
+		if (grow_array(&r->stacks, &r->stacks_alloc, r->nr_stacks, sizeof(int)) < 0)
+			return -ENOMEM;
+		memset(&bt, 0, sizeof(bt));
+		for (frames = get_varint(c), j = 0; j < frames && !c->bad; j++) {
+			ip += get_svarint(c);
+			if (j < MAX_BT_LEN)
+				bt.trace[j] = ip;
+		}
+		ret = stack_table_intern(&bt);
+		if (ret < 0)
+			return ret;
+		r->stacks[r->nr_stacks++] = ret;
+	}
+
+	return c->bad ? -EBADMSG : 0;
+}
+
+static int compare_offsets(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t*) a, y = *(const uint64_t*) b;
+
+	return x < y ? -1 : x > y;
+}
+
+static int compare_intervals(const void *a, const void *b)
+{
+	const struct rec_interval *x = a, *y = b;
+
+	if (x->time != y->time)
+		return x->time < y->time ? -1 : 1;
+	return compare_offsets(&x->off, &y->off);
+}
+
+static void recording_unload(struct recording *r)
+{
+	if (r->map)
+		munmap((void*) r->map, r->len);
+	free(r->dicts);
+	free(r->intervals);
+	free(r->comms);
+	free(r->stacks);
+}
+
+static int recording_load(struct recording *r, const char *path)
+{
+	struct cursor c;
+	struct stat st;
+	uint64_t tail = REC_HEADER_SIZE, index, end, off;
+	int64_t prev;
+	unsigned type, i;
+	int fd, ret;
+
+	memset(r, 0, sizeof(*r));
+	r->path = path;
+
+	fd = open(path, O_RDONLY|O_CLOEXEC);
+	if (fd < 0 || fstat(fd, &st) < 0) {
+		ret = -errno;
+		goto err;
+	}
+	ret = -EBADMSG;
+	if (st.st_size < REC_HEADER_SIZE)
+		goto err;
+	r->map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (r->map == MAP_FAILED) {
+		r->map = NULL;
+		ret = -errno;
+		goto err;
+	}
+	r->len = st.st_size;
+	close(fd);
+	fd = -1;
+
+	r->version = le32toh(*(uint32_t*) (r->map + 8));
+	if (memcmp(r->map, REC_MAGIC, 8) || r->version < REC_VERSION_MIN || r->version > REC_VERSION)
+		goto err;
+
+	/* the chain of INDEXes, from the last one */
+	index = le64toh(*(uint64_t*) (r->map + REC_LAST_INDEX_OFF));
+	while (index) {
+		end = get_record(r, index, &type, &c);
+		if (!end || type != REC_INDEX)
+			goto err;
+		if (tail == REC_HEADER_SIZE)
+			tail = end;
+		prev = read_index(r, &c);
+		if (prev < 0) {
+			ret = prev;
+			goto err;
+		}
+		/* the chain goes back in the file, it cannot loop */
+		if (prev >= index)
+			goto err;
+		index = prev;
+	}
+
+	/* batches that did not make it into the header */
+	for (off = tail; off < r->len; off = end) {
+		end = get_record(r, off, &type, &c);
+		if (!end) {
+			fprintf(stderr, "%s: ignoring a cut off record at offset %llu\n",
+			        path, (unsigned long long) off);
+			break;
+		}
+		if (type == REC_DICT)
+			ret = add_dict_off(r, off);
+		else if (type == REC_INTERVAL)
+			ret = add_interval_off(r, get_varint(&c), off);
+		else
+			ret = 0;
+		if (ret < 0)
+			goto err;
+	}
+
+	/* the DICTs in file order, their ids are implicit */
+	qsort(r->dicts, r->nr_dicts, sizeof(uint64_t), compare_offsets);
+	for (i = 0; i < r->nr_dicts; i++) {
+		ret = -EBADMSG;
+		if (!get_record(r, r->dicts[i], &type, &c) || type != REC_DICT)
+			goto err;
+		ret = read_dict(r, &c);
+		if (ret < 0)
+			goto err;
+	}
+	qsort(r->intervals, r->nr_intervals, sizeof(struct rec_interval), compare_intervals);
+	return 0;
+
+err:
+	fprintf(stderr, "Cannot read the recording %s: %s\n", path,
+	        strerror(ret == -EBADMSG ? EINVAL : -ret));
+	if (fd >= 0)
+		close(fd);
+	recording_unload(r);
+	memset(r, 0, sizeof(*r));
+	return ret;
+}
+
+/* Skips the entries of a DICT, counting them into the ids */
+static void count_dict(struct cursor *c, unsigned *comms, unsigned *symbols, unsigned *stacks)
+{
+	uint64_t n, i, j, len;
+
+	for (n = get_varint(c), i = 0; i < n && !c->bad; i++, ++*comms) {
+		len = get_varint(c);
+		if (len > (uint64_t) (c->end - c->p))
+			c->bad = true;
+		else
+			c->p += len;
+	}
+	for (n = get_varint(c), i = 0; i < n && !c->bad; i++, ++*symbols) {
+		get_svarint(c);
+		len = get_varint(c);
+		if (len > (uint64_t) (c->end - c->p))
+			c->bad = true;
+		else
+			c->p += len;
+	}
+	for (n = get_varint(c), i = 0; i < n && !c->bad; i++, ++*stacks)
+		for (len = get_varint(c), j = 0; j < len && !c->bad; j++)
+			get_svarint(c);
+}
+
+/*
+ * The writer continues the recording open in rec_fd after its last
+ * complete batch, with the dictionary ids counted on from the ones in
+ * the file. Records after the last INDEX are a batch cut off by a crash,
+ * they are dropped.
+ */
+static int recording_resume(uint64_t size)
+{
+	struct recording r = { .path = rec_path, .len = size };
+	unsigned type, comms = 0, symbols = 0, stacks = 0;
+	uint64_t off, end;
+	struct cursor c;
+	char le[8];
+	int ret = -EBADMSG;
+
+	if (size < REC_HEADER_SIZE)
+		goto err;
+	r.map = mmap(NULL, size, PROT_READ, MAP_SHARED, rec_fd, 0);
+	if (r.map == MAP_FAILED) {
+		r.map = NULL;
+		ret = -errno;
+		goto err;
+	}
+	if (memcmp(r.map, REC_MAGIC, 8))
+		goto err;
+	r.version = le32toh(*(uint32_t*) (r.map + 8));
+	if (r.version != REC_VERSION) {
+		fprintf(stderr, "%s is a version %u recording, lattop appends to version %u only.\n",
+		        rec_path, r.version, REC_VERSION);
+		munmap((void*) r.map, size);
+		return -EINVAL;
+	}
+
+	file_end = REC_HEADER_SIZE;
+	last_index = 0;
+	for (off = REC_HEADER_SIZE; off < size; off = end) {
+		end = get_record(&r, off, &type, &c);
+		if (!end)
+			break;
+		if (type == REC_DICT) {
+			count_dict(&c, &comms, &symbols, &stacks);
+			if (c.bad)
+				goto err;
+		} else if (type == REC_INDEX) {
+			file_end = end;
+			last_index = off;
+			first_comm = comms;
+			nr_symbols = symbols;
+			nr_stacks = stacks;
+		}
+	}
+	munmap((void*) r.map, size);
+	r.map = NULL;
+
+	if (file_end < size) {
+		fprintf(stderr, "%s: dropping a cut off batch at offset %llu\n",
+		        rec_path, (unsigned long long) file_end);
+		if (ftruncate(rec_fd, file_end) < 0)
+			goto err_errno;
+	}
+	/* the last batch may not have been linked from the header */
+	put_le64(le, last_index);
+	if (pwrite(rec_fd, le, sizeof(le), REC_LAST_INDEX_OFF) != sizeof(le) ||
+	    lseek(rec_fd, file_end, SEEK_SET) < 0)
+		goto err_errno;
+	return 0;
+
+err_errno:
+	ret = -errno;
+err:
+	if (r.map)
+		munmap((void*) r.map, size);
+	fprintf(stderr, "Cannot append to %s: %s\n", rec_path,
+	        ret == -EBADMSG ? "not a lattop recording" : strerror(-ret));
+	return ret;
+}
+
+/* Feeds an interval's accounts of the filtered threads to the accountant */
+static int replay_interval(struct recording *r, uint64_t off)
+{
+	struct latency_account la;
+	struct cursor c;
+	uint64_t nr_threads, nr_accounts, t, a, comm, stack;
+	unsigned type, sample_factor, i, mask, n;
+	pid_t pid = 0, tid;
+	bool match;
+
+	if (!get_record(r, off, &type, &c) || type != REC_INTERVAL)
+		return -EBADMSG;
+
+	get_varint(&c);		/* time */
+	get_varint(&c);		/* interval length */
+	sample_factor = get_varint(&c);
+	nr_threads = get_varint(&c);
+
+	for (t = 0; t < nr_threads && !c.bad; t++) {
+		pid += get_svarint(&c);
+		tid = pid + get_svarint(&c);
+		comm = get_varint(&c);
+		nr_accounts = get_varint(&c);
+		if (comm >= r->nr_comms)
+			return -EBADMSG;
+		match = filter_match(pid, r->comms[comm]);
+
+		for (a = 0, stack = 0; a < nr_accounts && !c.bad; a++) {
+			stack += get_svarint(&c);
+			la.count = get_varint(&c);
+			la.total = get_varint(&c);
+			la.max = get_varint(&c);
+			mask = get_varint(&c);
+			for (i = 0; i < LA_HIST_BUCKETS; i++)
+				la.hist[i] = mask & (1U << i) ? get_varint(&c) : 0;
+			n = r->version >= 2 ? get_varint(&c) : 0;
+			if (n > LA_EXEMPLARS)
+				return -EBADMSG;
+			la.n_exemplars = n;
+			for (i = 0; i < n; i++) {
+				la.exemplars[i].time = get_varint(&c);
+				la.exemplars[i].delay = get_varint(&c);
+				la.exemplars[i].tid = tid + get_svarint(&c);
+				la.exemplars[i].cpu = get_varint(&c);
+				la.exemplars[i].type = get_varint(&c);
+			}
+			for (i = 0; i < _LA_NR_STATES; i++) {
+				la.state_count[i] = r->version >= 3 ? get_varint(&c) : 0;
+				la.state_total[i] = r->version >= 3 ? get_varint(&c) : 0;
+				la.state_max[i] = r->version >= 3 ? get_varint(&c) : 0;
+			}
+			if (stack >= r->nr_stacks)
+				return -EBADMSG;
+
+			if (match)
+				pa_account_merge(pid, tid, r->comms[comm], r->stacks[stack],
+				                 &la, sample_factor);
+		}
+	}
+
+	return c.bad ? -EBADMSG : 0;
+}
+
+int recording_report(const char *path, time_t from, time_t to)
+{
+	struct recording rec;
+	unsigned lo, hi, mid, n = 0;
+	int r;
+
+	if (lat_translator_init() < 0)
+		fprintf(stderr, "Warning: Failed to load latencytop translations.\n");
+
+	r = recording_load(&rec, path);
+	if (r < 0)
+		goto out;
+
+	/* an empty recording has no symbols */
+	if (rec.nr_stacks) {
+		r = sym_translator_build();
+		if (r < 0) {
+			fprintf(stderr, "Failed to init the symbol map.\n");
+			goto out;
+		}
+	}
+
+	r = pa_init();
+	if (r < 0)
+		goto out;
+
+	for (lo = 0, hi = rec.nr_intervals; lo < hi; ) {
+		mid = (lo + hi) / 2;
+		if (rec.intervals[mid].time < from)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	for (; lo < rec.nr_intervals && rec.intervals[lo].time <= to; lo++, n++) {
+		r = replay_interval(&rec, rec.intervals[lo].off);
+		if (r < 0) {
+			fprintf(stderr, "%s: corrupted interval at offset %llu\n",
+			        path, (unsigned long long) rec.intervals[lo].off);
+			break;
+		}
+		pa_dump_and_clear_at(rec.intervals[lo].time);
+	}
+	if (!n)
+		fprintf(stderr, "No intervals recorded in the time range.\n");
+
+	pa_fini();
+out:
+	recording_unload(&rec);
+	sym_translator_fini();
+	lat_translator_fini();
+	return r;
+}
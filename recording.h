@@ -0,0 +1,21 @@
+/*
+ * Copyright 2026 agent
+ * Author: agent <agent@local>
+ * License: GPLv2
+ */
+#ifndef _RECORDING_H
+#define _RECORDING_H
+
+#include <time.h>
+
+/* Starts recording into path, replacing the file. Returns 0 or -errno. */
+int  recording_open(const char *path);
+/* Appends the interval's latencies, written out in batches */
+void recording_add_interval(void);
+/* Writes the pending intervals */
+void recording_close(void);
+
+/* Prints the reports of the recorded intervals that ended between from and to */
+int  recording_report(const char *path, time_t from, time_t to);
+
+#endif
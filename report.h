@@ -0,0 +1,57 @@
+/*
+ * Copyright 2026 agent
+ * Author: agent <agent@local>
+ * License: GPLv2
+ */
+#ifndef _REPORT_H
+#define _REPORT_H
+
+#include <time.h>
+
+#include "outbuf.h"
+#include "process.h"
+
+struct report_info {
+	time_t time;		/* end of the interval */
+	unsigned long seq;	/* number of the interval, from 0 */
+	unsigned sample_factor;	/* the highest during the interval */
+	enum sort_by sort;
+	bool reverse;
+};
+
+/*
+ * A report writer renders one interval into the output buffer.
+ * Processes are passed in the sort order, already summarized.
+ * Without a flush op, the buffer is appended to the output.
+ */
+struct report_writer {
+	void (*begin)(struct outbuf *ob, const struct report_info *ri);
+	void (*process)(struct outbuf *ob, const struct report_info *ri,
+	                struct process *p);
+	void (*end)(struct outbuf *ob, const struct report_info *ri);
+	int  (*flush)(struct outbuf *ob);
+};
+
+extern const struct report_writer text_writer;
+extern const struct report_writer json_writer;
+extern const struct report_writer csv_writer;
+extern const struct report_writer folded_writer;
+extern const struct report_writer pprof_writer;
+extern const struct report_writer snapshot_writer;
+extern const struct report_writer tree_writer;
+extern const struct report_writer callers_writer;
+/* Compares to the baseline of --diff, in the text or json format */
+extern const struct report_writer diff_writer;
+
+/* Renders the processes (not summarized yet) as one report into ob */
+void pa_render_report(struct outbuf *ob, const struct report_info *ri,
+                      enum output_format format,
+                      struct process **array, unsigned n);
+
+/* A flush op writing the buffer as the whole --output file, replaced atomically */
+int  replace_output_file(struct outbuf *ob);
+
+void profile_writer_fini(void);
+void call_tree_fini(void);
+
+#endif
@@ -0,0 +1,345 @@
+/*
+ * Copyright 2026 agent
+ * Author: agent <agent@local>
+ * License: GPLv2
+ */
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "screen.h"
+
+#include "outbuf.h"
+
+/* cursor movement costs about as much as rewriting this many cells */
+#define MAX_SKIP 4
+
+struct cell {
+	char ch;
+	unsigned char attr;
+};
+
+static bool active;
+static struct termios orig_termios;
+static unsigned rows, cols;
+static struct cell *front;	/* what the terminal shows */
+static struct cell *back;	/* what it should show */
+static bool full_redraw;
+static unsigned char term_attr;
+static struct outbuf out;
+
+/* stderr goes to a temporary file while the screen is active */
+static int saved_stderr = -1;
+static int msg_fd = -1;
+static off_t msg_size;
+static char last_msg[256];
+
+static void put_str(const char *s)
+{
+	ob_puts(&out, s);
+}
+
+static int write_now(const char *s)
+{
+	put_str(s);
+	return ob_flush(&out, STDOUT_FILENO);
+}
+
+static void redirect_stderr(void)
+{
+	msg_fd = open(P_tmpdir, O_TMPFILE|O_RDWR|O_CLOEXEC, 0600);
+	if (msg_fd < 0)
+		return;
+
+	saved_stderr = fcntl(STDERR_FILENO, F_DUPFD_CLOEXEC, 3);
+	if (saved_stderr < 0 || dup2(msg_fd, STDERR_FILENO) < 0) {
+		close(msg_fd);
+		msg_fd = -1;
+		return;
+	}
+}
+
+/* Puts back the real stderr and replays what was written meanwhile */
+static void restore_stderr(void)
+{
+	char buf[4096];
+	ssize_t n;
+
+	if (msg_fd < 0)
+		return;
+
+	dup2(saved_stderr, STDERR_FILENO);
+	close(saved_stderr);
+	saved_stderr = -1;
+
+	lseek(msg_fd, 0, SEEK_SET);
+	while ((n = read(msg_fd, buf, sizeof(buf))) > 0)
+		if (write(STDERR_FILENO, buf, n) != n)
+			break;
+
+	close(msg_fd);
+	msg_fd = -1;
+}
+
+int screen_init(void)
+{
+	static bool registered;
+	struct termios raw;
+	int r;
+
+	if (!isatty(STDIN_FILENO) || !isatty(STDOUT_FILENO))
+		return -ENOTTY;
+
+	if (tcgetattr(STDIN_FILENO, &orig_termios) < 0)
+		return -errno;
+
+	/* keep ISIG, so that ^C still goes through the signal reader */
+	raw = orig_termios;
+	raw.c_lflag &= ~(ICANON|ECHO|IEXTEN);
+	raw.c_iflag &= ~(IXON|ICRNL|INLCR);
+	raw.c_cc[VMIN] = 1;
+	raw.c_cc[VTIME] = 0;
+	if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw) < 0)
+		return -errno;
+
+	active = true;
+	if (!registered) {
+		atexit(screen_fini);
+		registered = true;
+	}
+
+	/* alternate screen, hidden cursor */
+	r = write_now("\033[?1049h\033[?25l");
+	if (r < 0) {
+		screen_fini();
+		return r;
+	}
+
+	r = screen_resize();
+	if (r < 0) {
+		screen_fini();
+		return r;
+	}
+
+	redirect_stderr();
+	return 0;
+}
+
+void screen_fini(void)
+{
+	if (!active)
+		return;
+	active = false;
+
+	out.len = 0;
+	write_now("\033[0m\033[?25h\033[?1049l");
+	tcsetattr(STDIN_FILENO, TCSAFLUSH, &orig_termios);
+	restore_stderr();
+
+	free(front);
+	free(back);
+	front = back = NULL;
+	ob_free(&out);
+}
+
+int screen_resize(void)
+{
+	struct winsize ws;
+	struct cell *f, *b;
+	unsigned i;
+
+	if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) < 0 || !ws.ws_row || !ws.ws_col) {
+		ws.ws_row = 24;
+		ws.ws_col = 80;
+	}
+
+	f = realloc(front, sizeof(struct cell) * ws.ws_row * ws.ws_col);
+	if (!f)
+		return -ENOMEM;
+	front = f;
+	b = realloc(back, sizeof(struct cell) * ws.ws_row * ws.ws_col);
+	if (!b)
+		return -ENOMEM;
+	back = b;
+
+	rows = ws.ws_row;
+	cols = ws.ws_col;
+	for (i = 0; i < rows * cols; i++)
+		back[i] = (struct cell) { ' ', ATTR_NORMAL };
+
+	screen_invalidate();
+	return 0;
+}
+
+void screen_invalidate(void)
+{
+	full_redraw = true;
+}
+
+unsigned screen_rows(void)
+{
+	return rows;
+}
+
+unsigned screen_cols(void)
+{
+	return cols;
+}
+
+void screen_line(unsigned row, enum screen_attr attr, const char *fmt, ...)
+{
+	struct cell *line;
+	char buf[1024];
+	va_list ap;
+	unsigned c;
+	int n;
+
+	if (row >= rows)
+		return;
+
+	va_start(ap, fmt);
+	n = vsnprintf(buf, sizeof(buf), fmt, ap);
+	va_end(ap);
+	if (n < 0)
+		n = 0;
+	else if (n >= sizeof(buf))
+		n = sizeof(buf) - 1;
+
+	line = back + row * cols;
+	for (c = 0; c < cols; c++) {
+		char ch = c < n ? buf[c] : ' ';
+		if (ch < ' ' || ch > '~')
+			ch = '?';
+		line[c] = (struct cell) { ch, attr };
+	}
+}
+
+void screen_clear_lines(unsigned from_row)
+{
+	unsigned i;
+
+	for (i = from_row * cols; i < rows * cols; i++)
+		back[i] = (struct cell) { ' ', ATTR_NORMAL };
+}
+
+static void put_attr(unsigned char attr)
+{
+	put_str("\033[0");
+	if (attr & ATTR_BOLD)
+		put_str(";1");
+	if (attr & ATTR_REVERSE)
+		put_str(";7");
+	ob_putc(&out, 'm');
+	term_attr = attr;
+}
+
+static void put_goto(unsigned row, unsigned col)
+{
+	put_str("\033[");
+	ob_put_u64(&out, row + 1);
+	ob_putc(&out, ';');
+	ob_put_u64(&out, col + 1);
+	ob_putc(&out, 'H');
+}
+
+static bool same(const struct cell *a, const struct cell *b)
+{
+	return a->ch == b->ch && a->attr == b->attr;
+}
+
+/* Can the cursor get from col to col+skip by rewriting unchanged cells? */
+static bool cheap_skip(unsigned i, unsigned skip)
+{
+	unsigned j;
+
+	if (skip > MAX_SKIP)
+		return false;
+	for (j = i; j < i + skip; j++)
+		if (back[j].attr != term_attr)
+			return false;
+	return true;
+}
+
+int screen_refresh(void)
+{
+	unsigned r, c, i, j;
+	int cur_row = -1, cur_col = 0;
+
+	if (!active)
+		return 0;
+
+	if (full_redraw) {
+		put_str("\033[0m\033[H\033[2J");
+		term_attr = ATTR_NORMAL;
+		for (i = 0; i < rows * cols; i++)
+			front[i] = (struct cell) { ' ', ATTR_NORMAL };
+		full_redraw = false;
+	}
+
+	for (r = 0; r < rows; r++) {
+		for (c = 0; c < cols; c++) {
+			i = r * cols + c;
+			if (same(&front[i], &back[i]))
+				continue;
+
+			if (cur_row == r && cur_col < c && cheap_skip(i - (c - cur_col), c - cur_col)) {
+				for (j = i - (c - cur_col); j < i; j++)
+					ob_putc(&out, back[j].ch);
+			} else if (cur_row != r || cur_col != c)
+				put_goto(r, c);
+
+			if (back[i].attr != term_attr)
+				put_attr(back[i].attr);
+			ob_putc(&out, back[i].ch);
+			front[i] = back[i];
+
+			cur_row = r;
+			cur_col = c + 1;
+			/* the cursor position after the last column is unreliable */
+			if (cur_col == cols)
+				cur_row = -1;
+		}
+	}
+
+	if (!out.len)
+		return 0;
+	return ob_flush(&out, STDOUT_FILENO);
+}
+
+const char *screen_last_message(void)
+{
+	struct stat st;
+	char buf[sizeof(last_msg)];
+	char *end, *start;
+	ssize_t n;
+	off_t from;
+
+	if (msg_fd < 0 || fstat(msg_fd, &st) < 0)
+		return NULL;
+	if (st.st_size == msg_size)
+		return last_msg[0] ? last_msg : NULL;
+	msg_size = st.st_size;
+
+	from = st.st_size > sizeof(buf) - 1 ? st.st_size - (sizeof(buf) - 1) : 0;
+	n = pread(msg_fd, buf, st.st_size - from, from);
+	if (n <= 0)
+		return NULL;
+	buf[n] = '\0';
+
+	end = buf + n;
+	while (end > buf && (end[-1] == '\n' || end[-1] == '\r'))
+		*--end = '\0';
+	start = strrchr(buf, '\n');
+	start = start ? start + 1 : buf;
+
+	snprintf(last_msg, sizeof(last_msg), "%s", start);
+	return last_msg[0] ? last_msg : NULL;
+}
@@ -0,0 +1,42 @@
+/*
+ * Copyright 2026 agent
+ * Author: agent <agent@local>
+ * License: GPLv2
+ */
+#ifndef _SCREEN_H
+#define _SCREEN_H
+
+/*
+ * A minimal full-screen terminal renderer. Lines are drawn into a back
+ * buffer of cells, screen_refresh() compares it with what the terminal
+ * already shows and writes only the changed cells, in a single write().
+ */
+
+enum screen_attr {
+	ATTR_NORMAL  = 0,
+	ATTR_BOLD    = 1 << 0,
+	ATTR_REVERSE = 1 << 1,
+};
+
+/* Raw keyboard, alternate screen. stderr is kept until screen_fini(). */
+int  screen_init(void);
+void screen_fini(void);
+
+/* Re-reads the terminal size, the next refresh redraws everything */
+int  screen_resize(void);
+void screen_invalidate(void);
+
+unsigned screen_rows(void);
+unsigned screen_cols(void);
+
+/* Replaces a whole line of the back buffer, clipped to the width */
+void screen_line(unsigned row, enum screen_attr attr, const char *fmt, ...)
+	__attribute__((format(printf, 3, 4)));
+void screen_clear_lines(unsigned from_row);
+
+int  screen_refresh(void);
+
+/* The last line written to stderr while the screen was active, or NULL */
+const char *screen_last_message(void);
+
+#endif
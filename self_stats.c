@@ -0,0 +1,82 @@
+/*
+ * Self-instrumentation: the counters are plain increments in the
+ * pipeline, the stage times two clock reads per batch of events or per
+ * report. The symbol lookups are sampled.
+ *
+ * Copyright 2026 agent
+ * Author: agent <agent@local>
+ * License: GPLv2
+ */
+#include "self_stats.h"
+
+#include "stack_table.h"
+
+struct self_stats self_stats;
+
+static const char *const stage_names[_NR_STAGES] = {
+	[STAGE_PARSE]     = "parse",
+	[STAGE_ACCOUNT]   = "account",
+	[STAGE_SORT]      = "sort",
+	[STAGE_SYMBOLIZE] = "symbolize",
+	[STAGE_PRINT]     = "print",
+};
+
+void self_stats_render(struct outbuf *ob, const struct report_info *ri,
+                       enum output_format format,
+                       struct process **array, unsigned n)
+{
+	const struct self_stats *s = &self_stats;
+	uint64_t stacks = 0, bytes;
+	unsigned i;
+
+	if (!s->live || (format != FORMAT_TEXT && format != FORMAT_JSON))
+		return;
+
+	for (i = 0; i < n; i++)
+		stacks += array[i]->bt2la_count;
+	/* the aggregation's own structures, the allocator's overhead aside */
+	bytes = n * sizeof(struct process) + stacks * sizeof(struct bt2la) +
+	        stack_table_bytes();
+
+	if (format == FORMAT_JSON) {
+		ob_puts(ob, "{\"interval\":");
+		ob_put_u64(ob, ri->seq);
+		ob_puts(ob, ",\"time\":");
+		ob_put_i64(ob, ri->time);
+		ob_printf(ob, ",\"self\":{\"events\":%llu,\"bytes_read\":%llu,\"malformed_lines\":%llu,"
+		          "\"ring_high_water\":%u,\"probe_drops\":%llu,\"dropped_bytes\":%llu,"
+		          "\"threads\":%u,\"stacks\":%llu,\"aggregation_bytes\":%llu,\"cpu_percent\":%.1f",
+		          (unsigned long long) s->events, (unsigned long long) s->bytes_read,
+		          (unsigned long long) s->malformed, s->ring_high_water,
+		          (unsigned long long) s->probe_drops, (unsigned long long) s->dropped_bytes,
+		          n, (unsigned long long) stacks, (unsigned long long) bytes, s->cpu_percent);
+		for (i = 0; i < _NR_STAGES; i++)
+			ob_printf(ob, ",\"%s_ns\":%llu", stage_names[i],
+			          (unsigned long long) s->stage_ns[i]);
+		ob_puts(ob, "}}\n");
+		return;
+	}
+
+	ob_printf(ob, "lattop: %llu events, %.1f KiB read (ring max %.1f KiB), %llu malformed lines, "
+	          "%llu events lost by the probe, %llu bytes dropped\n",
+	          (unsigned long long) s->events, s->bytes_read / 1024.0,
+	          s->ring_high_water / 1024.0, (unsigned long long) s->malformed,
+	          (unsigned long long) s->probe_drops, (unsigned long long) s->dropped_bytes);
+	ob_printf(ob, "lattop: %llu stacks in %u threads, %.1f KiB, %.1f%% CPU;",
+	          (unsigned long long) stacks, n, bytes / 1024.0, s->cpu_percent);
+	for (i = 0; i < _NR_STAGES; i++)
+		ob_printf(ob, "%s %s %.2f ms", i ? "," : "", stage_names[i], s->stage_ns[i] / 1e6);
+	ob_putc(ob, '\n');
+}
+
+void self_stats_reset(void)
+{
+	struct self_stats *s = &self_stats;
+	unsigned i;
+
+	s->events = s->bytes_read = s->malformed = 0;
+	s->dropped_bytes = s->probe_drops = 0;
+	s->ring_high_water = 0;
+	for (i = 0; i < _NR_STAGES; i++)
+		s->stage_ns[i] = 0;
+}
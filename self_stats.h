@@ -0,0 +1,59 @@
+/*
+ * lattop's own costs and losses, counted all the time
+ *
+ * Copyright 2026 agent
+ * Author: agent <agent@local>
+ * License: GPLv2
+ */
+#ifndef _SELF_STATS_H
+#define _SELF_STATS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "lattop.h"
+#include "outbuf.h"
+#include "process.h"
+#include "report.h"
+
+enum self_stage {
+	STAGE_PARSE,
+	STAGE_ACCOUNT,
+	STAGE_SORT,
+	STAGE_SYMBOLIZE,
+	STAGE_PRINT,
+	_NR_STAGES
+};
+
+/* The counts are since the last report */
+struct self_stats {
+	bool live;		/* fed by the probe, not a recording */
+	uint64_t events;	/* parsed */
+	uint64_t bytes_read;
+	uint64_t malformed;	/* lines */
+	uint64_t dropped_bytes;	/* of the read buffer, on overflow */
+	uint64_t probe_drops;	/* gaps in the probe's sequence numbers */
+	unsigned ring_high_water;
+	double cpu_percent;	/* of the last interval, by the governor */
+	uint64_t stage_ns[_NR_STAGES];
+};
+
+extern struct self_stats self_stats;
+
+static inline uint64_t self_stats_clock(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Appends the footer of a text or json report, nothing for other formats */
+void self_stats_render(struct outbuf *ob, const struct report_info *ri,
+                       enum output_format format,
+                       struct process **array, unsigned n);
+/* Starts counting the next interval */
+void self_stats_reset(void);
+
+#endif
@@ -0,0 +1,112 @@
+/*
+ * An example consumer of lattop --shm: prints the threads' worst stacks
+ * whenever lattop publishes a new interval.
+ *
+ * Copyright 2026 agent
+ * Author: agent <agent@local>
+ * License: GPLv2
+ */
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "lattop_shm.h"
+
+static void print_stack(FILE *f, const struct lattop_shm_view *v, uint32_t stack)
+{
+	const struct lattop_shm_stack *s;
+	const char *t;
+	uint32_t i;
+
+	if (stack >= v->nr_stacks)
+		return;
+	s = &v->stacks[stack];
+
+	t = lattop_shm_string(v, s->translation);
+	if (*t) {
+		fprintf(f, "%s", t);
+		return;
+	}
+	for (i = s->first_frame; i < s->first_frame + s->nr_frames && i < v->nr_frames; i++)
+		fprintf(f, "%s%s", i == s->first_frame ? "" : " <- ",
+		        lattop_shm_string(v, v->frames[i].symbol));
+}
+
+/* Renders the snapshot into a memory stream, it is printed only if consistent */
+static void render(FILE *f, const struct lattop_shm_view *v)
+{
+	const struct lattop_shm_thread *t;
+	const struct lattop_shm_account *a, *worst;
+	uint32_t i, j;
+
+	fprintf(f, "interval %" PRIu64 ": %u threads, %u stacks\n",
+	        v->hdr->interval_seq, v->nr_threads, v->nr_stacks);
+
+	for (i = 0; i < v->nr_threads; i++) {
+		t = &v->threads[i];
+		worst = NULL;
+		for (j = t->first_account; j < t->first_account + t->nr_accounts && j < v->nr_accounts; j++) {
+			a = &v->accounts[j];
+			if (!worst || a->max > worst->max)
+				worst = a;
+		}
+
+		fprintf(f, "%7d %7d %-16s %5u %8.1f ms max  ", t->pid, t->tid,
+		        lattop_shm_string(v, t->comm), t->count, t->max / 1e6);
+		if (worst)
+			print_stack(f, v, worst->stack);
+		fputc('\n', f);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	const char *name = argc > 1 ? argv[1] : LATTOP_SHM_DEFAULT_NAME;
+	struct lattop_shm shm;
+	struct lattop_shm_view v;
+	uint64_t last = UINT64_MAX;
+	char *text;
+	size_t len;
+	FILE *f;
+	int r;
+
+	r = lattop_shm_open(&shm, name);
+	if (r < 0) {
+		fprintf(stderr, "Cannot open %s: %s\n", name, strerror(-r));
+		return 1;
+	}
+
+	for (;;) {
+		r = lattop_shm_begin(&shm, &v);
+		if (r < 0) {
+			fprintf(stderr, "%s: %s\n", name, r == -ESTALE ? "lattop has exited" : strerror(-r));
+			break;
+		}
+
+		/* nothing new, or nothing published yet */
+		if (v.hdr->interval_seq == last || !v.hdr->interval_end) {
+			usleep(100000);
+			continue;
+		}
+
+		f = open_memstream(&text, &len);
+		if (!f)
+			break;
+		render(f, &v);
+		last = v.hdr->interval_seq;
+		fclose(f);
+
+		if (!lattop_shm_retry(&v))
+			fwrite(text, 1, len, stdout);
+		else
+			last = UINT64_MAX;
+		free(text);
+		fflush(stdout);
+	}
+
+	lattop_shm_close(&shm);
+	return 1;
+}
@@ -0,0 +1,293 @@
+/*
+ * Publishes every interval as a snapshot in shared memory, see
+ * lattop_shm.h for the layout. The snapshot is built aside and copied
+ * into the region under the seqlock, so the region is odd only briefly.
+ *
+ * Copyright 2026 agent
+ * Author: agent <agent@local>
+ * License: GPLv2
+ */
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "shm_writer.h"
+
+#include "array.h"
+#include "governor.h"
+#include "lattop.h"
+#include "lattop_shm.h"
+#include "outbuf.h"
+#include "process.h"
+#include "process_accountant.h"
+#include "stack_table.h"
+#include "sym_translator.h"
+
+static char *shm_name;
+static int shm_fd = -1;
+static struct lattop_shm_header *region;
+static size_t region_len;
+static uint64_t interval_seq;
+
+/* the sections of the snapshot being built */
+static struct outbuf threads, accounts, stacks, frames, strings;
+static uint32_t nr_threads, nr_accounts, nr_stacks, nr_frames;
+
+/* stack table id -> index in stacks + 1, symbol index -> string offset + 1 */
+static uint32_t *stack_index, *symbol_string;
+static unsigned stack_index_len, symbol_string_len;
+
+static uint32_t add_string(const char *s)
+{
+	uint32_t off = strings.len;
+
+	if (!s || !*s)
+		return 0;
+	ob_write(&strings, s, strlen(s) + 1);
+	return off;
+}
+
+static uint32_t add_symbol(unsigned long ip)
+{
+	int index;
+
+	index = sym_translator_lookup_index(ip);
+	if (index < 0)
+		return 0;
+	if (grow_array(&symbol_string, &symbol_string_len, index, sizeof(uint32_t)) < 0)
+		return add_string(sym_translator_name(index));
+
+	if (!symbol_string[index])
+		symbol_string[index] = add_string(sym_translator_name(index)) + 1;
+	return symbol_string[index] - 1;
+}
+
+static uint32_t add_stack(int id)
+{
+	struct lattop_shm_stack s;
+	struct lattop_shm_frame f = {};
+	struct back_trace bt;
+	unsigned i, len;
+	bool cached = grow_array(&stack_index, &stack_index_len, id, sizeof(uint32_t)) == 0;
+
+	if (cached && stack_index[id])
+		return stack_index[id] - 1;
+
+	len = stack_table_get(id, &bt);
+	s.stack_id = id;
+	s.translation = add_string(bt_translate(&bt));
+	s.first_frame = nr_frames;
+	for (i = 0; i < len; i++) {
+		f.ip = bt.trace[i];
+		f.symbol = add_symbol(bt.trace[i]);
+		ob_write(&frames, &f, sizeof(f));
+		nr_frames++;
+	}
+	s.nr_frames = nr_frames - s.first_frame;
+	ob_write(&stacks, &s, sizeof(s));
+
+	if (cached)
+		stack_index[id] = nr_stacks + 1;
+	return nr_stacks++;
+}
+
+static void add_process(struct process *p, void *userdata)
+{
+	struct lattop_shm_thread t = {
+		.pid = p->pid,
+		.tid = p->tid,
+		.comm = add_string(p->comm),
+		.first_account = nr_accounts,
+	};
+	struct rb_node *node;
+
+	for (node = rb_first(&p->bt2la_map); node; node = rb_next(node)) {
+		struct bt2la *b = rb_entry(node, struct bt2la, rb_node);
+		struct lattop_shm_account a = {
+			.thread = nr_threads,
+			.stack = add_stack(b->stack_id),
+			/* the layout has 32 bits, saturated */
+			.count = b->la.count < UINT32_MAX ? b->la.count : UINT32_MAX,
+			.total = b->la.total,
+			.max = b->la.max,
+		};
+
+		ob_write(&accounts, &a, sizeof(a));
+		nr_accounts++;
+		t.nr_accounts++;
+		t.count = t.count + a.count < t.count ? UINT32_MAX : t.count + a.count;
+		t.total += a.total;
+		if (a.max > t.max)
+			t.max = a.max;
+	}
+
+	ob_write(&threads, &t, sizeof(t));
+	nr_threads++;
+}
+
+static size_t align8(size_t n)
+{
+	return (n + 7) & ~(size_t) 7;
+}
+
+static int grow_region(size_t len)
+{
+	long page = sysconf(_SC_PAGESIZE);
+	size_t new_len = region_len;
+	void *map;
+
+	while (new_len < len)
+		new_len *= 2;
+	new_len = (new_len + page - 1) & ~(page - 1);
+
+	if (ftruncate(shm_fd, new_len) < 0)
+		return -errno;
+	map = mremap(region, region_len, new_len, MREMAP_MAYMOVE);
+	if (map == MAP_FAILED)
+		return -errno;
+
+	region = map;
+	region_len = new_len;
+	return 0;
+}
+
+void shm_writer_publish(void)
+{
+	struct lattop_shm_header h = {
+		.magic = LATTOP_SHM_MAGIC,
+		.version = LATTOP_SHM_VERSION,
+		.sample_factor = governor_sample_factor(),
+		.interval_seq = interval_seq++,
+		.interval_end = time(NULL),
+		.interval_ms = arg_interval_ms,
+	};
+	size_t len;
+	int r;
+
+	threads.len = accounts.len = stacks.len = frames.len = strings.len = 0;
+	nr_threads = nr_accounts = nr_stacks = nr_frames = 0;
+	ob_putc(&strings, '\0');
+
+	if (stack_index)
+		memset(stack_index, 0, stack_index_len * sizeof(uint32_t));
+	if (symbol_string)
+		memset(symbol_string, 0, symbol_string_len * sizeof(uint32_t));
+
+	pa_for_each_process(add_process, NULL);
+
+	if (threads.error || accounts.error || stacks.error || frames.error || strings.error) {
+		fprintf(stderr, "Cannot build the shared memory snapshot: %s\n", strerror(ENOMEM));
+		return;
+	}
+
+	h.nr_threads = nr_threads;
+	h.nr_accounts = nr_accounts;
+	h.nr_stacks = nr_stacks;
+	h.nr_frames = nr_frames;
+	h.strings_len = strings.len;
+	h.threads_off = align8(sizeof(h));
+	h.accounts_off = align8(h.threads_off + threads.len);
+	h.stacks_off = align8(h.accounts_off + accounts.len);
+	h.frames_off = align8(h.stacks_off + stacks.len);
+	h.strings_off = align8(h.frames_off + frames.len);
+	len = h.strings_off + strings.len;
+
+	/* outside of the write section, readers remap when they see the size */
+	if (len > region_len) {
+		r = grow_region(len);
+		if (r < 0) {
+			fprintf(stderr, "Cannot grow the shared memory snapshot: %s\n", strerror(-r));
+			return;
+		}
+	}
+	h.size = region_len;
+
+	h.seq = region->seq + 1;
+	__atomic_store_n(&region->seq, h.seq, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	memcpy((char*) region + h.threads_off, threads.data, threads.len);
+	memcpy((char*) region + h.accounts_off, accounts.data, accounts.len);
+	memcpy((char*) region + h.stacks_off, stacks.data, stacks.len);
+	memcpy((char*) region + h.frames_off, frames.data, frames.len);
+	memcpy((char*) region + h.strings_off, strings.data, strings.len);
+	/* all but seq */
+	memcpy((char*) region + sizeof(h.magic) + sizeof(h.version) + sizeof(h.seq),
+	       (char*) &h + sizeof(h.magic) + sizeof(h.version) + sizeof(h.seq),
+	       sizeof(h) - sizeof(h.magic) - sizeof(h.version) - sizeof(h.seq));
+
+	__atomic_store_n(&region->seq, h.seq + 1, __ATOMIC_RELEASE);
+}
+
+int shm_writer_init(const char *name)
+{
+	int r;
+
+	if (asprintf(&shm_name, "%s%s", name[0] == '/' ? "" : "/", name) < 0) {
+		shm_name = NULL;
+		return -ENOMEM;
+	}
+
+	/* a new object, readers of a previous lattop see it was left stale */
+	shm_unlink(shm_name);
+	shm_fd = shm_open(shm_name, O_RDWR|O_CREAT|O_EXCL|O_CLOEXEC, 0600);
+	if (shm_fd < 0) {
+		r = -errno;
+		goto err;
+	}
+
+	region_len = sysconf(_SC_PAGESIZE);
+	if (ftruncate(shm_fd, region_len) < 0) {
+		r = -errno;
+		goto err;
+	}
+	region = mmap(NULL, region_len, PROT_READ|PROT_WRITE, MAP_SHARED, shm_fd, 0);
+	if (region == MAP_FAILED) {
+		region = NULL;
+		r = -errno;
+		goto err;
+	}
+
+	/* an empty snapshot until the first interval ends */
+	region->version = LATTOP_SHM_VERSION;
+	region->size = region_len;
+	__atomic_store_n(&region->magic, LATTOP_SHM_MAGIC, __ATOMIC_RELEASE);
+	return 0;
+err:
+	fprintf(stderr, "Cannot create the shared memory snapshot %s: %s\n", shm_name, strerror(-r));
+	shm_writer_fini();
+	return r;
+}
+
+void shm_writer_fini(void)
+{
+	if (region) {
+		__atomic_store_n(&region->magic, 0, __ATOMIC_RELEASE);
+		munmap(region, region_len);
+		region = NULL;
+	}
+	if (shm_fd >= 0) {
+		close(shm_fd);
+		shm_unlink(shm_name);
+		shm_fd = -1;
+	}
+	free(shm_name);
+	shm_name = NULL;
+	free(stack_index);
+	free(symbol_string);
+	stack_index = symbol_string = NULL;
+	stack_index_len = symbol_string_len = 0;
+	ob_free(&threads);
+	ob_free(&accounts);
+	ob_free(&stacks);
+	ob_free(&frames);
+	ob_free(&strings);
+}
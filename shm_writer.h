@@ -0,0 +1,16 @@
+/*
+ * Copyright 2026 agent
+ * Author: agent <agent@local>
+ * License: GPLv2
+ */
+#ifndef _SHM_WRITER_H
+#define _SHM_WRITER_H
+
+/* Creates the shared memory object name, returns 0 or -errno */
+int  shm_writer_init(const char *name);
+/* Replaces the published snapshot with the interval's latencies */
+void shm_writer_publish(void);
+/* Marks the snapshot stale and removes the object */
+void shm_writer_fini(void);
+
+#endif
@@ -15,6 +15,9 @@
 
 #include "signal_reader.h"
 
+#include "lattop.h"
+#include "tui.h"
+
 struct signal_reader {
 	/* must be first */
 	struct polled_reader pr;
@@ -33,6 +36,9 @@ static int signal_reader_start(struct polled_reader *pr)
 	sigaddset(&accept_sigs, SIGINT);
 	sigaddset(&accept_sigs, SIGTERM);
 	sigaddset(&accept_sigs, SIGQUIT);
+	sigaddset(&accept_sigs, SIGUSR1);
+	sigaddset(&accept_sigs, SIGUSR2);
+	sigaddset(&accept_sigs, SIGWINCH);
 
 	r = sigprocmask(SIG_BLOCK, &accept_sigs, &sr->orig_sigmask);
 	if (r < 0) {
@@ -69,6 +75,15 @@ static int signal_reader_handle_ready_fd(struct polled_reader *pr)
 	case SIGQUIT:
 		fprintf(stderr, "Exiting.\n");
 		return 1; /* do a clean exit */
+	case SIGUSR1:
+		lattop_shed_load();
+		break;
+	case SIGUSR2:
+		lattop_restore_filters();
+		break;
+	case SIGWINCH:
+		tui_resize();
+		break;
 	default:
 		fprintf(stderr, "Unexpected signal %d received via signalfd.\n", si.ssi_signo);
 		return -1;
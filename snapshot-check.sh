@@ -0,0 +1,50 @@
+#!/bin/sh
+#
+# snapshot-check.sh: the snapshot round trip on local files, run by
+# "make check". A snapshot of generated events must read back unchanged,
+# merging it with itself must double every count and total, and counts
+# past 32 bits must survive --merge.
+#
+# Copyright 2026 agent
+# Author: agent <agent@local>
+# License: GPLv2
+
+set -e
+
+dir=$(mktemp -d /tmp/lattop-check-XXXXXX)
+trap 'rm -rf "$dir"' EXIT
+
+fail()
+{
+	echo "snapshot-check: $*" >&2
+	exit 1
+}
+
+./lattop-gen -n 100000 -s 500 -y 2000 -K "$dir/kallsyms" > "$dir/events"
+./lattop --input="$dir/events" --kallsyms="$dir/kallsyms" -i 3600 \
+         -f snapshot -o "$dir/a.snap" 2> /dev/null
+[ "$(tail -n +2 "$dir/a.snap" | wc -l)" -gt 0 ] || fail "empty snapshot"
+
+# written, read and written again
+./lattop --merge -f snapshot -o "$dir/b.snap" "$dir/a.snap"
+tail -n +2 "$dir/a.snap" > "$dir/a.body"
+tail -n +2 "$dir/b.snap" > "$dir/b.body"
+cmp -s "$dir/a.body" "$dir/b.body" || fail "a snapshot changes when read back"
+
+# count, total and max of every line, the max does not add up
+./lattop --merge -f snapshot -o "$dir/m.snap" "$dir/a.snap" "$dir/a.snap"
+tail -n +2 "$dir/m.snap" > "$dir/m.body"
+awk -F '\t' 'NR == FNR { c[$1] = $2; t[$1] = $3; m[$1] = $4; next }
+             !($1 in c) || $2 != 2 * c[$1] || $3 != 2 * t[$1] || $4 != m[$1] { bad++ }
+             END { exit bad || FNR != NR - FNR }' "$dir/a.body" "$dir/m.body" ||
+	fail "merging a snapshot with itself does not double it"
+
+# 3e9 does not fit 32 bits, neither does the sum
+printf '# lattop-snapshot 2 intervals=1 first=1 last=1 sample_factor=1\n' > "$dir/big.snap"
+printf 'big;f\t3000000000\t3000000000000\t1000\t9:3000000000\t3000000000:3000000000000:1000,0:0:0\n' \
+	>> "$dir/big.snap"
+./lattop --merge -f snapshot -o "$dir/big2.snap" "$dir/big.snap" "$dir/big.snap"
+grep -q "	6000000000	6000000000000	1000	9:6000000000	6000000000:" "$dir/big2.snap" ||
+	fail "counts past 32 bits do not merge"
+
+echo "snapshot-check: OK"
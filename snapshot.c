@@ -0,0 +1,731 @@
+/*
+ * Snapshots are mergeable aggregates, e.g. of a whole fleet. A snapshot
+ * file is text:
+ *
+ *   # lattop-snapshot 2 intervals=N first=T last=T sample_factor=S
+ *   comm;outermost;...;innermost<TAB>count<TAB>total_ns<TAB>max_ns<TAB>hist<TAB>states
+ *
+ * The frames are symbol names, so addresses randomized by KASLR do not
+ * matter, and threads of the same comm are added together. hist is the
+ * sparse "bucket:count,..." or "-", states is "count:total_ns:max_ns" of
+ * the sleeps and of the blocks, separated by a ',' (not in version 1
+ * snapshots, which are still read). The lines are sorted bytewise by the
+ * key, so any number of snapshots is merged in a single streaming pass.
+ *
+ * The snapshot writer accumulates all intervals of the run and replaces
+ * the output file with every interval.
+ *
+ * Copyright 2026 agent
+ * Author: agent <agent@local>
+ * License: GPLv2
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "snapshot.h"
+
+#include "call_tree.h"
+#include "diff.h"
+#include "filter.h"
+#include "fnv1a.h"
+#include "lat_translator.h"
+#include "lattop.h"
+#include "process.h"
+#include "process_accountant.h"
+#include "report.h"
+#include "stack_rewrite.h"
+#include "stack_table.h"
+#include "sym_translator.h"
+
+#define SNAPSHOT_VERSION 2
+/* without the states */
+#define SNAPSHOT_VERSION_MIN 1
+
+struct snap_info {
+	unsigned long intervals;
+	long long first, last;
+	unsigned sample_factor;
+};
+
+static void put_header(struct outbuf *ob, const struct snap_info *si)
+{
+	ob_printf(ob, "# lattop-snapshot %d intervals=%lu first=%lld last=%lld sample_factor=%u\n",
+	          SNAPSHOT_VERSION, si->intervals, si->first, si->last, si->sample_factor);
+}
+
+static void put_line(struct outbuf *ob, const char *key, const struct latency_account *la)
+{
+	bool first = true;
+	unsigned i;
+
+	ob_puts(ob, key);
+	ob_putc(ob, '\t');
+	ob_put_u64(ob, la->count);
+	ob_putc(ob, '\t');
+	ob_put_u64(ob, la->total);
+	ob_putc(ob, '\t');
+	ob_put_u64(ob, la->max);
+	ob_putc(ob, '\t');
+	for (i = 0; i < LA_HIST_BUCKETS; i++) {
+		if (!la->hist[i])
+			continue;
+		ob_printf(ob, "%s%u:%llu", first ? "" : ",", i, (unsigned long long) la->hist[i]);
+		first = false;
+	}
+	if (first)
+		ob_putc(ob, '-');
+	for (i = 0; i < _LA_NR_STATES; i++)
+		ob_printf(ob, "%c%llu:%llu:%llu", i ? ',' : '\t',
+		          (unsigned long long) la->state_count[i],
+		          (unsigned long long) la->state_total[i],
+		          (unsigned long long) la->state_max[i]);
+	ob_putc(ob, '\n');
+}
+
+/*
+ * The writer.
+ */
+
+struct snap_entry {
+	char *key;
+	struct latency_account la;
+};
+
+static struct snap_info run;
+static struct snap_entry *entries;
+static unsigned nr_entries, entries_alloc;
+/* entry index + 1, open addressing, at most half full */
+static unsigned *entry_hash;
+static unsigned entry_hash_size;
+static struct outbuf key;
+
+static int grow_entry_hash(void)
+{
+	unsigned new_size = entry_hash_size ? 2 * entry_hash_size : 1024;
+	unsigned *new_hash, i, slot;
+
+	new_hash = calloc(new_size, sizeof(unsigned));
+	if (!new_hash)
+		return -ENOMEM;
+	for (i = 0; i < nr_entries; i++) {
+		slot = fnv1a_string(entries[i].key) & (new_size - 1);
+		while (new_hash[slot])
+			slot = (slot + 1) & (new_size - 1);
+		new_hash[slot] = i + 1;
+	}
+	free(entry_hash);
+	entry_hash = new_hash;
+	entry_hash_size = new_size;
+	return 0;
+}
+
+static void add_entry(const char *k, const struct latency_account *la)
+{
+	struct snap_entry *e;
+	unsigned slot;
+
+	if (2 * (nr_entries + 1) > entry_hash_size && grow_entry_hash() < 0)
+		return;
+
+	slot = fnv1a_string(k) & (entry_hash_size - 1);
+	while (entry_hash[slot]) {
+		e = &entries[entry_hash[slot] - 1];
+		if (!strcmp(e->key, k)) {
+			la_merge(&e->la, la);
+			return;
+		}
+		slot = (slot + 1) & (entry_hash_size - 1);
+	}
+
+	if (nr_entries == entries_alloc) {
+		unsigned new_alloc = entries_alloc ? 2 * entries_alloc : 256;
+		e = realloc(entries, new_alloc * sizeof(struct snap_entry));
+		if (!e)
+			return;
+		entries = e;
+		entries_alloc = new_alloc;
+	}
+
+	e = &entries[nr_entries];
+	e->key = strdup(k);
+	if (!e->key)
+		return;
+	e->la = *la;
+	entry_hash[slot] = ++nr_entries;
+}
+
+/* ';' and tabs separate the fields */
+static void put_key_part(struct outbuf *ob, const char *s)
+{
+	for (; *s; s++)
+		ob_putc(ob, *s == ';' || *s == '\t' || *s == '\n' ? '_' : *s);
+}
+
+void snapshot_put_stack(struct outbuf *ob, const struct back_trace *bt)
+{
+	const char *sym;
+	char hex[32];
+	int i;
+
+	for (i = MAX_BT_LEN - 1; i >= 0; i--) {
+		if (bt->trace[i] == 0 || bt->trace[i] == ULONG_MAX)
+			continue;
+		sym = sym_translator_lookup(bt->trace[i]);
+		if (!sym) {
+			snprintf(hex, sizeof(hex), "0x%lx", bt->trace[i]);
+			sym = hex;
+		}
+		ob_putc(ob, ';');
+		put_key_part(ob, sym);
+	}
+}
+
+static void snapshot_begin(struct outbuf *ob, const struct report_info *ri)
+{
+	if (!run.intervals++)
+		run.first = ri->time;
+	run.last = ri->time;
+	if (ri->sample_factor > run.sample_factor)
+		run.sample_factor = ri->sample_factor;
+}
+
+static void snapshot_process(struct outbuf *ob, const struct report_info *ri,
+                             struct process *p)
+{
+	struct back_trace bt;
+	struct rb_node *node;
+
+	for (node = rb_first(&p->bt2la_map); node; node = rb_next(node)) {
+		struct bt2la *bt2la = rb_entry(node, struct bt2la, rb_node);
+
+		key.len = 0;
+		put_key_part(&key, p->comm);
+		stack_table_get(bt2la->stack_id, &bt);
+		snapshot_put_stack(&key, &bt);
+		ob_putc(&key, '\0');
+		if (!key.error)
+			add_entry(key.data, &bt2la->la);
+	}
+}
+
+static int compare_entries(const void *a, const void *b)
+{
+	return strcmp((*(const struct snap_entry**) a)->key,
+	              (*(const struct snap_entry**) b)->key);
+}
+
+static void snapshot_end(struct outbuf *ob, const struct report_info *ri)
+{
+	struct snap_entry **sorted;
+	unsigned i;
+
+	sorted = malloc(nr_entries * sizeof(struct snap_entry*) + 1);
+	if (!sorted) {
+		ob->error = -ENOMEM;
+		return;
+	}
+	for (i = 0; i < nr_entries; i++)
+		sorted[i] = &entries[i];
+	qsort(sorted, nr_entries, sizeof(struct snap_entry*), compare_entries);
+
+	put_header(ob, &run);
+	for (i = 0; i < nr_entries; i++)
+		put_line(ob, sorted[i]->key, &sorted[i]->la);
+	free(sorted);
+}
+
+const struct report_writer snapshot_writer = {
+	.begin = snapshot_begin,
+	.process = snapshot_process,
+	.end = snapshot_end,
+	.flush = replace_output_file,
+};
+
+void snapshot_writer_fini(void)
+{
+	unsigned i;
+
+	for (i = 0; i < nr_entries; i++)
+		free(entries[i].key);
+	free(entries);
+	free(entry_hash);
+	entries = NULL;
+	entry_hash = NULL;
+	nr_entries = entries_alloc = entry_hash_size = 0;
+	ob_free(&key);
+}
+
+/*
+ * The merge.
+ */
+
+struct snap_input {
+	const char *path;
+	FILE *f;
+	unsigned long lineno;
+	/* the current and the previous line, to check the order */
+	char *line, *prev;
+	size_t line_alloc, prev_alloc;
+	bool has_prev;
+	const char *key;
+	struct latency_account la;
+};
+
+static int input_error(struct snap_input *in, const char *what)
+{
+	fprintf(stderr, "%s:%lu: %s\n", in->path, in->lineno, what);
+	return -EINVAL;
+}
+
+static int parse_account(struct snap_input *in, char *s)
+{
+	struct latency_account *la = &in->la;
+	unsigned long long v[3], count, total, max;
+	unsigned bucket;
+	char *end, *states;
+	int i, n;
+
+	memset(la, 0, sizeof(*la));
+	for (i = 0; i < 3; i++) {
+		errno = 0;
+		v[i] = strtoull(s, &end, 10);
+		if (errno || end == s || *end != '\t')
+			return input_error(in, "invalid numbers");
+		s = end + 1;
+	}
+	la->count = v[0];
+	la->total = v[1];
+	la->max = v[2];
+
+	states = strchr(s, '\t');
+	if (states) {
+		*states++ = '\0';
+		for (i = 0; i < _LA_NR_STATES; i++) {
+			if (sscanf(states, "%llu:%llu:%llu%n", &count, &total, &max, &n) != 3 ||
+			    states[n] != (i < _LA_NR_STATES - 1 ? ',' : '\0'))
+				return input_error(in, "invalid states");
+			la->state_count[i] = count;
+			la->state_total[i] = total;
+			la->state_max[i] = max;
+			states += n + 1;
+		}
+	}
+
+	if (!strcmp(s, "-"))
+		return 0;
+	for (;;) {
+		if (sscanf(s, "%u:%llu", &bucket, &count) != 2 || bucket >= LA_HIST_BUCKETS)
+			return input_error(in, "invalid histogram");
+		la->hist[bucket] = count;
+		s = strchr(s, ',');
+		if (!s)
+			return 0;
+		s++;
+	}
+}
+
+/* Reads the next line, returns 1 if there is one, 0 at the end or -errno */
+static int input_next(struct snap_input *in)
+{
+	char *swap_line;
+	size_t swap_alloc;
+	ssize_t n;
+	char *tab;
+
+	swap_line = in->prev;
+	swap_alloc = in->prev_alloc;
+	in->prev = in->line;
+	in->prev_alloc = in->line_alloc;
+	in->line = swap_line;
+	in->line_alloc = swap_alloc;
+	in->has_prev = in->key != NULL;
+
+	n = getline(&in->line, &in->line_alloc, in->f);
+	if (n < 0) {
+		in->key = NULL;
+		return ferror(in->f) ? -EIO : 0;
+	}
+	in->lineno++;
+	if (n && in->line[n-1] == '\n')
+		in->line[n-1] = '\0';
+
+	tab = strchr(in->line, '\t');
+	if (!tab)
+		return input_error(in, "missing fields");
+	*tab = '\0';
+	in->key = in->line;
+	if (in->has_prev && strcmp(in->prev, in->key) >= 0)
+		return input_error(in, "the lines are not sorted");
+
+	return parse_account(in, tab + 1) ?: 1;
+}
+
+static int input_open(struct snap_input *in, struct snap_info *si)
+{
+	unsigned version;
+	struct snap_info h;
+	ssize_t n;
+
+	in->f = fopen(in->path, "re");
+	if (!in->f) {
+		fprintf(stderr, "Cannot open %s: %s\n", in->path, strerror(errno));
+		return -errno;
+	}
+
+	n = getline(&in->line, &in->line_alloc, in->f);
+	in->lineno = 1;
+	if (n < 0 || sscanf(in->line, "# lattop-snapshot %u intervals=%lu first=%lld last=%lld sample_factor=%u",
+	                    &version, &h.intervals, &h.first, &h.last, &h.sample_factor) != 5)
+		return input_error(in, "not a lattop snapshot");
+	if (version < SNAPSHOT_VERSION_MIN || version > SNAPSHOT_VERSION)
+		return input_error(in, "unsupported snapshot version");
+
+	if (!si->intervals || h.first < si->first)
+		si->first = h.first;
+	if (h.last > si->last)
+		si->last = h.last;
+	if (h.sample_factor > si->sample_factor)
+		si->sample_factor = h.sample_factor;
+	si->intervals += h.intervals;
+	return 0;
+}
+
+int snapshot_load(const char *path, unsigned long *intervals,
+                  void (*fn)(const char *key, const struct latency_account *la, void *userdata),
+                  void *userdata)
+{
+	struct snap_input in = { .path = path };
+	struct snap_info si = {};
+	int r;
+
+	r = input_open(&in, &si);
+	if (r == 0)
+		while ((r = input_next(&in)) > 0)
+			fn(in.key, &in.la, userdata);
+
+	if (in.f)
+		fclose(in.f);
+	free(in.line);
+	free(in.prev);
+	*intervals = si.intervals;
+	return r;
+}
+
+/* min-heap of the inputs by their current key */
+static void sift_down(struct snap_input **heap, unsigned n, unsigned i)
+{
+	struct snap_input *tmp;
+	unsigned child;
+
+	for (;;) {
+		child = 2 * i + 1;
+		if (child >= n)
+			return;
+		if (child + 1 < n && strcmp(heap[child + 1]->key, heap[child]->key) < 0)
+			child++;
+		if (strcmp(heap[i]->key, heap[child]->key) <= 0)
+			return;
+		tmp = heap[i];
+		heap[i] = heap[child];
+		heap[child] = tmp;
+		i = child;
+	}
+}
+
+/*
+ * For a report, the merged stacks become processes and back traces again:
+ * every comm gets a made up pid and every symbol a made up address,
+ * which the symbol translator then maps back to the name.
+ */
+struct report_state {
+	char **names;		/* symbol names by made up address / 16 - 1 */
+	unsigned *name_hash;	/* index + 1 */
+	unsigned nr_names, names_alloc, name_hash_size;
+	char comm[16];
+	pid_t pid;
+	int error;
+};
+
+static unsigned long symbol_addr(struct report_state *rs, const char *name)
+{
+	unsigned slot, i, new_size;
+	unsigned *new_hash;
+	char **n;
+
+	if (2 * (rs->nr_names + 1) > rs->name_hash_size) {
+		new_size = rs->name_hash_size ? 2 * rs->name_hash_size : 1024;
+		new_hash = calloc(new_size, sizeof(unsigned));
+		if (!new_hash)
+			return 0;
+		for (i = 0; i < rs->nr_names; i++) {
+			slot = fnv1a_string(rs->names[i]) & (new_size - 1);
+			while (new_hash[slot])
+				slot = (slot + 1) & (new_size - 1);
+			new_hash[slot] = i + 1;
+		}
+		free(rs->name_hash);
+		rs->name_hash = new_hash;
+		rs->name_hash_size = new_size;
+	}
+
+	slot = fnv1a_string(name) & (rs->name_hash_size - 1);
+	while (rs->name_hash[slot]) {
+		i = rs->name_hash[slot] - 1;
+		if (!strcmp(rs->names[i], name))
+			return (i + 1) * 16;
+		slot = (slot + 1) & (rs->name_hash_size - 1);
+	}
+
+	if (rs->nr_names == rs->names_alloc) {
+		unsigned new_alloc = rs->names_alloc ? 2 * rs->names_alloc : 1024;
+		n = realloc(rs->names, new_alloc * sizeof(char*));
+		if (!n)
+			return 0;
+		rs->names = n;
+		rs->names_alloc = new_alloc;
+	}
+	rs->names[rs->nr_names] = strdup(name);
+	if (!rs->names[rs->nr_names] || sym_translator_add((rs->nr_names + 1) * 16, name) < 0)
+		return 0;
+	rs->name_hash[slot] = ++rs->nr_names;
+	return rs->nr_names * 16;
+}
+
+static bool comm_matches(const char *k)
+{
+	char comm[16];
+	size_t len = strcspn(k, ";");
+
+	if (len >= sizeof(comm))
+		len = sizeof(comm) - 1;
+	memcpy(comm, k, len);
+	comm[len] = '\0';
+	return filter_match(0, comm);
+}
+
+/* Adds the frames of a key to the symbols, for the pass before the report */
+static void add_key_symbols(const char *key, const struct latency_account *la, void *userdata)
+{
+	struct report_state *rs = userdata;
+	char *k, *p, *f;
+
+	k = strdup(key);
+	if (!k) {
+		rs->error = -ENOMEM;
+		return;
+	}
+
+	p = strchr(k, ';');
+	while (p && (f = strsep(&p, ";")))
+		if (!symbol_addr(rs, f))
+			rs->error = -ENOMEM;
+	free(k);
+}
+
+/* Consumes the key */
+static int report_line(struct report_state *rs, char *k, const struct latency_account *la,
+                       unsigned sample_factor)
+{
+	struct back_trace bt = {};
+	const char *frames[MAX_BT_LEN];
+	char *p, *f;
+	unsigned n = 0, i;
+	int id;
+
+	p = strchr(k, ';');
+	if (p)
+		*p++ = '\0';
+
+	/* the keys are sorted, a comm's stacks are together */
+	if (strncmp(rs->comm, k, sizeof(rs->comm) - 1)) {
+		strncpy(rs->comm, k, sizeof(rs->comm) - 1);
+		rs->pid++;
+	}
+
+	/* outermost first in the key, innermost first in a back trace */
+	while (p && (f = strsep(&p, ";"))) {
+		if (n == MAX_BT_LEN)
+			memmove(frames, frames + 1, (MAX_BT_LEN - 1) * sizeof(char*));
+		frames[n < MAX_BT_LEN ? n++ : MAX_BT_LEN - 1] = f;
+	}
+	for (i = 0; i < n; i++) {
+		bt.trace[i] = symbol_addr(rs, frames[n - 1 - i]);
+		if (!bt.trace[i])
+			return -ENOMEM;
+	}
+
+	id = stack_table_intern(&bt);
+	if (id < 0)
+		return id;
+	pa_account_merge(rs->pid, rs->pid, rs->comm, id, la, sample_factor);
+	return 0;
+}
+
+int snapshot_merge(char **paths, unsigned n)
+{
+	struct snap_input *inputs, **heap;
+	struct report_state rs = {};
+	struct snap_info si = {};
+	struct latency_account la;
+	struct outbuf out = {};
+	const char *k;
+	char *cur = NULL, *tmp = NULL;
+	size_t cur_alloc = 0;
+	unsigned long intervals;
+	unsigned i, nr_heap = 0;
+	int fd = -1, r = 0;
+	bool to_snapshot = arg_format == FORMAT_SNAPSHOT;
+
+	inputs = calloc(n, sizeof(struct snap_input));
+	heap = calloc(n, sizeof(struct snap_input*));
+	if (!inputs || !heap) {
+		r = -ENOMEM;
+		goto out;
+	}
+
+	for (i = 0; i < n; i++) {
+		inputs[i].path = paths[i];
+		r = input_open(&inputs[i], &si);
+		if (r < 0)
+			goto out;
+		r = input_next(&inputs[i]);
+		if (r < 0)
+			goto out;
+		if (r)
+			heap[nr_heap++] = &inputs[i];
+	}
+	for (i = nr_heap / 2; i > 0; i--)
+		sift_down(heap, nr_heap, i - 1);
+
+	if (to_snapshot) {
+		if (asprintf(&tmp, "%s.tmp", arg_output) < 0) {
+			tmp = NULL;
+			r = -ENOMEM;
+			goto out;
+		}
+		fd = open(tmp, O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC, 0644);
+		if (fd < 0) {
+			r = -errno;
+			fprintf(stderr, "Cannot create %s: %s\n", tmp, strerror(errno));
+			goto out;
+		}
+		put_header(&out, &si);
+	} else {
+		if (lat_translator_init() < 0)
+			fprintf(stderr, "Warning: Failed to load latencytop translations.\n");
+		r = pa_init();
+		if (r < 0)
+			goto out;
+
+		/*
+		 * The frame rules and the call tree look at the symbols of
+		 * every stack as it is added, so they are all read first, in a
+		 * pass of their own.
+		 */
+		if (stack_rewrite_active() || call_tree_fed()) {
+			for (i = 0; i < n && r == 0; i++)
+				r = snapshot_load(paths[i], &intervals, add_key_symbols, &rs) ?: rs.error;
+			if (r == 0 && rs.nr_names)
+				r = sym_translator_build();
+			if (r < 0) {
+				fprintf(stderr, "Failed to init the symbol map.\n");
+				goto out;
+			}
+		}
+	}
+
+	/* only the current line of every input is in memory */
+	while (nr_heap) {
+		k = heap[0]->key;
+		if (strlen(k) >= cur_alloc) {
+			free(cur);
+			cur_alloc = strlen(k) + 256;
+			cur = malloc(cur_alloc);
+			if (!cur) {
+				r = -ENOMEM;
+				goto out;
+			}
+		}
+		strcpy(cur, k);
+		memset(&la, 0, sizeof(la));
+
+		while (nr_heap && !strcmp(heap[0]->key, cur)) {
+			la_merge(&la, &heap[0]->la);
+			r = input_next(heap[0]);
+			if (r < 0)
+				goto out;
+			if (!r)
+				heap[0] = heap[--nr_heap];
+			sift_down(heap, nr_heap, 0);
+		}
+
+		if (!comm_matches(cur))
+			continue;
+		if (to_snapshot) {
+			put_line(&out, cur, &la);
+			if (out.len >= 65536) {
+				r = ob_flush(&out, fd);
+				if (r < 0)
+					goto out;
+			}
+		} else {
+			r = report_line(&rs, cur, &la, si.sample_factor);
+			if (r < 0)
+				goto out;
+		}
+	}
+
+	if (to_snapshot) {
+		r = out.error ?: ob_flush(&out, fd);
+		if (close(fd) < 0 && r == 0)
+			r = -errno;
+		fd = -1;
+		if (r == 0 && rename(tmp, arg_output) < 0)
+			r = -errno;
+		if (r < 0)
+			fprintf(stderr, "Cannot write %s: %s\n", arg_output, strerror(-r));
+	} else {
+		if (rs.nr_names && !sym_translator_built()) {
+			r = sym_translator_build();
+			if (r < 0) {
+				fprintf(stderr, "Failed to init the symbol map.\n");
+				goto out;
+			}
+		}
+		if (arg_diff)
+			diff_set_intervals(si.intervals);
+		pa_dump_and_clear_at(si.last);
+	}
+
+out:
+	if (fd >= 0) {
+		close(fd);
+		unlink(tmp);
+	}
+	if (!to_snapshot) {
+		pa_fini();
+		sym_translator_fini();
+		lat_translator_fini();
+	}
+	for (i = 0; inputs && i < n; i++) {
+		if (inputs[i].f)
+			fclose(inputs[i].f);
+		free(inputs[i].line);
+		free(inputs[i].prev);
+	}
+	for (i = 0; i < rs.nr_names; i++)
+		free(rs.names[i]);
+	free(rs.names);
+	free(rs.name_hash);
+	free(inputs);
+	free(heap);
+	free(cur);
+	free(tmp);
+	ob_free(&out);
+	return r;
+}
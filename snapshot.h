@@ -0,0 +1,29 @@
+/*
+ * Copyright 2026 agent
+ * Author: agent <agent@local>
+ * License: GPLv2
+ */
+#ifndef _SNAPSHOT_H
+#define _SNAPSHOT_H
+
+#include "back_trace.h"
+#include "outbuf.h"
+#include "process.h"
+
+void snapshot_writer_fini(void);
+
+/* Appends the stack as in the snapshot keys, ";outermost;...;innermost" */
+void snapshot_put_stack(struct outbuf *ob, const struct back_trace *bt);
+
+/* Calls fn for every line of the snapshot file. Returns 0 or -errno. */
+int  snapshot_load(const char *path, unsigned long *intervals,
+                   void (*fn)(const char *key, const struct latency_account *la, void *userdata),
+                   void *userdata);
+
+/*
+ * Merges the snapshot files in one pass into a snapshot (with -f snapshot)
+ * or a report of the sum. Returns 0 or -errno.
+ */
+int  snapshot_merge(char **paths, unsigned n);
+
+#endif
@@ -0,0 +1,276 @@
+/*
+ * stack_rewrite changes the frames of a stack before it is interned.
+ *
+ * With --by-function every frame is replaced by the start of the symbol
+ * containing it, so the wakeups from different call sites in one function
+ * become one stack, as they are printed the same anyway. The symbol of an
+ * address is cached, kernel stacks have only so many distinct return
+ * addresses.
+ *
+ * The --drop and --collapse rules are glob patterns on the symbol names.
+ * Once the symbols are loaded, they are compiled into the rule number of
+ * every symbol, so applying them is one array lookup per frame. Dropping
+ * __schedule and friends leaves more of --stack-depth for the callers and
+ * makes fewer distinct stacks.
+ *
+ * Copyright 2026 agent
+ * Author: agent <agent@local>
+ * License: GPLv2
+ */
+#include <errno.h>
+#include <fnmatch.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "stack_rewrite.h"
+
+#include "fnv1a.h"
+#include "lattop.h"
+#include "stack_table.h"
+#include "sym_translator.h"
+#include "symbol_loader.h"
+
+#define MAX_RULES 64
+
+struct fold_rule {
+	enum fold_rule_type type;
+	const char *pattern;
+};
+
+static struct fold_rule rules[MAX_RULES];
+static unsigned nr_rules;
+/* per symbol index, the number of the first matching rule + 1, or 0 */
+static uint8_t *rule_of;
+
+struct addr_slot {
+	unsigned long addr;	/* 0 for a free slot */
+	int index;		/* of the symbol, or -1 */
+};
+
+/* open addressing, at most half full */
+static struct addr_slot *slots;
+static unsigned nr_slots, nr_addrs;
+
+/* stack table id -> id of the rewritten stack + 1, for recordings */
+static int *rewritten;
+static unsigned rewritten_len;
+
+static bool symbols_checked, have_symbols;
+
+int stack_rewrite_add_rule(enum fold_rule_type type, const char *pattern)
+{
+	if (nr_rules == MAX_RULES)
+		return -ENOSPC;
+	if (!*pattern)
+		return -EINVAL;
+
+	rules[nr_rules].type = type;
+	rules[nr_rules].pattern = pattern;
+	nr_rules++;
+	return 0;
+}
+
+bool stack_rewrite_active(void)
+{
+	return arg_by_function || nr_rules;
+}
+
+unsigned stack_rewrite_probe_depth(void)
+{
+	unsigned i;
+
+	for (i = 0; i < nr_rules; i++)
+		if (rules[i].type == FOLD_DROP)
+			return arg_stack_depth * 2 < MAX_BT_LEN ? arg_stack_depth * 2 : MAX_BT_LEN;
+	return arg_stack_depth;
+}
+
+static uint32_t hash_addr(unsigned long addr)
+{
+	return fnv1a_bytes(&addr, sizeof(addr));
+}
+
+static int grow_slots(void)
+{
+	struct addr_slot *new_slots;
+	unsigned new_nr = nr_slots ? nr_slots * 2 : 4096;
+	unsigned i, j;
+
+	new_slots = calloc(new_nr, sizeof(struct addr_slot));
+	if (!new_slots)
+		return -ENOMEM;
+
+	for (i = 0; i < nr_slots; i++) {
+		if (!slots[i].addr)
+			continue;
+		j = hash_addr(slots[i].addr) & (new_nr - 1);
+		while (new_slots[j].addr)
+			j = (j + 1) & (new_nr - 1);
+		new_slots[j] = slots[i];
+	}
+
+	free(slots);
+	slots = new_slots;
+	nr_slots = new_nr;
+	return 0;
+}
+
+/* The symbol index of addr, -1 if unknown */
+static int symbol_of(unsigned long addr)
+{
+	unsigned i;
+	int index;
+
+	if (nr_slots) {
+		for (i = hash_addr(addr) & (nr_slots - 1); slots[i].addr; i = (i + 1) & (nr_slots - 1))
+			if (slots[i].addr == addr)
+				return slots[i].index;
+	}
+
+	index = sym_translator_lookup_index(addr);
+	if (2 * (nr_addrs + 1) > nr_slots && grow_slots() < 0)
+		return index;
+
+	for (i = hash_addr(addr) & (nr_slots - 1); slots[i].addr; i = (i + 1) & (nr_slots - 1))
+		;
+	slots[i].addr = addr;
+	slots[i].index = index;
+	nr_addrs++;
+	return index;
+}
+
+static int compile_rules(void)
+{
+	unsigned n = sym_translator_count(), i, r;
+	bool *used;
+
+	if (!nr_rules)
+		return 0;
+
+	rule_of = calloc(n, sizeof(uint8_t));
+	used = calloc(nr_rules, sizeof(bool));
+	if (!rule_of || !used) {
+		free(used);
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < n; i++) {
+		for (r = 0; r < nr_rules; r++) {
+			if (!fnmatch(rules[r].pattern, sym_translator_name(i), 0)) {
+				rule_of[i] = r + 1;
+				used[r] = true;
+				break;
+			}
+		}
+	}
+
+	for (r = 0; r < nr_rules; r++)
+		if (!used[r])
+			fprintf(stderr, "Warning: No symbol matches '%s'.\n", rules[r].pattern);
+	free(used);
+	return 0;
+}
+
+/*
+ * Live, the symbols are still loading when the first events come. A merge
+ * of snapshots builds them from the keys before its first stack.
+ */
+static bool symbols_ready(void)
+{
+	if (!symbols_checked) {
+		symbols_checked = true;
+		have_symbols = symbol_loader_wait() == 0 && sym_translator_built() &&
+		               sym_translator_count();
+		if (have_symbols && compile_rules() < 0) {
+			fprintf(stderr, "Failed to compile the frame rules.\n");
+			have_symbols = false;
+		}
+	}
+	return have_symbols;
+}
+
+static const struct back_trace *rewrite(const struct back_trace *bt, struct back_trace *buf,
+                                        unsigned limit)
+{
+	unsigned i, n = 0, rule, prev_rule = 0;
+	unsigned long addr;
+	int index;
+
+	if (!stack_rewrite_active() || !symbols_ready())
+		return bt;
+
+	for (i = 0; i < MAX_BT_LEN && n < limit; i++) {
+		if (bt->trace[i] == 0 || bt->trace[i] == ULONG_MAX)
+			break;
+
+		index = symbol_of(bt->trace[i]);
+		addr = index >= 0 && arg_by_function ? sym_translator_addr(index) : bt->trace[i];
+		rule = index >= 0 && rule_of ? rule_of[index] : 0;
+
+		if (rule && rules[rule - 1].type == FOLD_DROP)
+			continue;
+		/* innermost first, the run's later frames are its callers */
+		if (rule && rule == prev_rule)
+			buf->trace[n - 1] = addr;
+		else
+			buf->trace[n++] = addr;
+		prev_rule = rule;
+	}
+	if (n < MAX_BT_LEN)
+		buf->trace[n] = 0;
+	return buf;
+}
+
+const struct back_trace *stack_rewrite(const struct back_trace *bt, struct back_trace *buf)
+{
+	/* the probe recorded extra frames to make up for the dropped ones */
+	return rewrite(bt, buf, stack_rewrite_probe_depth() > arg_stack_depth ?
+	                        arg_stack_depth : MAX_BT_LEN);
+}
+
+int stack_rewrite_id(int id)
+{
+	struct back_trace bt, buf;
+	unsigned new_len;
+	int *r, new_id;
+
+	if (!stack_rewrite_active())
+		return id;
+
+	if ((unsigned) id < rewritten_len && rewritten[id])
+		return rewritten[id] - 1;
+
+	stack_table_get(id, &bt);
+	new_id = stack_table_intern(rewrite(&bt, &buf, MAX_BT_LEN));
+	if (new_id < 0)
+		return new_id;
+
+	if ((unsigned) id >= rewritten_len) {
+		new_len = rewritten_len ? rewritten_len : 1024;
+		while (new_len <= (unsigned) id)
+			new_len *= 2;
+		r = realloc(rewritten, new_len * sizeof(int));
+		if (!r)
+			return new_id;
+		memset(r + rewritten_len, 0, (new_len - rewritten_len) * sizeof(int));
+		rewritten = r;
+		rewritten_len = new_len;
+	}
+	rewritten[id] = new_id + 1;
+	return new_id;
+}
+
+void stack_rewrite_fini(void)
+{
+	free(slots);
+	free(rewritten);
+	free(rule_of);
+	slots = NULL;
+	rewritten = NULL;
+	rule_of = NULL;
+	nr_slots = nr_addrs = rewritten_len = 0;
+	symbols_checked = have_symbols = false;
+}
@@ -0,0 +1,33 @@
+/*
+ * Copyright 2026 agent
+ * Author: agent <agent@local>
+ * License: GPLv2
+ */
+#ifndef _STACK_REWRITE_H
+#define _STACK_REWRITE_H
+
+#include <stdbool.h>
+
+#include "back_trace.h"
+
+enum fold_rule_type {
+	FOLD_DROP,	/* the matching frames are left out */
+	FOLD_COLLAPSE,	/* a run of frames matching one rule keeps only its outermost */
+};
+
+/* Adds a rule for the symbols matching the glob pattern, the first matching rule applies */
+int  stack_rewrite_add_rule(enum fold_rule_type type, const char *pattern);
+/* Whether any rewriting is enabled, --by-function or a rule */
+bool stack_rewrite_active(void);
+/* The frames the probe should record, more than --stack-depth when frames are dropped */
+unsigned stack_rewrite_probe_depth(void);
+/*
+ * Returns bt itself, or its rewritten copy in buf. The first call waits
+ * for the symbols.
+ */
+const struct back_trace *stack_rewrite(const struct back_trace *bt, struct back_trace *buf);
+/* The same for an interned stack, returns the rewritten stack's id or -errno */
+int  stack_rewrite_id(int id);
+void stack_rewrite_fini(void);
+
+#endif
@@ -0,0 +1,175 @@
+/*
+ * The frames of a trace are stored as offsets from the start of the
+ * kernel text mapping, each one as the zigzag varint of the difference
+ * to the previous frame. Kernel and module text is within 2 GiB of the
+ * base, and the frames of a trace are mostly close to each other, so a
+ * frame takes 3 or 4 bytes instead of 8 and a trace only as many frames
+ * as it has.
+ *
+ * Copyright 2026 agent
+ * Author: agent <agent@local>
+ * License: GPLv2
+ */
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "stack_table.h"
+
+#include "fnv1a.h"
+
+#if ULONG_MAX > 0xffffffffUL
+#define TEXT_BASE 0xffffffff80000000UL
+#else
+#define TEXT_BASE 0xc0000000UL
+#endif
+
+/* a varint of a 64-bit value takes at most 10 bytes */
+#define MAX_ENCODED_LEN (MAX_BT_LEN * 10)
+
+/* the encoded traces back to back, trace id spans [starts[id], starts[id + 1]) */
+static uint8_t *data;
+static size_t data_len, data_alloc;
+static uint32_t *starts;
+static unsigned nr_stacks, starts_alloc;
+
+/* open addressing, id + 1 in the slots, at most half full */
+static unsigned *slots;
+static unsigned nr_slots;
+
+static unsigned encode(const struct back_trace *bt, uint8_t *buf)
+{
+	unsigned long prev = 0, off;
+	uint64_t v;
+	unsigned n = 0;
+	int i;
+
+	for (i = 0; i < MAX_BT_LEN; i++) {
+		if (bt->trace[i] == 0 || bt->trace[i] == ULONG_MAX)
+			break;
+		off = bt->trace[i] - TEXT_BASE;
+		v = (int64_t) (off - prev);
+		v = (v << 1) ^ (uint64_t) ((int64_t) v >> 63);
+		prev = off;
+		while (v >= 0x80) {
+			buf[n++] = (v & 0x7f) | 0x80;
+			v >>= 7;
+		}
+		buf[n++] = v;
+	}
+	return n;
+}
+
+static unsigned encoded_len(unsigned id)
+{
+	return starts[id + 1] - starts[id];
+}
+
+static int grow_slots(void)
+{
+	unsigned *new_slots, new_nr = nr_slots ? nr_slots * 2 : 1024;
+	unsigned i, j;
+
+	new_slots = calloc(new_nr, sizeof(unsigned));
+	if (!new_slots)
+		return -ENOMEM;
+
+	for (i = 0; i < nr_stacks; i++) {
+		j = fnv1a_bytes(data + starts[i], encoded_len(i)) & (new_nr - 1);
+		while (new_slots[j])
+			j = (j + 1) & (new_nr - 1);
+		new_slots[j] = i + 1;
+	}
+
+	free(slots);
+	slots = new_slots;
+	nr_slots = new_nr;
+	return 0;
+}
+
+int stack_table_intern(const struct back_trace *bt)
+{
+	uint8_t buf[MAX_ENCODED_LEN];
+	unsigned len, i;
+
+	if (2 * (nr_stacks + 1) > nr_slots && grow_slots() < 0)
+		return -ENOMEM;
+
+	len = encode(bt, buf);
+	for (i = fnv1a_bytes(buf, len) & (nr_slots - 1); slots[i]; i = (i + 1) & (nr_slots - 1))
+		if (encoded_len(slots[i] - 1) == len &&
+		    !memcmp(data + starts[slots[i] - 1], buf, len))
+			return slots[i] - 1;
+
+	if (nr_stacks + 2 > starts_alloc) {
+		unsigned new_alloc = starts_alloc ? starts_alloc * 2 : 512;
+		uint32_t *s = realloc(starts, new_alloc * sizeof(uint32_t));
+		if (!s)
+			return -ENOMEM;
+		starts = s;
+		starts_alloc = new_alloc;
+	}
+	if (data_len + len > data_alloc) {
+		size_t new_alloc = data_alloc ? data_alloc * 2 : 16384;
+		uint8_t *d;
+
+		if (new_alloc > UINT32_MAX)
+			return -ENOMEM;
+		d = realloc(data, new_alloc);
+		if (!d)
+			return -ENOMEM;
+		data = d;
+		data_alloc = new_alloc;
+	}
+
+	memcpy(data + data_len, buf, len);
+	starts[nr_stacks] = data_len;
+	data_len += len;
+	starts[nr_stacks + 1] = data_len;
+	slots[i] = ++nr_stacks;
+	return nr_stacks - 1;
+}
+
+unsigned stack_table_get(int id, struct back_trace *bt)
+{
+	const uint8_t *p = data + starts[id], *end = data + starts[id + 1];
+	unsigned long off = 0;
+	unsigned n = 0, shift;
+	uint64_t v;
+
+	while (p < end) {
+		for (v = 0, shift = 0; ; shift += 7) {
+			v |= (uint64_t) (*p & 0x7f) << shift;
+			if (!(*p++ & 0x80))
+				break;
+		}
+		off += (int64_t) (v >> 1) ^ -(int64_t) (v & 1);
+		bt->trace[n++] = off + TEXT_BASE;
+	}
+	memset(bt->trace + n, 0, (MAX_BT_LEN - n) * sizeof(unsigned long));
+	return n;
+}
+
+unsigned stack_table_size(void)
+{
+	return nr_stacks;
+}
+
+size_t stack_table_bytes(void)
+{
+	return data_alloc + starts_alloc * sizeof(uint32_t) + nr_slots * sizeof(unsigned);
+}
+
+void stack_table_fini(void)
+{
+	free(data);
+	free(starts);
+	free(slots);
+	data = NULL;
+	starts = NULL;
+	slots = NULL;
+	data_len = data_alloc = 0;
+	nr_stacks = starts_alloc = nr_slots = 0;
+}
@@ -0,0 +1,26 @@
+/*
+ * Copyright 2026 agent
+ * Author: agent <agent@local>
+ * License: GPLv2
+ */
+#ifndef _STACK_TABLE_H
+#define _STACK_TABLE_H
+
+#include <stddef.h>
+
+#include "back_trace.h"
+
+/*
+ * Interns back traces. Equal traces get the same small integer id, which
+ * stays valid until stack_table_fini(). The traces are stored with
+ * variable length, a frame usually takes 3 or 4 bytes.
+ */
+int  stack_table_intern(const struct back_trace *bt);	/* id or -ENOMEM */
+/* Decodes the trace, the rest of bt is zeroed. Returns the number of frames. */
+unsigned stack_table_get(int id, struct back_trace *bt);
+unsigned stack_table_size(void);
+/* Memory used by the table */
+size_t stack_table_bytes(void);
+void stack_table_fini(void);
+
+#endif
@@ -0,0 +1,213 @@
+/*
+ * stap_module_cache keeps compiled SystemTap modules, so that only the first
+ * run on a given kernel pays for the translate/compile pipeline.
+ *
+ * Modules are stored as CACHE_DIR/<uname -r>/lattop_<hash of the script>.ko,
+ * where CACHE_DIR is $XDG_CACHE_HOME/lattop or ~/.cache/lattop.
+ * Filters are module parameters, so they are not part of the key.
+ *
+ * Copyright 2026 agent
+ * Author: agent <agent@local>
+ * License: GPLv2
+ */
+
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/utsname.h>
+#include <sys/wait.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "stap_module_cache.h"
+
+static int hash_file(const char *path, uint64_t *hash)
+{
+	char buf[4096];
+	uint64_t h = 14695981039346656037ULL;  /* FNV-1a */
+	ssize_t n, i;
+	int fd;
+
+	fd = open(path, O_RDONLY|O_CLOEXEC);
+	if (fd < 0)
+		return -errno;
+
+	while ((n = read(fd, buf, sizeof(buf))) > 0) {
+		for (i = 0; i < n; i++) {
+			h ^= (unsigned char) buf[i];
+			h *= 1099511628211ULL;
+		}
+	}
+	close(fd);
+	if (n < 0)
+		return -EIO;
+
+	*hash = h;
+	return 0;
+}
+
+static int mkdir_p(char *path)
+{
+	char *p;
+
+	for (p = path + 1; *p; p++) {
+		if (*p != '/')
+			continue;
+		*p = '\0';
+		if (mkdir(path, 0700) < 0 && errno != EEXIST) {
+			*p = '/';
+			return -errno;
+		}
+		*p = '/';
+	}
+
+	if (mkdir(path, 0700) < 0 && errno != EEXIST)
+		return -errno;
+
+	return 0;
+}
+
+static int get_cache_dir(char **dir)
+{
+	const char *base = getenv("XDG_CACHE_HOME");
+	const char *home = getenv("HOME");
+	struct utsname uts;
+	int r;
+
+	if (uname(&uts) < 0)
+		return -errno;
+
+	if (base && *base)
+		r = asprintf(dir, "%s/lattop/%s", base, uts.release);
+	else if (home && *home)
+		r = asprintf(dir, "%s/.cache/lattop/%s", home, uts.release);
+	else
+		return -ENOENT;
+
+	if (r < 0)
+		return -ENOMEM;
+
+	r = mkdir_p(*dir);
+	if (r < 0)
+		free(*dir);
+
+	return r;
+}
+
+int stap_module_cache_name(const char *script, char name[STAP_MODULE_NAME_MAX])
+{
+	uint64_t hash = 0;
+	int r;
+
+	r = hash_file(script, &hash);
+	if (r < 0)
+		return r;
+
+	snprintf(name, STAP_MODULE_NAME_MAX, "lattop_%016llx", (unsigned long long) hash);
+	return 0;
+}
+
+/* runs 'stap -p4' in build_dir, which leaves the module there */
+static int build_module(const char *script, const char *name, const char *build_dir)
+{
+	int status;
+	pid_t pid;
+
+	pid = fork();
+	if (pid < 0)
+		return -errno;
+
+	if (pid == 0) {
+		/* stdout is the pipe to lattop, stap must not write there */
+		if (dup2(STDERR_FILENO, STDOUT_FILENO) < 0 || chdir(build_dir) < 0) {
+			perror("Preparing the module build");
+			_exit(1);
+		}
+		execlp("stap", "stap", "-g", "-p4", STAP_MAXSTRINGLEN, "-m", name, script, NULL);
+		perror("Failed to execute 'stap'");
+		_exit(1);
+	}
+
+	while (waitpid(pid, &status, 0) < 0) {
+		if (errno != EINTR)
+			return -errno;
+	}
+
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+		return -EIO;
+
+	return 0;
+}
+
+int stap_module_cache_get(const char *script, char **module_path)
+{
+	char abs_script[PATH_MAX];
+	char *dir = NULL, *build_dir = NULL, *built = NULL, *path = NULL;
+	char name[STAP_MODULE_NAME_MAX];
+	int r;
+
+	if (!realpath(script, abs_script))
+		return -errno;
+
+	r = stap_module_cache_name(abs_script, name);
+	if (r < 0)
+		return r;
+
+	r = get_cache_dir(&dir);
+	if (r < 0)
+		return r;
+
+	if (asprintf(&path, "%s/%s.ko", dir, name) < 0) {
+		path = NULL;
+		r = -ENOMEM;
+		goto out;
+	}
+
+	if (access(path, R_OK) == 0)
+		goto out;
+
+	fprintf(stderr, "Compiling the Systemtap module into %s ...\n", dir);
+
+	if (asprintf(&build_dir, "%s/build.XXXXXX", dir) < 0) {
+		build_dir = NULL;
+		r = -ENOMEM;
+		goto out;
+	}
+	if (!mkdtemp(build_dir)) {
+		r = -errno;
+		goto out;
+	}
+
+	r = build_module(abs_script, name, build_dir);
+	if (r < 0)
+		goto out_rmdir;
+
+	if (asprintf(&built, "%s/%s.ko", build_dir, name) < 0) {
+		built = NULL;
+		r = -ENOMEM;
+		goto out_rmdir;
+	}
+
+	/* atomic, a concurrent lattop never sees a partial module */
+	if (rename(built, path) < 0)
+		r = -errno;
+
+out_rmdir:
+	if (built)
+		unlink(built);
+	rmdir(build_dir);
+out:
+	free(built);
+	free(build_dir);
+	free(dir);
+	if (r < 0)
+		free(path);
+	else
+		*module_path = path;
+	return r;
+}
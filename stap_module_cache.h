@@ -0,0 +1,24 @@
+/*
+ * Copyright 2026 agent
+ * Author: agent <agent@local>
+ * License: GPLv2
+ */
+#ifndef _STAP_MODULE_CACHE_H
+#define _STAP_MODULE_CACHE_H
+
+#define STAP_MODULE_NAME_MAX 32
+
+/* A back trace of MAX_BT_LEN frames is longer than stap's default strings */
+#define STAP_MAXSTRINGLEN "-DMAXSTRINGLEN=1280"
+
+/* The module name is derived from the script's contents */
+int stap_module_cache_name(const char *script, char name[STAP_MODULE_NAME_MAX]);
+
+/*
+ * Returns the path of the compiled kernel module for the script, building
+ * it first if it is not cached yet for the running kernel release.
+ * Build output goes to stderr. The caller frees the returned path.
+ */
+int stap_module_cache_get(const char *script, char **module_path);
+
+#endif
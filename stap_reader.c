@@ -1,6 +1,10 @@
 /*
  * stap_reader reads stack traces of waking processes using a SystemTap script
  *
+ * With --input it reads the script's output from a file instead, e.g. from
+ * lattop-gen or a saved "stap lat.stp", and ends the last interval at its
+ * end. There is no probe to push the filters to then.
+ *
  * Copyright 2013 Red Hat Inc.
  * Author: Michal Schmidt
  * License: GPLv2
@@ -12,6 +16,7 @@
 #include <assert.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <inttypes.h>
 #include <signal.h>
 #include <stdbool.h>
 #include <stdio.h>
@@ -22,15 +27,38 @@
 #include "stap_reader.h"
 
 #include "back_trace.h"
+#include "filter.h"
+#include "governor.h"
 #include "process_accountant.h"
+#include "self_stats.h"
+#include "probes.h"
+#include "stack_rewrite.h"
+#include "stap_module_cache.h"
+#include "timer_reader.h"
 #include "lattop.h"
 
+/* the events parsed from one read are accounted together */
+#define ACCOUNT_BATCH 64
+
+struct parsed_event {
+	unsigned long pid;
+	char comm[16];
+	struct la_event ev;
+	unsigned weight;
+	struct back_trace bt;
+};
+
 struct stap_reader {
 	/* must be first */
 	struct polled_reader pr;
 
 	int pipe[2];
 	pid_t stap_pid;
+	const char *input;	/* the file instead of stap */
+	char module_name[STAP_MODULE_NAME_MAX];
+	/* while starting, applied on "lat begin" */
+	bool delays_changed;
+	bool filters_changed;
 
 	enum { STAP_STARTING, STAP_WANT_PROC_INFO, STAP_WANT_LATENCY } state;
 
@@ -44,18 +72,51 @@ struct stap_reader {
 
 	/* data read in state STAP_WANT_PROC_INFO */
 	char comm[16]; /* TASK_COMM_LEN */
-	unsigned long delay;
 	unsigned long pid;
-	unsigned long tid;
-	char sleep_or_block;
+	struct la_event ev;
+	unsigned weight;	/* the sample_n the probe sampled the event under */
+
+	struct parsed_event batch[ACCOUNT_BATCH];
+	unsigned batch_len;
+
+	unsigned long long seq;	/* of the last event, the probe counts from 1 */
+	bool warned_malformed;
 };
 
+/* module parameters passed to staprun */
+#define NR_PARAMS 6
+
+static int stap_reader_start_input(struct stap_reader *sr)
+{
+	sr->pipe[0] = open(sr->input, O_RDONLY|O_CLOEXEC);
+	if (sr->pipe[0] < 0) {
+		fprintf(stderr, "Cannot open %s: %s\n", sr->input, strerror(errno));
+		return -errno;
+	}
+
+	return 0;
+}
+
 static int stap_reader_start(struct polled_reader *pr)
 {
 	struct stap_reader *sr = (struct stap_reader*) pr;
 	pid_t pid;
 	int r;
 
+	if (sr->input)
+		return stap_reader_start_input(sr);
+
+	r = stap_module_cache_name("lat.stp", sr->module_name);
+	if (r < 0) {
+		fprintf(stderr, "Cannot read lat.stp: %s\n", strerror(-r));
+		return r;
+	}
+
+	self_stats.live = true;
+
+	/* the sets are filled when the probe has started */
+	sr->filters_changed = filter_active();
+
 	r = pipe2(sr->pipe, 0);
 	if (r < 0) {
 		r = -errno;
@@ -72,8 +133,10 @@ static int stap_reader_start(struct polled_reader *pr)
 
 	if (pid == 0) {
 		/* child */
-		char *argv[7];
-		unsigned n;
+		char *argv[5 + 2*NR_PARAMS + 1];
+		char *params[NR_PARAMS];
+		char *module;
+		unsigned n, i;
 
 		close(sr->pipe[0]);
 		r = dup2(sr->pipe[1], STDOUT_FILENO);
@@ -82,19 +145,42 @@ static int stap_reader_start(struct polled_reader *pr)
 			exit(1);
 		}
 
+		asprintf(&params[0], "min_delay=%llu", arg_min_delay);
+		asprintf(&params[1], "max_interruptible_delay=%llu", arg_max_interruptible_delay);
+		/* drop everything until the filter sets are pushed */
+		asprintf(&params[2], "filter_on=%d", filter_active());
+		asprintf(&params[3], "sample_n=%u", governor_sample_factor());
+		asprintf(&params[4], "tid_rate=%u", arg_tid_rate);
+		asprintf(&params[5], "stack_depth=%u", stack_rewrite_probe_depth());
+
 		n = 0;
-		argv[n++] = "stap";
-		argv[n++] = "-g";
-		argv[n++] = "lat.stp";
-		asprintf(&argv[n++], "%llu", arg_min_delay);
-		asprintf(&argv[n++], "%llu", arg_max_interruptible_delay);
-		asprintf(&argv[n++], "%d", arg_pid_filter);
+		r = stap_module_cache_get("lat.stp", &module);
+		if (r == 0) {
+			/* staprun takes the filters as module parameters */
+			argv[n++] = "staprun";
+			argv[n++] = module;
+			for (i = 0; i < NR_PARAMS; i++)
+				argv[n++] = params[i];
+		} else {
+			fprintf(stderr, "Warning: Cannot use a cached module (%s), running stap directly.\n",
+				strerror(-r));
+			argv[n++] = "stap";
+			argv[n++] = "-g";
+			argv[n++] = STAP_MAXSTRINGLEN;
+			argv[n++] = "-m";
+			argv[n++] = sr->module_name;
+			argv[n++] = "lat.stp";
+			for (i = 0; i < NR_PARAMS; i++) {
+				argv[n++] = "-G";
+				argv[n++] = params[i];
+			}
+		}
 		argv[n++] = NULL;
 
-		execvp("stap", argv);
+		execvp(argv[0], argv);
 
 		/* only on failure */
-		perror("Failed to execute 'stap'");
+		fprintf(stderr, "Failed to execute '%s': %s\n", argv[0], strerror(errno));
 		exit(1);
 	}
 
@@ -113,6 +199,82 @@ out_pipe:
 	return r;
 }
 
+static int write_procfs(struct stap_reader *sr, const char *file, const char *value)
+{
+	char path[128];
+	int fd, len, r = 0;
+
+	if (sr->input)
+		return -EOPNOTSUPP;
+
+	snprintf(path, sizeof(path), "/proc/systemtap/%s/%s", sr->module_name, file);
+	fd = open(path, O_WRONLY|O_CLOEXEC);
+	if (fd < 0)
+		return -errno;
+
+	len = strlen(value);
+	if (write(fd, value, len) != len)
+		r = -EIO;
+
+	close(fd);
+	return r;
+}
+
+static int write_param(struct stap_reader *sr, const char *param,
+                       unsigned long long value)
+{
+	char buf[32];
+
+	snprintf(buf, sizeof(buf), "%llu\n", value);
+	return write_procfs(sr, param, buf);
+}
+
+static int write_filter_cmd(void *userdata, const char *cmd)
+{
+	char buf[128];
+
+	snprintf(buf, sizeof(buf), "%s\n", cmd);
+	return write_procfs(userdata, "filter", buf);
+}
+
+int stap_reader_set_delays(struct polled_reader *pr)
+{
+	struct stap_reader *sr = (struct stap_reader*) pr;
+	int r;
+
+	if (sr->state == STAP_STARTING) {
+		sr->delays_changed = true;
+		return -EAGAIN;
+	}
+
+	r = write_param(sr, "min_delay", arg_min_delay);
+	if (!r)
+		r = write_param(sr, "max_interruptible_delay", arg_max_interruptible_delay);
+	return r;
+}
+
+int stap_reader_set_filters(struct polled_reader *pr)
+{
+	struct stap_reader *sr = (struct stap_reader*) pr;
+
+	if (sr->state == STAP_STARTING) {
+		sr->filters_changed = true;
+		return -EAGAIN;
+	}
+
+	return filter_for_each_command(write_filter_cmd, sr);
+}
+
+int stap_reader_set_sampling(struct polled_reader *pr, unsigned sample_n)
+{
+	struct stap_reader *sr = (struct stap_reader*) pr;
+
+	if (sr->state == STAP_STARTING)
+		return -EAGAIN;
+
+	return write_param(sr, "sample_n", sample_n);
+}
+
 static ssize_t buf_refill(struct stap_reader *sr)
 {
 	struct iovec iovecs[2];
@@ -145,6 +307,10 @@ static ssize_t buf_refill(struct stap_reader *sr)
 		return -errno;
 
 	sr->fill_count += nread;
+	self_stats.bytes_read += nread;
+	LATTOP_PROBE2(refill, nread, sr->fill_count);
+	if (sr->fill_count > self_stats.ring_high_water)
+		self_stats.ring_high_water = sr->fill_count;
 
 	return nread;
 }
@@ -210,14 +376,34 @@ static ssize_t get_next_line(struct stap_reader *sr)
 	return line_len;
 }
 
+/* Timed as a whole, two clock reads per batch rather than per event */
+static void account_batch(struct stap_reader *sr)
+{
+	struct parsed_event *e;
+	uint64_t t;
+	unsigned i;
+
+	if (!sr->batch_len)
+		return;
+
+	t = self_stats_clock();
+	for (i = 0; i < sr->batch_len; i++) {
+		e = &sr->batch[i];
+		pa_account_latency(e->pid, e->comm, &e->ev, e->weight, &e->bt);
+	}
+	self_stats.stage_ns[STAGE_ACCOUNT] += self_stats_clock() - t;
+	self_stats.events += sr->batch_len;
+	sr->batch_len = 0;
+}
+
 static int read_all_lines(struct stap_reader *sr)
 {
 	ssize_t n;
 	char *str;
-	struct back_trace bt;
+	struct parsed_event *e;
+	unsigned long long seq;
 	int depth;
 	int nread;
-	bool end_of_trace;
 
 	for (;;) {
 		n = get_next_line(sr);
@@ -235,34 +421,50 @@ static int read_all_lines(struct stap_reader *sr)
 
 			lattop_reader_started(&sr->pr);
 			sr->state = STAP_WANT_PROC_INFO;
+			if (sr->delays_changed)
+				lattop_delays_changed();
+			if (sr->filters_changed)
+				lattop_filters_changed();
 			break;
 
 		case STAP_WANT_PROC_INFO:
-			if (sscanf(sr->line, "%c %lu %lu %lu %15[^\n]", &sr->sleep_or_block, &sr->delay, &sr->pid, &sr->tid, sr->comm) != 5) {
-				fprintf(stderr, "Malformed input line.\n");
-				return -EINVAL;
+			if (sscanf(sr->line, "%c %llu %" SCNu64 " %lu %d %" SCNu64 " %" SCNu16 " %u %15[^\n]",
+			           &sr->ev.type, &seq, &sr->ev.delay, &sr->pid, &sr->ev.tid,
+			           &sr->ev.time, &sr->ev.cpu, &sr->weight, sr->comm) != 9 ||
+			    !sr->weight) {
+				/* skipped until the next event, e.g. after a dropped buffer */
+				if (!sr->warned_malformed)
+					fprintf(stderr, "Malformed input line.\n");
+				sr->warned_malformed = true;
+				self_stats.malformed++;
+				break;
 			}
+			/* the probe's transport drops what does not fit its buffers */
+			if (seq > sr->seq + 1)
+				self_stats.probe_drops += seq - sr->seq - 1;
+			sr->seq = seq;
 			sr->state = STAP_WANT_LATENCY;
 			break;
 
 		case STAP_WANT_LATENCY:
+			e = &sr->batch[sr->batch_len++];
+			e->pid = sr->pid;
+			memcpy(e->comm, sr->comm, sizeof(e->comm));
+			e->ev = sr->ev;
+			e->weight = sr->weight;
+
+			/* the stack table reads up to the first 0 */
 			str = sr->line;
-			end_of_trace = false;
 			for (depth = 0; depth < MAX_BT_LEN; depth++) {
-				if (end_of_trace) {
-					bt.trace[depth] = 0;
-					continue;
-				}
-
-				if (sscanf(str, "%lx%n", &bt.trace[depth], &nread) == 1)
-					str += nread;
-				else {
-					bt.trace[depth] = 0;
-					end_of_trace = true;
+				if (sscanf(str, "%lx%n", &e->bt.trace[depth], &nread) != 1) {
+					e->bt.trace[depth] = 0;
+					break;
 				}
+				str += nread;
 			}
 
-			pa_account_latency(sr->pid, sr->tid, sr->comm, sr->delay, &bt);
+			if (sr->batch_len == ACCOUNT_BATCH)
+				account_batch(sr);
 			sr->state = STAP_WANT_PROC_INFO;
 			break;
 		}
@@ -273,6 +475,7 @@ static int stap_reader_handle_ready_fd(struct polled_reader *pr)
 {
 	struct stap_reader *sr = (struct stap_reader*) pr;
 	ssize_t refill_result;
+	uint64_t t, account, events, parse;
 	int r, i;
 
 	/* Finite loop count in order to give other polled readers a chance */
@@ -280,18 +483,35 @@ static int stap_reader_handle_ready_fd(struct polled_reader *pr)
 		refill_result = buf_refill(sr);
 		switch (refill_result) {
 		case 0:
-			return -1;
+			if (!sr->input)
+				return -1;
+			fprintf(stderr, "End of %s.\n", sr->input);
+			/* the views and the clients stay, the reports are done */
+			if (arg_interactive || arg_daemon) {
+				lattop_reader_stopped(pr);
+				return 0;
+			}
+			return timer_reader_tick() ?: 1;
 		case -EAGAIN:
 			return 0;
 		case -ENOSPC:
 			fprintf(stderr, "No space in read buffer before refilling. Weird.\n");
 			/* try to recover by dropping it all */
+			self_stats.dropped_bytes += sr->fill_count;
 			sr->fill_count = 0;
 			return 0;
 		default:;
 		}
 
+		t = self_stats_clock();
+		account = self_stats.stage_ns[STAGE_ACCOUNT];
+		events = self_stats.events;
 		r = read_all_lines(sr);
+		account_batch(sr);
+		account = self_stats.stage_ns[STAGE_ACCOUNT] - account;
+		parse = self_stats_clock() - t - account;
+		self_stats.stage_ns[STAGE_PARSE] += parse;
+		LATTOP_PROBE3(parse, self_stats.events - events, parse, account);
 		if (r < 0)
 			return r;
 	}
@@ -317,6 +537,8 @@ static void stap_reader_fini(struct polled_reader *pr)
 			}
 		} while (!WIFEXITED(status) && !WIFSIGNALED(status));
 	}
+	if (sr->input && sr->pipe[0] >= 0)
+		close(sr->pipe[0]);
 	free(sr->line);
 }
 
@@ -333,6 +555,35 @@ static const struct polled_reader_ops stap_reader_ops = {
 	.handle_ready_fd = stap_reader_handle_ready_fd,
 };
 
+struct polled_reader *stap_reader_new_stream(int fd)
+{
+	struct stap_reader *r;
+
+	r = (struct stap_reader*) stap_reader_new();
+	if (r == NULL)
+		return NULL;
+
+	/* past "lat begin", the caller owns the fd */
+	r->pipe[0] = fd;
+	r->state = STAP_WANT_PROC_INFO;
+
+	return &r->pr;
+}
+
+struct polled_reader *stap_reader_new_file(const char *path)
+{
+	struct stap_reader *r;
+
+	r = (struct stap_reader*) stap_reader_new();
+	if (r == NULL)
+		return NULL;
+
+	r->input = path;
+	r->pipe[0] = -1;
+
+	return &r->pr;
+}
+
 struct polled_reader *stap_reader_new(void)
 {
 	struct stap_reader *r;
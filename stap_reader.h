@@ -10,5 +10,14 @@
 #include "polled_reader.h"
 
 struct polled_reader *stap_reader_new(void);
+/* Parses the events of an already started probe from fd, without stap */
+struct polled_reader *stap_reader_new_stream(int fd);
+/* Reads the script's output from the file at path, starting at "lat begin" */
+struct polled_reader *stap_reader_new_file(const char *path);
+/* Pushes arg_min_delay and arg_max_interruptible_delay to the running probe */
+int stap_reader_set_delays(struct polled_reader *pr);
+/* Refills the probe's task filter sets */
+int stap_reader_set_filters(struct polled_reader *pr);
+int stap_reader_set_sampling(struct polled_reader *pr, unsigned sample_n);
 
 #endif
@@ -0,0 +1,220 @@
+/*
+ * Report writers for machine consumption: JSON Lines and CSV.
+ * There is one record per interval, thread and stack, with raw values.
+ *
+ * Copyright 2026 agent
+ * Author: agent <agent@local>
+ * License: GPLv2
+ */
+#include <alloca.h>
+
+#include "report.h"
+
+#include "back_trace.h"
+#include "stack_table.h"
+#include "sym_translator.h"
+
+static void json_begin(struct outbuf *ob, const struct report_info *ri)
+{
+}
+
+static void json_put_exemplars(struct outbuf *ob, const struct latency_account *la)
+{
+	struct la_event ex[LA_EXEMPLARS];
+	unsigned i, n;
+
+	n = la_sorted_exemplars(la, ex);
+	ob_puts(ob, ",\"exemplars\":[");
+	for (i = 0; i < n; i++) {
+		ob_puts(ob, i ? ",{\"time_ns\":" : "{\"time_ns\":");
+		ob_put_u64(ob, ex[i].time);
+		ob_puts(ob, ",\"tid\":");
+		ob_put_i64(ob, ex[i].tid);
+		ob_puts(ob, ",\"cpu\":");
+		ob_put_u64(ob, ex[i].cpu);
+		ob_puts(ob, ",\"type\":\"");
+		ob_putc(ob, ex[i].type);
+		ob_puts(ob, "\",\"delay_ns\":");
+		ob_put_u64(ob, ex[i].delay);
+		ob_putc(ob, '}');
+	}
+	ob_putc(ob, ']');
+}
+
+static void json_process(struct outbuf *ob, const struct report_info *ri,
+                         struct process *p)
+{
+	struct back_trace bt;
+	struct bt2la **array;
+	unsigned n, i, len;
+	enum la_state s;
+
+	array = alloca(sizeof(struct bt2la*) * p->bt2la_count);
+	process_sorted_bt2las(p, array, ri->sort, ri->reverse);
+
+	for (n = 0; n < p->bt2la_count; n++) {
+		const struct bt2la *bt2la = array[n];
+		const char *translation, *sym;
+
+		ob_puts(ob, "{\"interval\":");
+		ob_put_u64(ob, ri->seq);
+		ob_puts(ob, ",\"time\":");
+		ob_put_i64(ob, ri->time);
+		ob_puts(ob, ",\"pid\":");
+		ob_put_i64(ob, p->pid);
+		ob_puts(ob, ",\"tid\":");
+		ob_put_i64(ob, p->tid);
+		ob_puts(ob, ",\"comm\":");
+		ob_put_json_string(ob, p->comm);
+		ob_puts(ob, ",\"total_ns\":");
+		ob_put_u64(ob, bt2la->la.total);
+		ob_puts(ob, ",\"max_ns\":");
+		ob_put_u64(ob, bt2la->la.max);
+		ob_puts(ob, ",\"count\":");
+		ob_put_u64(ob, bt2la->la.count);
+		for (s = 0; s < _LA_NR_STATES; s++) {
+			ob_printf(ob, ",\"%s_total_ns\":", la_state_name(s));
+			ob_put_u64(ob, bt2la->la.state_total[s]);
+			ob_printf(ob, ",\"%s_max_ns\":", la_state_name(s));
+			ob_put_u64(ob, bt2la->la.state_max[s]);
+			ob_printf(ob, ",\"%s_count\":", la_state_name(s));
+			ob_put_u64(ob, bt2la->la.state_count[s]);
+		}
+		ob_puts(ob, ",\"sample_factor\":");
+		ob_put_u64(ob, ri->sample_factor);
+		json_put_exemplars(ob, &bt2la->la);
+
+		ob_puts(ob, ",\"translation\":");
+		len = stack_table_get(bt2la->stack_id, &bt);
+		translation = bt_translate(&bt);
+		if (translation)
+			ob_put_json_string(ob, translation);
+		else
+			ob_puts(ob, "null");
+
+		ob_puts(ob, ",\"addrs\":[");
+		for (i = 0; i < len; i++) {
+			if (i)
+				ob_putc(ob, ',');
+			ob_putc(ob, '"');
+			ob_put_hex(ob, bt.trace[i]);
+			ob_putc(ob, '"');
+		}
+		ob_puts(ob, "],\"symbols\":[");
+		for (i = 0; i < len; i++) {
+			if (i)
+				ob_putc(ob, ',');
+			sym = sym_translator_lookup(bt.trace[i]);
+			if (sym)
+				ob_put_json_string(ob, sym);
+			else
+				ob_puts(ob, "null");
+		}
+		ob_puts(ob, "]}\n");
+	}
+}
+
+static void json_end(struct outbuf *ob, const struct report_info *ri)
+{
+}
+
+const struct report_writer json_writer = {
+	.begin = json_begin,
+	.process = json_process,
+	.end = json_end,
+};
+
+static void csv_begin(struct outbuf *ob, const struct report_info *ri)
+{
+	if (ri->seq == 0)
+		ob_puts(ob, "interval,time,pid,tid,comm,total_ns,max_ns,count,"
+		            "sample_factor,translation,symbols,addrs,exemplars,"
+		            "sleep_total_ns,sleep_max_ns,sleep_count,"
+		            "block_total_ns,block_max_ns,block_count\n");
+}
+
+static void csv_process(struct outbuf *ob, const struct report_info *ri,
+                        struct process *p)
+{
+	struct la_event ex[LA_EXEMPLARS];
+	struct back_trace bt;
+	struct bt2la **array;
+	char symbols[MAX_BT_LEN * 64];
+	unsigned n, i, len, nex;
+	enum la_state s;
+
+	array = alloca(sizeof(struct bt2la*) * p->bt2la_count);
+	process_sorted_bt2las(p, array, ri->sort, ri->reverse);
+
+	for (n = 0; n < p->bt2la_count; n++) {
+		const struct bt2la *bt2la = array[n];
+		const char *translation;
+
+		ob_put_u64(ob, ri->seq);
+		ob_putc(ob, ',');
+		ob_put_i64(ob, ri->time);
+		ob_putc(ob, ',');
+		ob_put_i64(ob, p->pid);
+		ob_putc(ob, ',');
+		ob_put_i64(ob, p->tid);
+		ob_putc(ob, ',');
+		ob_put_csv_string(ob, p->comm);
+		ob_putc(ob, ',');
+		ob_put_u64(ob, bt2la->la.total);
+		ob_putc(ob, ',');
+		ob_put_u64(ob, bt2la->la.max);
+		ob_putc(ob, ',');
+		ob_put_u64(ob, bt2la->la.count);
+		ob_putc(ob, ',');
+		ob_put_u64(ob, ri->sample_factor);
+		ob_putc(ob, ',');
+
+		len = stack_table_get(bt2la->stack_id, &bt);
+		translation = bt_translate(&bt);
+		if (translation)
+			ob_put_csv_string(ob, translation);
+		ob_putc(ob, ',');
+
+		/* space separated, like in the text output */
+		bt_save_symbolic(&bt, symbols, sizeof(symbols));
+		ob_put_csv_string(ob, symbols);
+		ob_putc(ob, ',');
+
+		for (i = 0; i < len; i++) {
+			if (i)
+				ob_putc(ob, ' ');
+			ob_put_hex(ob, bt.trace[i]);
+		}
+		ob_putc(ob, ',');
+
+		/* TYPE:DELAY_NS:TIME_NS:TID:CPU, the largest delay first */
+		nex = la_sorted_exemplars(&bt2la->la, ex);
+		for (i = 0; i < nex; i++) {
+			if (i)
+				ob_putc(ob, ' ');
+			ob_printf(ob, "%c:%llu:%llu:%d:%u", ex[i].type,
+			          (unsigned long long) ex[i].delay,
+			          (unsigned long long) ex[i].time, ex[i].tid, ex[i].cpu);
+		}
+
+		for (s = 0; s < _LA_NR_STATES; s++) {
+			ob_putc(ob, ',');
+			ob_put_u64(ob, bt2la->la.state_total[s]);
+			ob_putc(ob, ',');
+			ob_put_u64(ob, bt2la->la.state_max[s]);
+			ob_putc(ob, ',');
+			ob_put_u64(ob, bt2la->la.state_count[s]);
+		}
+		ob_putc(ob, '\n');
+	}
+}
+
+static void csv_end(struct outbuf *ob, const struct report_info *ri)
+{
+}
+
+const struct report_writer csv_writer = {
+	.begin = csv_begin,
+	.process = csv_process,
+	.end = csv_end,
+};
@@ -17,11 +17,13 @@
 
 #include "rbtree.h"
 #include "lat_translator.h"
+#include "self_stats.h"
 
 struct symbol {
 	struct rb_node rb_node;
 	unsigned long addr;
 	ptrdiff_t name_offset;  /* relative to all_names */
+	struct symbol *alias;   /* other names of the same address */
 };
 
 struct symbol_slab {
@@ -39,9 +41,12 @@ static struct symbol_slab *first_slab, *current_slab;
 /* tree of symbols, only used during kallsyms parsing */
 static struct rb_root addr2fun = RB_ROOT;
 
-static char *addr_name_arrays;  /* storage for both addr_array and name_array */
+static char *addr_name_arrays;  /* storage for all the arrays below */
 static unsigned long *addr_array;  /* sorted for binary search */
 static char **name_array; /* pointers into all_names */
+static int *trans_id_array;   /* parallel to name_array, -1 if untranslated */
+static int *trans_prio_array; /* parallel to name_array */
+#define ARRAYS_SIZE(n) ((n) * (sizeof(unsigned long) + sizeof(char*) + 2*sizeof(int)))
 static char *all_names;   /* storage for all names: "name\0second_name\0third_name\0..." */
 static size_t all_names_alloc, all_names_end;
 static unsigned n_symbols;
@@ -127,17 +132,64 @@ static struct symbol *new_symbol(unsigned long addr, ptrdiff_t name_offset)
 	s = &current_slab->symbols[current_slab->fill_count++];
 	s->addr = addr;
 	s->name_offset = name_offset;
+	s->alias = NULL;
 	return s;
 }
 
-static void undo_new_symbol(struct symbol *s)
+/* Makes room for a name of up to 1023 characters at all_names_end */
+static int reserve_name(void)
 {
-	assert(current_slab->fill_count > 0);
-	current_slab->fill_count--;
-	assert(&current_slab->symbols[current_slab->fill_count] == s);
+	char *new_names;
+
+	if (!all_names) {
+		new_names = mmap(NULL, NAMES_INCREMENT, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+		if (new_names == MAP_FAILED) {
+			perror("Allocating memory for symbol names");
+			return -ENOMEM;
+		}
+		all_names = new_names;
+		all_names_alloc = NAMES_INCREMENT;
+	}
+
+	if (all_names_alloc - all_names_end < 1024) {
+		new_names = mremap(all_names, all_names_alloc, all_names_alloc + NAMES_INCREMENT, MREMAP_MAYMOVE);
+		if (new_names == MAP_FAILED) {
+			perror("Allocating memory for symbol names");
+			return -ENOMEM;
+		}
+		all_names = new_names;
+		all_names_alloc += NAMES_INCREMENT;
+	}
+
+	return 0;
+}
+
+/* Adds the symbol whose name was just stored at all_names_end */
+static int add_symbol(unsigned long addr)
+{
+	char *name = all_names + all_names_end;
+	struct symbol *s, *old;
+
+	s = new_symbol(addr, all_names_end);
+	if (!s) {
+		perror("Allocating memory for symbols");
+		return -ENOMEM;
+	}
+
+	old = insert_symbol(addr, s);
+	if (!old)
+		n_symbols++;
+	else {
+		/* Remember the alias. The preferred name is chosen in
+		 * build_arrays(), when the translations are known. */
+		s->alias = old->alias;
+		old->alias = s;
+	}
+	all_names_end += strlen(name) + 1;
+	return 0;
 }
 
-static int parse_kallsyms(void)
+static int parse_kallsyms(const char *path)
 {
 	FILE *f;
 	char *line = NULL;
@@ -145,42 +197,21 @@ static int parse_kallsyms(void)
 	ssize_t read;
 	unsigned long addr;
 	char type;
-	struct symbol *s, *old;
-	char *new_names;
-	char *name;
 	int r = 0;
 
-	f = fopen("/proc/kallsyms", "re");
+	f = fopen(path, "re");
 	if (!f) {
 		r = -errno;
-		perror("/proc/kallsyms");
-		goto err;
-	}
-
-	new_names = mmap(NULL, NAMES_INCREMENT, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
-	if (new_names == MAP_FAILED) {
-		perror("Allocating memory for symbol names");
-		r = -ENOMEM;
+		perror(path);
 		goto err;
 	}
-	all_names = new_names;
-	all_names_alloc = NAMES_INCREMENT;
 
 	while ((read = getline(&line, &len, f)) != -1) {
-		if (all_names_alloc - all_names_end < 1024) {
-			new_names = mremap(all_names, all_names_alloc, all_names_alloc + NAMES_INCREMENT, MREMAP_MAYMOVE);
-			if (new_names == MAP_FAILED) {
-				perror("Allocating memory for symbol names");
-				r = -ENOMEM;
-				goto err;
-			}
-			all_names = new_names;
-			all_names_alloc += NAMES_INCREMENT;
-		}
-
-		name = all_names + all_names_end;
+		r = reserve_name();
+		if (r)
+			goto err;
 
-		if (sscanf(line, "%lx %c %1023s", &addr, &type, name) != 3) {
+		if (sscanf(line, "%lx %c %1023s", &addr, &type, all_names + all_names_end) != 3) {
 			fprintf(stderr, "Failed to parse line: %s", line);
 			continue;
 		}
@@ -189,44 +220,14 @@ static int parse_kallsyms(void)
 		if (type != 't' && type != 'T')
 			continue;
 
-		s = new_symbol(addr, name - all_names);
-		if (!s) {
-			perror("Allocating memory for symbols");
-			r = -ENOMEM;
+		r = add_symbol(addr);
+		if (r)
 			goto err;
-		}
-
-		old = insert_symbol(addr, s);
-		if (!old) {
-			all_names_end += strlen(name) + 1;
-			n_symbols++;
-		} else {
-			const char *translation;
-			int prio;
-			/* prefer symbol names that have a translation defined */
-			if (lat_translator_lookup(name, &translation, &prio) == 0 &&
-			    lat_translator_lookup(all_names + old->name_offset, &translation, &prio) < 0) {
-				/* Replace the old symbol name with the better one.
-				 * Note that the old name is leaked inside all_names, but
-				 * this is sufficiently rare that it hardly matters. */
-				old->name_offset = name - all_names;
-				all_names_end += strlen(name) + 1;
-			}
-
-			undo_new_symbol(s);
-		}
 	}
 
 	if (all_names_end == 0)
 		goto err;
 
-	/* trim all_names to minimal required size */
-	all_names = mremap(all_names, all_names_alloc, all_names_end, 0);
-	assert(all_names != MAP_FAILED);
-	all_names_alloc = all_names_end;
-
-	mprotect(all_names, all_names_alloc, PROT_READ);
-
 	free(line);
 	fclose(f);
 	return 0;
@@ -244,14 +245,18 @@ static void delete_arrays(void)
 	if (all_names) {
 		munmap(all_names, all_names_alloc);
 		all_names = NULL;
+		all_names_alloc = all_names_end = 0;
 	}
 
 	if (addr_name_arrays) {
-		munmap(addr_name_arrays, n_symbols * (sizeof(unsigned long) + sizeof(char*)));
+		munmap(addr_name_arrays, ARRAYS_SIZE(n_symbols));
 		addr_array = NULL;
 		name_array = NULL;
+		trans_id_array = NULL;
+		trans_prio_array = NULL;
 		addr_name_arrays = NULL;
 	}
+	n_symbols = 0;
 }
 
 static int build_arrays(void)
@@ -260,27 +265,51 @@ static int build_arrays(void)
 	struct rb_node *node;
 	unsigned i;
 
-	new_alloc = mmap(NULL, n_symbols * (sizeof(unsigned long) + sizeof(char*)),
-	                 PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	if (all_names_end == 0)
+		return -ENOENT;
+
+	/* trim all_names to minimal required size */
+	all_names = mremap(all_names, all_names_alloc, all_names_end, 0);
+	assert(all_names != MAP_FAILED);
+	all_names_alloc = all_names_end;
+
+	mprotect(all_names, all_names_alloc, PROT_READ);
+
+	new_alloc = mmap(NULL, ARRAYS_SIZE(n_symbols), PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
 	if (new_alloc == MAP_FAILED)
 		return -ENOMEM;
 	addr_name_arrays = new_alloc;
 
 	addr_array = (unsigned long*) addr_name_arrays;
 	name_array = (char**)(addr_name_arrays + n_symbols * sizeof(unsigned long));
+	trans_id_array = (int*)(name_array + n_symbols);
+	trans_prio_array = trans_id_array + n_symbols;
 
 	i = 0;
 	for (node = rb_first(&addr2fun); node; node = rb_next(node)) {
 		struct symbol *symbol = rb_entry(node, struct symbol, rb_node);
+		struct symbol *s;
+		int trans_id = -1;
+
+		/* prefer symbol names that have a translation defined */
+		for (s = symbol; s; s = s->alias) {
+			trans_id = lat_translator_lookup(all_names + s->name_offset);
+			if (trans_id >= 0) {
+				symbol = s;
+				break;
+			}
+		}
 
 		addr_array[i] = symbol->addr;
 		name_array[i] = all_names + symbol->name_offset;
+		trans_id_array[i] = trans_id >= 0 ? trans_id : -1;
+		trans_prio_array[i] = trans_id >= 0 ? lat_translator_prio(trans_id) : 0;
 
 		i++;
 	}
 	assert(i == n_symbols);
 
-	mprotect(addr_name_arrays, n_symbols * (sizeof(unsigned long) + sizeof(char*)), PROT_READ);
+	mprotect(addr_name_arrays, ARRAYS_SIZE(n_symbols), PROT_READ);
 
 	/* the tree is not needed anymore */
 	delete_slabs();
@@ -288,20 +317,20 @@ static int build_arrays(void)
 	return 0;
 }
 
-const char *sym_translator_lookup(unsigned long ip)
+static int lookup_index(unsigned long ip)
 {
 	unsigned low, high, middle;
 	if (!addr_array || !name_array || !all_names || n_symbols == 0)
-		return NULL;
+		return -1;
 
 	low = 0;
 	high = n_symbols - 1;
 
 	if (ip < addr_array[low])
-		return NULL;
+		return -1;
 
 	if (ip >= addr_array[high])
-		return name_array[high];
+		return high;
 
 	/* Invariant: addr_array[low] <= ip < addr_array[high] */
 
@@ -313,24 +342,103 @@ const char *sym_translator_lookup(unsigned long ip)
 			high = middle;
 	}
 
-	return name_array[low];
+	return low;
+}
+
+unsigned sym_translator_count(void)
+{
+	return n_symbols;
+}
+
+bool sym_translator_built(void)
+{
+	return name_array != NULL;
+}
+
+const char *sym_translator_name(int index)
+{
+	return name_array[index];
+}
+
+unsigned long sym_translator_addr(int index)
+{
+	return addr_array[index];
+}
+
+int sym_translator_translation(int index, int *prio)
+{
+	*prio = trans_prio_array[index];
+	return trans_id_array[index];
+}
+
+/*
+ * The lookups come one at a time from the writers, too short and too many
+ * to time each. One in SYMBOLIZE_SAMPLE is timed and counted for all.
+ */
+#define SYMBOLIZE_SAMPLE 64
+
+int sym_translator_lookup_index(unsigned long ip)
+{
+	static unsigned lookups;
+	uint64_t t;
+	int index;
+
+	if (++lookups % SYMBOLIZE_SAMPLE)
+		return lookup_index(ip);
+
+	t = self_stats_clock();
+	index = lookup_index(ip);
+	self_stats.stage_ns[STAGE_SYMBOLIZE] += (self_stats_clock() - t) * SYMBOLIZE_SAMPLE;
+	return index;
+}
+
+const char *sym_translator_lookup(unsigned long ip)
+{
+	int index = sym_translator_lookup_index(ip);
+
+	return index >= 0 ? name_array[index] : NULL;
 }
 
 int sym_translator_init(void)
+{
+	return sym_translator_init_from("/proc/kallsyms");
+}
+
+int sym_translator_init_from(const char *path)
 {
 	int r;
 
-	r = parse_kallsyms();
+	r = parse_kallsyms(path);
 	if (r)
-		goto err;
+		sym_translator_fini();
+
+	return r;
+}
+
+int sym_translator_add(unsigned long addr, const char *name)
+{
+	size_t len = strlen(name);
+	int r;
+
+	r = reserve_name();
+	if (r)
+		return r;
+
+	if (len > 1023)
+		len = 1023;
+	memcpy(all_names + all_names_end, name, len);
+	all_names[all_names_end + len] = '\0';
+	return add_symbol(addr);
+}
+
+int sym_translator_build(void)
+{
+	int r;
 
 	r = build_arrays();
 	if (r)
-		goto err;
+		sym_translator_fini();
 
-	return 0;
-err:
-	sym_translator_fini();
 	return r;
 }
 
@@ -6,9 +6,28 @@
 #ifndef _SYM_TRANSLATOR_H
 #define _SYM_TRANSLATOR_H
 
+#include <stdbool.h>
+
+/* Only parses kallsyms, it does not need the latencytop translations yet */
 int  sym_translator_init(void);
+/* The same with a file in the kallsyms format, e.g. a generated one */
+int  sym_translator_init_from(const char *path);
+/* Adds a symbol instead of kallsyms, e.g. from a recording */
+int  sym_translator_add(unsigned long addr, const char *name);
+/* Makes the symbols usable for lookups. Call after lat_translator_init(). */
+int  sym_translator_build(void);
 void sym_translator_fini(void);
 /*void sym_translator_dump(void);*/
 const char *sym_translator_lookup(unsigned long ip);
 
+/* Index of the symbol containing ip, or -1 */
+int sym_translator_lookup_index(unsigned long ip);
+unsigned sym_translator_count(void);
+/* Whether sym_translator_build() has made the symbols usable, count() counts the added ones too */
+bool sym_translator_built(void);
+const char *sym_translator_name(int index);
+unsigned long sym_translator_addr(int index);
+/* Returns the symbol's latencytop translation id (or -1) and its priority */
+int sym_translator_translation(int index, int *prio);
+
 #endif
@@ -0,0 +1,85 @@
+/*
+ * symbol_loader loads the symbol map and the latencytop translations on
+ * worker threads, while the main thread is already collecting latencies.
+ * Symbols are only needed when dumping, so the first dump waits for them.
+ *
+ * Copyright 2026 agent
+ * Author: agent <agent@local>
+ * License: GPLv2
+ */
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "symbol_loader.h"
+
+#include "lat_translator.h"
+#include "lattop.h"
+#include "sym_translator.h"
+
+static pthread_t lat_thread, sym_thread;
+static bool started, done;
+static int lat_result, sym_result, result;
+
+static void *load_translations(void *unused)
+{
+	lat_result = lat_translator_init();
+	return NULL;
+}
+
+static void *load_symbols(void *unused)
+{
+	sym_result = arg_kallsyms ? sym_translator_init_from(arg_kallsyms) : sym_translator_init();
+	return NULL;
+}
+
+int symbol_loader_start(void)
+{
+	int r;
+
+	r = pthread_create(&lat_thread, NULL, load_translations, NULL);
+	if (r) {
+		fprintf(stderr, "Failed to create thread: %s\n", strerror(r));
+		return -r;
+	}
+
+	r = pthread_create(&sym_thread, NULL, load_symbols, NULL);
+	if (r) {
+		fprintf(stderr, "Failed to create thread: %s\n", strerror(r));
+		pthread_join(lat_thread, NULL);
+		return -r;
+	}
+
+	started = true;
+	return 0;
+}
+
+int symbol_loader_wait(void)
+{
+	if (done || !started)
+		return result;
+
+	pthread_join(lat_thread, NULL);
+	pthread_join(sym_thread, NULL);
+	done = true;
+
+	if (lat_result)
+		fprintf(stderr, "Warning: Failed to load latencytop translations.\n");
+
+	result = sym_result;
+	if (!result)
+		result = sym_translator_build();
+	if (result)
+		fprintf(stderr, "Failed to init the symbol map.\n");
+
+	return result;
+}
+
+void symbol_loader_fini(void)
+{
+	symbol_loader_wait();
+	sym_translator_fini();
+	lat_translator_fini();
+}
@@ -0,0 +1,15 @@
+/*
+ * Copyright 2026 agent
+ * Author: agent <agent@local>
+ * License: GPLv2
+ */
+#ifndef _SYMBOL_LOADER_H
+#define _SYMBOL_LOADER_H
+
+/* Starts loading kallsyms and latencytop translations in the background */
+int  symbol_loader_start(void);
+/* Waits until the symbols are usable. Returns 0 or -errno. */
+int  symbol_loader_wait(void);
+void symbol_loader_fini(void);
+
+#endif
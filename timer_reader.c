@@ -16,6 +16,16 @@
 
 #include "lattop.h"
 #include "process_accountant.h"
+#include "symbol_loader.h"
+#include "governor.h"
+#include "tui.h"
+#include "daemon.h"
+#include "metrics.h"
+#include "shm_writer.h"
+#include "recording.h"
+#include "probes.h"
+#include "self_stats.h"
+#include "timespan.h"
 
 struct timer_reader {
 	/* must be first */
@@ -31,8 +41,8 @@ static int timer_reader_start(struct polled_reader *pr)
 {
 	struct timer_reader *tr = (struct timer_reader*) pr;
 	const struct itimerspec its = {
-		.it_interval = { arg_interval, 0 },
-		.it_value =    { arg_interval, 0 },
+		.it_interval = { arg_interval_ms / MSEC_PER_SEC, arg_interval_ms % MSEC_PER_SEC * NSEC_PER_MSEC },
+		.it_value =    { arg_interval_ms / MSEC_PER_SEC, arg_interval_ms % MSEC_PER_SEC * NSEC_PER_MSEC },
 	};
 	int r;
 
@@ -50,6 +60,36 @@ static int timer_reader_start(struct polled_reader *pr)
 	return 0;
 }
 
+int timer_reader_tick(void)
+{
+	uint64_t start;
+	int r;
+
+	start = self_stats_clock();
+
+	/* events collected so far are kept, only symbolization must wait */
+	r = symbol_loader_wait();
+	if (r)
+		return r;
+
+	governor_tick();
+	if (arg_metrics)
+		metrics_update();
+	if (arg_shm)
+		shm_writer_publish();
+	if (arg_record)
+		recording_add_interval();
+	if (arg_daemon)
+		daemon_tick();
+	else if (arg_interactive)
+		tui_update();
+	else
+		pa_dump_and_clear();
+
+	LATTOP_PROBE1(tick_end, self_stats_clock() - start);
+	return 0;
+}
+
 static int timer_reader_handle_ready_fd(struct polled_reader *pr)
 {
 	struct timer_reader *tr = (struct timer_reader*) pr;
@@ -62,7 +102,10 @@ static int timer_reader_handle_ready_fd(struct polled_reader *pr)
 		return -1;
 	}
 
-	pa_dump_and_clear();
+	LATTOP_PROBE1(tick_begin, expired);
+	r = timer_reader_tick();
+	if (r)
+		return r;
 
 	if (tr->count <= 0)  /* run indefinitely */
 		return 0;
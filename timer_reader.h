@@ -10,5 +10,7 @@
 #include "polled_reader.h"
 
 struct polled_reader *timer_reader_new();
+/* Ends the interval now, as the timer does. Returns -errno on failure. */
+int timer_reader_tick(void);
 
 #endif
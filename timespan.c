@@ -1,6 +1,9 @@
 #include <assert.h>
+#include <errno.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include "timespan.h"
 
@@ -36,9 +39,11 @@ char *format_timespan(char *buf, size_t l, uint64_t usec, unsigned significant_d
                 { "ms", USEC_PER_MSEC },
                 { "us", 1 },
         };
-	uint64_t tmp;
-	unsigned log;
-	int i, prec, printed;
+	static const uint64_t pow10[] = { 1, 10, 100, 1000, 10000, 100000, 1000000 };
+	char tmp[48], *p = tmp + sizeof(tmp);
+	uint64_t scaled, unit;
+	unsigned log, prec, len;
+	int i;
 
 	assert(l > 0);
 
@@ -47,25 +52,94 @@ char *format_timespan(char *buf, size_t l, uint64_t usec, unsigned significant_d
                 if (usec >= table[i].usec)
                         break;
 	}
+	unit = table[i].usec;
 
 	if (i != ELEMENTSOF(table)-1) {
 		log = 0;
-		tmp = usec / table[i].usec;
-		while (tmp > 0) {
-			tmp /= 10;
+		for (scaled = usec / unit; scaled > 0; scaled /= 10)
 			log++;
-		}
 
 		prec = significant_digits - MIN(log, significant_digits);
+		prec = MIN(prec, ELEMENTSOF(pow10) - 1);
 	} else
 		prec = 0;
 
-	printed = snprintf(buf, l, "%.*f %s", prec, (double)usec / table[i].usec, table[i].suffix);
-	if (printed >= l) {
+	/* integer math only: usec/unit with prec decimal places, rounded half up */
+	scaled = (usec * pow10[prec] + unit / 2) / unit;
+
+	/* built from the end: suffix, fraction, integer part */
+	len = strlen(table[i].suffix);
+	p -= len;
+	memcpy(p, table[i].suffix, len);
+	*--p = ' ';
+	if (prec > 0) {
+		for (log = 0; log < prec; log++) {
+			*--p = '0' + scaled % 10;
+			scaled /= 10;
+		}
+		*--p = '.';
+	}
+	do {
+		*--p = '0' + scaled % 10;
+		scaled /= 10;
+	} while (scaled);
+
+	len = tmp + sizeof(tmp) - p;
+	if (len >= l) {
 		memset(buf, '#', l-1);
 		buf[l-1] = '\0';
 		return NULL;
 	}
 
+	memcpy(buf, p, len);
+	buf[len] = '\0';
         return buf;
 }
+
+int parse_timestamp(const char *s, time_t *ret)
+{
+	static const char *const formats[] = {
+		"%Y-%m-%d %H:%M:%S", "%Y-%m-%dT%H:%M:%S",
+		"%Y-%m-%d %H:%M", "%Y-%m-%dT%H:%M", "%Y-%m-%d",
+	};
+	struct tm tm;
+	time_t now;
+	char *end;
+	unsigned i;
+
+	if (s[0] == '@') {
+		errno = 0;
+		*ret = strtoll(s + 1, &end, 10);
+		return errno || end == s + 1 || *end ? -EINVAL : 0;
+	}
+
+	for (i = 0; i < ELEMENTSOF(formats); i++) {
+		memset(&tm, 0, sizeof(tm));
+		end = strptime(s, formats[i], &tm);
+		if (end && !*end)
+			goto found;
+	}
+
+	/* a time of day, the last one not in the future */
+	time(&now);
+	localtime_r(&now, &tm);
+	tm.tm_sec = 0;
+	end = strptime(s, "%H:%M:%S", &tm);
+	if (!end || *end)
+		end = strptime(s, "%H:%M", &tm);
+	if (!end || *end)
+		return -EINVAL;
+	tm.tm_isdst = -1;
+	*ret = mktime(&tm);
+	if (*ret > now) {
+		tm.tm_mday--;
+		tm.tm_isdst = -1;
+		*ret = mktime(&tm);
+	}
+	return *ret == -1 ? -EINVAL : 0;
+
+found:
+	tm.tm_isdst = -1;
+	*ret = mktime(&tm);
+	return *ret == -1 ? -EINVAL : 0;
+}
@@ -2,6 +2,7 @@
 #define _TIMESPAN_H
 
 #include <stdint.h>
+#include <time.h>
 
 #define MSEC_PER_SEC  1000ULL
 #define USEC_PER_SEC  1000000ULL
@@ -24,5 +25,10 @@
 #define NSEC_PER_YEAR (31557600ULL*NSEC_PER_SEC)
 
 char *format_timespan(char *buf, size_t l, uint64_t usec, unsigned significant_digits);
+/*
+ * Parses "YYYY-MM-DD[ HH:MM[:SS]]", "@SECONDS" or "HH:MM[:SS]" (the most
+ * recent past one) in local time. Returns 0 or -EINVAL.
+ */
+int parse_timestamp(const char *s, time_t *ret);
 
 #endif
@@ -0,0 +1,726 @@
+/*
+ * The interactive mode. Every interval replaces the shown snapshot of
+ * latencies. The keys switch the sort order and move between the views:
+ * threads -> the stacks of one process (all its threads) -> the frames of
+ * one stack and its worst events. The selection sticks to the same thread
+ * or stack across intervals. ':' prompts for a command of command_reader.c
+ * on the message line.
+ *
+ * Copyright 2026 agent
+ * Author: agent <agent@local>
+ * License: GPLv2
+ */
+
+#include <limits.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "tui.h"
+
+#include "back_trace.h"
+#include "command_reader.h"
+#include "lattop.h"
+#include "process.h"
+#include "process_accountant.h"
+#include "screen.h"
+#include "stack_table.h"
+#include "sym_translator.h"
+#include "timespan.h"
+
+enum view {
+	VIEW_THREADS,
+	VIEW_STACKS,
+	VIEW_FRAMES,
+	_NR_VIEWS
+};
+
+/* title, column header, ..., message, keys */
+#define LIST_FIRST_ROW 2
+#define NON_LIST_ROWS  4
+
+#define KEY_CTRL_L     0x0c
+#define KEY_ESC        0x1b
+#define KEY_BACKSPACE  0x7f
+
+enum {
+	KEY_UP = 0x100,
+	KEY_DOWN,
+	KEY_LEFT,
+	KEY_RIGHT,
+	KEY_PGUP,
+	KEY_PGDN,
+	KEY_HOME,
+	KEY_END,
+};
+
+struct tui_reader {
+	/* must be first */
+	struct polled_reader pr;
+};
+
+static bool active;
+static bool have_data;
+/* the command being typed after ':' */
+static bool prompting;
+static char prompt[256];
+static unsigned prompt_len;
+static struct pa_snapshot snap;
+
+static enum sort_by sort;
+static bool reverse;
+static enum view view;
+static unsigned sel[_NR_VIEWS], top[_NR_VIEWS];
+
+/* VIEW_THREADS, in the display order */
+static struct process **threads;
+static unsigned nthreads, threads_alloc;
+static pid_t sel_tid;
+
+/* VIEW_STACKS, the process's stacks merged over its threads */
+static pid_t cur_pid;
+static char cur_comm[16];
+static struct bt2la *stacks, **stack_order;
+static unsigned nstacks, stacks_alloc;
+static uint64_t cur_total;
+static int sel_stack = -1;
+
+/* VIEW_FRAMES */
+static int cur_stack;
+static struct back_trace cur_bt;
+static unsigned nframes;
+
+static unsigned list_rows(void)
+{
+	unsigned rows = screen_rows();
+	return rows > NON_LIST_ROWS ? rows - NON_LIST_ROWS : 1;
+}
+
+static unsigned view_length(void)
+{
+	switch (view) {
+	case VIEW_THREADS:
+		return nthreads;
+	case VIEW_STACKS:
+		return nstacks;
+	default:
+		return nframes;
+	}
+}
+
+static void remember_selection(void)
+{
+	if (view == VIEW_THREADS && sel[view] < nthreads)
+		sel_tid = threads[sel[view]]->tid;
+	else if (view == VIEW_STACKS && sel[view] < nstacks)
+		sel_stack = stack_order[sel[view]]->stack_id;
+}
+
+static void clamp_selection(void)
+{
+	unsigned n = view_length(), rows = list_rows();
+
+	if (sel[view] >= n)
+		sel[view] = n ? n - 1 : 0;
+	if (top[view] > sel[view])
+		top[view] = sel[view];
+	if (sel[view] >= top[view] + rows)
+		top[view] = sel[view] - rows + 1;
+}
+
+static int rebuild_threads(void)
+{
+	struct rb_node *node;
+	struct process **a;
+	unsigned i;
+
+	if (snap.count > threads_alloc) {
+		a = realloc(threads, snap.count * sizeof(*threads));
+		if (!a)
+			return -ENOMEM;
+		threads = a;
+		threads_alloc = snap.count;
+	}
+
+	nthreads = 0;
+	for (node = rb_first(&snap.processes); node; node = rb_next(node))
+		threads[nthreads++] = rb_entry(node, struct process, rb_node);
+
+	pa_sort_processes(threads, nthreads, sort);
+	if (reverse) {
+		for (i = 0; i < nthreads / 2; i++) {
+			struct process *tmp = threads[i];
+			threads[i] = threads[nthreads - i - 1];
+			threads[nthreads - i - 1] = tmp;
+		}
+	}
+
+	for (i = 0; i < nthreads; i++) {
+		if (threads[i]->tid == sel_tid) {
+			sel[VIEW_THREADS] = i;
+			break;
+		}
+	}
+
+	return 0;
+}
+
+static int compare_bt2la_by_stack(const void *p1, const void *p2)
+{
+	const struct bt2la *b1 = *(const struct bt2la**) p1;
+	const struct bt2la *b2 = *(const struct bt2la**) p2;
+
+	return (b1->stack_id > b2->stack_id) - (b1->stack_id < b2->stack_id);
+}
+
+static int rebuild_stacks(void)
+{
+	struct rb_node *node, *n2;
+	struct bt2la *s, **o;
+	unsigned nall = 0, i;
+
+	for (i = 0; i < nthreads; i++)
+		if (threads[i]->pid == cur_pid)
+			nall += threads[i]->bt2la_count;
+
+	if (nall > stacks_alloc) {
+		s = realloc(stacks, nall * sizeof(*stacks));
+		if (!s)
+			return -ENOMEM;
+		stacks = s;
+		o = realloc(stack_order, nall * sizeof(*stack_order));
+		if (!o)
+			return -ENOMEM;
+		stack_order = o;
+		stacks_alloc = nall;
+	}
+
+	/* collect the stacks of all the threads, then merge the equal ones */
+	nall = 0;
+	for (node = rb_first(&snap.processes); node; node = rb_next(node)) {
+		struct process *p = rb_entry(node, struct process, rb_node);
+		if (p->pid != cur_pid)
+			continue;
+		for (n2 = rb_first(&p->bt2la_map); n2; n2 = rb_next(n2))
+			stack_order[nall++] = rb_entry(n2, struct bt2la, rb_node);
+	}
+	qsort(stack_order, nall, sizeof(*stack_order), compare_bt2la_by_stack);
+
+	nstacks = 0;
+	cur_total = 0;
+	for (i = 0; i < nall; i++) {
+		const struct bt2la *b = stack_order[i];
+
+		cur_total += b->la.total;
+		if (nstacks && stacks[nstacks-1].stack_id == b->stack_id)
+			la_merge(&stacks[nstacks-1].la, &b->la);
+		else
+			stacks[nstacks++] = *b;
+	}
+
+	for (i = 0; i < nstacks; i++)
+		stack_order[i] = &stacks[i];
+	process_sort_bt2las(stack_order, nstacks, sort, reverse);
+
+	for (i = 0; i < nstacks; i++) {
+		if (stack_order[i]->stack_id == sel_stack) {
+			sel[VIEW_STACKS] = i;
+			break;
+		}
+	}
+
+	return 0;
+}
+
+static void rebuild(void)
+{
+	enum view v;
+	int r;
+
+	r = rebuild_threads();
+	if (!r && view >= VIEW_STACKS)
+		r = rebuild_stacks();
+	if (r)
+		fprintf(stderr, "Failed to update the view: %s\n", strerror(-r));
+
+	for (v = VIEW_THREADS; v <= view; v++) {
+		enum view shown = view;
+		view = v;
+		clamp_selection();
+		remember_selection();
+		view = shown;
+	}
+}
+
+static const char *stack_name(const struct back_trace *bt, char *buf, size_t len)
+{
+	const char *translation;
+	size_t end;
+
+	translation = bt_translate(bt);
+	if (translation)
+		return translation;
+
+	bt_save_symbolic(bt, buf + 1, len - 2);
+	end = strlen(buf + 1);
+	buf[0] = '[';
+	buf[end + 1] = ']';
+	buf[end + 2] = '\0';
+	return buf;
+}
+
+static void draw_threads(void)
+{
+	char max[32], total[32], sleep[32], block[32];
+	unsigned i, row = LIST_FIRST_ROW;
+
+	screen_line(0, ATTR_BOLD, "lattop: %u threads, sorted by %s%s",
+	            nthreads, lattop_sort_name(sort), reverse ? " (reversed)" : "");
+	screen_line(1, ATTR_REVERSE, "%7s %7s  %-16s %10s %10s %10s %10s %10s",
+	            "PID", "TID", "COMMAND", "MAX", "TOTAL", "SLEEP", "BLOCK", "COUNT");
+
+	for (i = top[view]; i < nthreads && row < LIST_FIRST_ROW + list_rows(); i++, row++) {
+		const struct process *p = threads[i];
+
+		format_timespan(max,   sizeof(max),   p->summarized.max/1000,   3);
+		format_timespan(total, sizeof(total), p->summarized.total/1000, 3);
+		format_timespan(sleep, sizeof(sleep), p->summarized.state_total[LA_SLEEP]/1000, 3);
+		format_timespan(block, sizeof(block), p->summarized.state_total[LA_BLOCK]/1000, 3);
+		screen_line(row, i == sel[view] ? ATTR_REVERSE : ATTR_NORMAL,
+		            "%7d %7d  %-16s %10s %10s %10s %10s %10llu",
+		            p->pid, p->tid, p->comm, max, total, sleep, block,
+		            (unsigned long long) p->summarized.count);
+	}
+	screen_clear_lines(row);
+}
+
+static void draw_stacks(void)
+{
+	char max[32], total[32], sleep[32], block[32], sym_bt[1000];
+	unsigned i, row = LIST_FIRST_ROW;
+	struct back_trace bt;
+
+	screen_line(0, ATTR_BOLD, "lattop: %s (%d), %u stacks, sorted by %s%s",
+	            cur_comm, cur_pid, nstacks, lattop_sort_name(sort), reverse ? " (reversed)" : "");
+	screen_line(1, ATTR_REVERSE, "%10s %10s %10s %10s %10s %6s  %s",
+	            "MAX", "TOTAL", "SLEEP", "BLOCK", "COUNT", "%", "CAUSE");
+
+	for (i = top[view]; i < nstacks && row < LIST_FIRST_ROW + list_rows(); i++, row++) {
+		const struct bt2la *b = stack_order[i];
+
+		stack_table_get(b->stack_id, &bt);
+		format_timespan(max,   sizeof(max),   b->la.max/1000,   3);
+		format_timespan(total, sizeof(total), b->la.total/1000, 3);
+		format_timespan(sleep, sizeof(sleep), b->la.state_total[LA_SLEEP]/1000, 3);
+		format_timespan(block, sizeof(block), b->la.state_total[LA_BLOCK]/1000, 3);
+		screen_line(row, i == sel[view] ? ATTR_REVERSE : ATTR_NORMAL,
+		            "%10s %10s %10s %10s %10llu %5.1f%%  %s", max, total, sleep, block,
+		            (unsigned long long) b->la.count,
+		            cur_total ? b->la.total * 100.0 / cur_total : 0.0,
+		            stack_name(&bt, sym_bt, sizeof(sym_bt)));
+	}
+	screen_clear_lines(row);
+}
+
+/* The stack's largest events below the frames, as far as they fit */
+static unsigned draw_exemplars(const struct bt2la *b, unsigned row)
+{
+	struct la_event ex[LA_EXEMPLARS];
+	char when[32], delay[32];
+	unsigned i, n;
+	struct tm tm;
+	time_t t;
+
+	n = la_sorted_exemplars(&b->la, ex);
+	if (!n || row + 2 > LIST_FIRST_ROW + list_rows())
+		return row;
+
+	screen_line(row++, ATTR_NORMAL, "%s", "");
+	screen_line(row++, ATTR_REVERSE, "%-26s %7s %4s %4s %10s",
+	            "WORST AT", "TID", "CPU", "TYPE", "DELAY");
+	for (i = 0; i < n && row < LIST_FIRST_ROW + list_rows(); i++, row++) {
+		t = ex[i].time / NSEC_PER_SEC;
+		strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", localtime_r(&t, &tm));
+		format_timespan(delay, sizeof(delay), ex[i].delay/1000, 3);
+		screen_line(row, ATTR_NORMAL, "%s.%06u %7d %4u %4c %10s", when,
+		            (unsigned) (ex[i].time % NSEC_PER_SEC / 1000),
+		            ex[i].tid, ex[i].cpu, ex[i].type, delay);
+	}
+	return row;
+}
+
+static void draw_frames(void)
+{
+	char max[32], total[32], sym_bt[1000];
+	const struct bt2la *b = NULL;
+	unsigned i, row = LIST_FIRST_ROW;
+	const char *name;
+
+	for (i = 0; i < nstacks; i++) {
+		if (stacks[i].stack_id == cur_stack) {
+			b = &stacks[i];
+			break;
+		}
+	}
+
+	if (b) {
+		format_timespan(max,   sizeof(max),   b->la.max/1000,   3);
+		format_timespan(total, sizeof(total), b->la.total/1000, 3);
+		screen_line(0, ATTR_BOLD, "lattop: %s (%d), %s: max %s, total %s, count %llu",
+		            cur_comm, cur_pid, stack_name(&cur_bt, sym_bt, sizeof(sym_bt)),
+		            max, total, (unsigned long long) b->la.count);
+	} else
+		screen_line(0, ATTR_BOLD, "lattop: %s (%d), %s: none in the last interval",
+		            cur_comm, cur_pid, stack_name(&cur_bt, sym_bt, sizeof(sym_bt)));
+	screen_line(1, ATTR_REVERSE, "%3s  %-18s  %s", "#", "ADDRESS", "FUNCTION");
+
+	for (i = top[view]; i < nframes && row < LIST_FIRST_ROW + list_rows(); i++, row++) {
+		name = sym_translator_lookup(cur_bt.trace[i]);
+		screen_line(row, i == sel[view] ? ATTR_REVERSE : ATTR_NORMAL,
+		            "%3u  0x%016lx  %s", i, cur_bt.trace[i], name ?: "?");
+	}
+	if (b && i == nframes)
+		row = draw_exemplars(b, row);
+	screen_clear_lines(row);
+}
+
+static void draw(void)
+{
+	static const char *const keys[_NR_VIEWS] = {
+		[VIEW_THREADS] = "q:quit  m/t/p/c/s/b:sort by max/total/pid/count/sleep/block  r:reverse  Enter:process  ::command",
+		[VIEW_STACKS]  = "q:quit  m/t/c/s/b:sort by max/total/count/sleep/block  r:reverse  Enter:frames  Esc:back  ::command",
+		[VIEW_FRAMES]  = "q:quit  Esc:back  ::command",
+	};
+	unsigned rows = screen_rows();
+	const char *msg;
+	char buf[32];
+	int r;
+
+	if (!active)
+		return;
+
+	if (!have_data) {
+		screen_line(0, ATTR_BOLD, "lattop: waiting for the first interval (%s)",
+		            format_timespan(buf, sizeof(buf), arg_interval_ms * USEC_PER_MSEC, 0));
+		screen_clear_lines(1);
+	} else if (view == VIEW_THREADS)
+		draw_threads();
+	else if (view == VIEW_STACKS)
+		draw_stacks();
+	else
+		draw_frames();
+
+	msg = screen_last_message();
+	if (rows > NON_LIST_ROWS && prompting) {
+		screen_line(rows - 2, ATTR_NORMAL, ":%.*s", (int) prompt_len, prompt);
+		screen_line(rows - 1, ATTR_BOLD, "%s",
+		            "Enter:run  Esc:cancel  e.g. min-latency USEC, pid-filter PID, no-filter");
+	} else if (rows > NON_LIST_ROWS) {
+		screen_line(rows - 2, ATTR_NORMAL, "%s", msg ?: "");
+		screen_line(rows - 1, ATTR_BOLD, "%s", keys[view]);
+	}
+
+	r = screen_refresh();
+	if (r < 0)
+		fprintf(stderr, "Failed to update the screen: %s\n", strerror(-r));
+}
+
+static void enter(void)
+{
+	const struct process *p;
+	unsigned i;
+
+	if (view == VIEW_THREADS && sel[view] < nthreads) {
+		p = threads[sel[view]];
+		cur_pid = p->pid;
+		strcpy(cur_comm, p->comm);
+		for (i = 0; i < nthreads; i++)
+			if (threads[i]->tid == cur_pid)
+				strcpy(cur_comm, threads[i]->comm);
+		view = VIEW_STACKS;
+		sel[view] = top[view] = 0;
+		sel_stack = -1;
+		rebuild();
+	} else if (view == VIEW_STACKS && sel[view] < nstacks) {
+		cur_stack = stack_order[sel[view]]->stack_id;
+		nframes = stack_table_get(cur_stack, &cur_bt);
+		view = VIEW_FRAMES;
+		sel[view] = top[view] = 0;
+	}
+}
+
+static void leave(void)
+{
+	if (view == VIEW_THREADS)
+		return;
+	view--;
+	clamp_selection();
+}
+
+static void move(int delta)
+{
+	int n = view_length();
+	int s = (int) sel[view] + delta;
+
+	if (s >= n)
+		s = n - 1;
+	if (s < 0)
+		s = 0;
+	sel[view] = s;
+	clamp_selection();
+	remember_selection();
+}
+
+static void set_sort(enum sort_by s)
+{
+	sort = s;
+	rebuild();
+}
+
+static void prompt_key(int key)
+{
+	switch (key) {
+	case '\r':
+	case '\n':
+		prompting = false;
+		prompt[prompt_len] = '\0';
+		command_run(prompt);
+		break;
+	case KEY_ESC:
+		prompting = false;
+		break;
+	case KEY_BACKSPACE:
+	case '\b':
+		if (prompt_len)
+			prompt_len--;
+		break;
+	default:
+		if (key >= ' ' && key < KEY_BACKSPACE && prompt_len < sizeof(prompt) - 1)
+			prompt[prompt_len++] = key;
+		break;
+	}
+}
+
+/* Returns 1 to quit */
+static int handle_key(int key)
+{
+	if (prompting) {
+		prompt_key(key);
+		return 0;
+	}
+
+	switch (key) {
+	case 'q':
+	case 'Q':
+		return 1;
+	case 'm':
+		set_sort(SORT_BY_MAX_LATENCY);
+		break;
+	case 't':
+		set_sort(SORT_BY_TOTAL_LATENCY);
+		break;
+	case 'p':
+		set_sort(SORT_BY_PID);
+		break;
+	case 'c':
+		set_sort(SORT_BY_COUNT);
+		break;
+	case 's':
+		set_sort(SORT_BY_SLEEP);
+		break;
+	case 'b':
+		set_sort(SORT_BY_BLOCK);
+		break;
+	case 'r':
+		reverse = !reverse;
+		rebuild();
+		break;
+	case KEY_UP:
+	case 'k':
+		move(-1);
+		break;
+	case KEY_DOWN:
+	case 'j':
+		move(1);
+		break;
+	case KEY_PGUP:
+		move(-(int) list_rows());
+		break;
+	case KEY_PGDN:
+	case ' ':
+		move(list_rows());
+		break;
+	case KEY_HOME:
+	case 'g':
+		move(INT_MIN / 2);
+		break;
+	case KEY_END:
+	case 'G':
+		move(INT_MAX / 2);
+		break;
+	case '\r':
+	case '\n':
+	case KEY_RIGHT:
+	case 'l':
+		enter();
+		break;
+	case KEY_ESC:
+	case KEY_BACKSPACE:
+	case '\b':
+	case KEY_LEFT:
+	case 'h':
+		leave();
+		break;
+	case KEY_CTRL_L:
+		screen_invalidate();
+		break;
+	case ':':
+		prompting = true;
+		prompt_len = 0;
+		break;
+	}
+
+	return 0;
+}
+
+/* Decodes one key, returns the number of bytes used */
+static int decode_key(const unsigned char *buf, int len, int *key)
+{
+	int i;
+
+	*key = buf[0];
+	if (buf[0] != KEY_ESC || len < 3 || (buf[1] != '[' && buf[1] != 'O'))
+		return 1;	/* a lone Esc too */
+
+	switch (buf[2]) {
+	case 'A': *key = KEY_UP;    return 3;
+	case 'B': *key = KEY_DOWN;  return 3;
+	case 'C': *key = KEY_RIGHT; return 3;
+	case 'D': *key = KEY_LEFT;  return 3;
+	case 'H': *key = KEY_HOME;  return 3;
+	case 'F': *key = KEY_END;   return 3;
+	}
+
+	/* ESC [ number ~ */
+	for (i = 2; i < len && buf[i] >= '0' && buf[i] <= '9'; i++)
+		;
+	if (i == 2 || i >= len || buf[i] != '~') {
+		*key = 0;	/* unknown, skip the introducer */
+		return 2;
+	}
+
+	switch (atoi((const char *) buf + 2)) {
+	case 1: case 7: *key = KEY_HOME; break;
+	case 4: case 8: *key = KEY_END;  break;
+	case 5:         *key = KEY_PGUP; break;
+	case 6:         *key = KEY_PGDN; break;
+	default:        *key = 0;        break;
+	}
+	return i + 1;
+}
+
+static int tui_reader_handle_ready_fd(struct polled_reader *pr)
+{
+	unsigned char buf[64];
+	ssize_t n;
+	int i, key, r = 0;
+
+	n = read(STDIN_FILENO, buf, sizeof(buf));
+	if (n < 0)
+		return errno == EAGAIN || errno == EINTR ? 0 : -errno;
+	if (n == 0) {
+		lattop_reader_stopped(pr);
+		return 0;
+	}
+
+	for (i = 0; i < n && !r; ) {
+		i += decode_key(buf + i, n - i, &key);
+		r = handle_key(key);
+	}
+
+	if (!r)
+		draw();
+	return r;
+}
+
+static void tui_reader_fini(struct polled_reader *pr)
+{
+	pa_snapshot_free(&snap);
+	free(threads);
+	free(stacks);
+	free(stack_order);
+	screen_fini();
+	active = false;
+}
+
+static int tui_reader_get_fd(struct polled_reader *pr)
+{
+	return STDIN_FILENO;
+}
+
+static const struct polled_reader_ops tui_reader_ops = {
+	.fini = tui_reader_fini,
+	.get_fd = tui_reader_get_fd,
+	.handle_ready_fd = tui_reader_handle_ready_fd,
+};
+
+struct polled_reader *tui_reader_new(void)
+{
+	struct tui_reader *r;
+
+	r = calloc(1, sizeof(struct tui_reader));
+	if (r == NULL)
+		return NULL;
+
+	r->pr.ops = &tui_reader_ops;
+
+	return &r->pr;
+}
+
+int tui_init(void)
+{
+	int r;
+
+	r = screen_init();
+	if (r < 0) {
+		fprintf(stderr, "Cannot use the terminal for the interactive mode: %s\n",
+		        strerror(-r));
+		return r;
+	}
+
+	snap.processes = RB_ROOT;
+	sort = arg_sort;
+	reverse = arg_reverse;
+	active = true;
+	draw();
+	return 0;
+}
+
+void tui_update(void)
+{
+	pa_snapshot_free(&snap);
+	pa_take_snapshot(&snap);
+	have_data = true;
+	rebuild();
+	draw();
+}
+
+void tui_resize(void)
+{
+	int r;
+
+	if (!active)
+		return;
+
+	r = screen_resize();
+	if (r < 0) {
+		fprintf(stderr, "Failed to resize the screen: %s\n", strerror(-r));
+		return;
+	}
+	clamp_selection();
+	draw();
+}
@@ -0,0 +1,21 @@
+/*
+ * Copyright 2026 agent
+ * Author: agent <agent@local>
+ * License: GPLv2
+ */
+#ifndef _TUI_H
+#define _TUI_H
+
+#include "polled_reader.h"
+
+/* Takes over the terminal. Call before any child process is started. */
+int  tui_init(void);
+/* The keyboard reader, its fini gives the terminal back */
+struct polled_reader *tui_reader_new(void);
+
+/* Shows the interval that just ended instead of printing a report */
+void tui_update(void);
+/* SIGWINCH */
+void tui_resize(void);
+
+#endif